@@ -8,4 +8,8 @@ glslc.exe shaderSkel.vert -o anim_v.spv
 
 glslc.exe offscreenSkel.vert -o animOffscreen_v.spv
 
+glslc.exe shaderBaked.vert -o baked_v.spv
+
+glslc.exe offscreenBaked.vert -o bakedOffscreen_v.spv
+
 pause
\ No newline at end of file
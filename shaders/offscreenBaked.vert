@@ -0,0 +1,36 @@
+#version 450
+    
+layout(binding = 0) uniform UniformBufferObject 
+{   
+    mat4 MVP;
+    // A baked position is boundsMin + its 16 bit values * boundsScale, the frames start at frameOffsets
+    vec4 bakedBoundsMin;
+    vec4 bakedBoundsScale;
+    uvec2 bakedFrameOffsets;
+    float bakedFrameAlpha;
+    float bakedPadding;
+} ubo;
+
+// Every frame's vertices one after another, x | y << 16 and z | octahedral normal << 16, baked on the CPU
+layout(std430, binding = 1) readonly buffer BakedAnimation
+{
+    uvec2 vertices[];
+} baked;
+
+// no vertex streams bound, the positions come from the baked frames
+
+vec3 decodePosition(uvec2 v)
+{
+    return ubo.bakedBoundsMin.xyz + vec3(v.x & 0xffffu, v.x >> 16, v.y & 0xffffu) * ubo.bakedBoundsScale.xyz;
+}
+    
+
+void main() 
+{   
+    uvec2 vertex0 = baked.vertices[ubo.bakedFrameOffsets.x + uint(gl_VertexIndex)];
+    uvec2 vertex1 = baked.vertices[ubo.bakedFrameOffsets.y + uint(gl_VertexIndex)];
+    vec3 bakedPosition = mix(decodePosition(vertex0), decodePosition(vertex1), ubo.bakedFrameAlpha);
+
+    gl_Position = ubo.MVP * vec4(bakedPosition, 1.0f);
+    
+}
\ No newline at end of file
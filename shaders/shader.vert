@@ -1,4 +1,5 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout(binding = 0) uniform UniformBufferObject 
 {
@@ -20,10 +21,8 @@ layout(binding = 0) uniform UniformBufferObject
 } pushConstants;*/
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
-layout(location = 3) in vec3 inNormal;
-layout(location = 4) in vec3 inTangent;
+layout(location = 3) in vec4 inNormalTangent;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
@@ -38,6 +37,8 @@ const mat4 biasMat = mat4(
 	0.0, 0.0, 1.0, 0.0,
 	0.5, 0.5, 0.0, 1.0 );
 
+#include "vertexFormat.glsl"
+
 
 void main() 
 {
@@ -53,8 +54,10 @@ void main()
     vec3 CameraPosition = inverse(ubo.view)[3].xyz;
     fragViewDir = normalize(CameraPosition - Positon.xyz);    
 
-    vec3 T = normalize(ubo.model*vec4(inTangent, 0.0f)).xyz;
-    vec3 N = normalize(ubo.model*vec4(inNormal, 0.0f)).xyz;
+    vec3 normal, tangent;
+    decodeNormalTangent(inNormalTangent, normal, tangent);
+    vec3 T = normalize(ubo.model*vec4(tangent, 0.0f)).xyz;
+    vec3 N = normalize(ubo.model*vec4(normal, 0.0f)).xyz;
     vec3 B = normalize(cross(N, T));
     fragTBN = mat3(T, B, N);
 }
\ No newline at end of file
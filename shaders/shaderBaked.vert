@@ -0,0 +1,91 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+    
+layout(binding = 0) uniform UniformBufferObject 
+{   
+    mat4 model;
+	mat4 view;
+	mat4 proj;
+	mat4 depthMVP;
+	vec4 light;
+	vec4 modelColor;
+	float modelLightReflection;
+	float textured;
+    float padding1;
+    float padding2;
+    // A baked position is boundsMin + its 16 bit values * boundsScale, the frames start at frameOffsets
+    vec4 bakedBoundsMin;
+    vec4 bakedBoundsScale;
+    uvec2 bakedFrameOffsets;
+    float bakedFrameAlpha;
+    float bakedPadding;
+} ubo;
+
+// Every frame's vertices one after another, x | y << 16 and z | octahedral normal << 16, baked on the CPU
+layout(std430, binding = 4) readonly buffer BakedAnimation
+{
+    uvec2 vertices[];
+} baked;
+    
+// positions and normals come from the baked frames, only the surface stream is bound
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec4 inNormalTangent;
+    
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out mat3 fragTBN;
+layout(location = 5) out vec3 fragViewDir;
+layout(location = 6) out vec3 fragLight;
+layout(location = 7) out vec4 fragLightCamPosition;
+    
+const mat4 biasMat = mat4( 
+	0.5, 0.0, 0.0, 0.0,
+	0.0, 0.5, 0.0, 0.0,
+	0.0, 0.0, 1.0, 0.0,
+	0.5, 0.5, 0.0, 1.0 );
+
+vec3 decodePosition(uvec2 v)
+{
+    return ubo.bakedBoundsMin.xyz + vec3(v.x & 0xffffu, v.x >> 16, v.y & 0xffffu) * ubo.bakedBoundsScale.xyz;
+}
+
+vec3 decodeNormal(uvec2 v)
+{
+    vec2 e = vec2((v.y >> 16) & 0xffu, v.y >> 24) / 255.0f * 2.0f - 1.0f;
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float fold = max(-n.z, 0.0f);
+    n.x -= n.x >= 0.0f ? fold : -fold;
+    n.y -= n.y >= 0.0f ? fold : -fold;
+    return normalize(n);
+}
+
+#include "vertexFormat.glsl"
+
+
+void main() 
+{   
+    fragLight = ubo.light.xyz;
+    fragTexCoord = inTexCoord;
+    fragColor=ubo.modelColor.xyz;
+
+    uvec2 vertex0 = baked.vertices[ubo.bakedFrameOffsets.x + uint(gl_VertexIndex)];
+    uvec2 vertex1 = baked.vertices[ubo.bakedFrameOffsets.y + uint(gl_VertexIndex)];
+    vec3 bakedPosition = mix(decodePosition(vertex0), decodePosition(vertex1), ubo.bakedFrameAlpha);
+    vec3 bakedNormal = normalize(mix(decodeNormal(vertex0), decodeNormal(vertex1), ubo.bakedFrameAlpha));
+    // tangents aren't baked, the bind one made perpendicular to the baked normal again is close enough
+    vec3 bindNormal, bindTangent;
+    decodeNormalTangent(inNormalTangent, bindNormal, bindTangent);
+    vec3 bakedTangent = bindTangent - bakedNormal * dot(bakedNormal, bindTangent);
+
+    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(bakedPosition, 1.0f);
+    fragLightCamPosition = biasMat * ubo.depthMVP * vec4(bakedPosition, 1.0f);
+
+    vec3 Positon = (ubo.model * vec4(bakedPosition, 1.0f)).xyz;
+    vec3 CameraPosition = inverse(ubo.view)[3].xyz;
+    fragViewDir = normalize(CameraPosition - Positon.xyz);    
+
+    vec3 T = normalize(ubo.model*vec4(bakedTangent, 0.0f)).xyz;
+    vec3 N = normalize(ubo.model*vec4(bakedNormal, 0.0f)).xyz;
+    vec3 B = normalize(cross(N, T));
+    fragTBN = mat3(T, B, N);
+}   
\ No newline at end of file
@@ -0,0 +1,19 @@
+// The normal octahedral in xy and the tangent as an angle around it in z, packed on the CPU by VertexFormat
+void decodeNormalTangent(vec4 encoded, out vec3 normal, out vec3 tangent)
+{
+    vec2 e = encoded.xy * 2.0f - 1.0f;
+    normal = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float fold = max(-normal.z, 0.0f);
+    normal.x -= normal.x >= 0.0f ? fold : -fold;
+    normal.y -= normal.y >= 0.0f ? fold : -fold;
+    normal = normalize(normal);
+
+    // the same basis around the normal the angle was measured in
+    float s = normal.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (s + normal.z);
+    float b = normal.x * normal.y * a;
+    vec3 b1 = vec3(1.0f + s * normal.x * normal.x * a, s * b, -s * normal.x);
+    vec3 b2 = vec3(b, s + normal.y * normal.y * a, -normal.y);
+    float angle = encoded.z * 6.28318530718f;
+    tangent = cos(angle) * b1 + sin(angle) * b2;
+}
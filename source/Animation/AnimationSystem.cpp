@@ -0,0 +1,309 @@
+#include "AnimationSystem.h"
+#include "Pose.h"
+#include "Skeleton.h"
+#include "Rendering/VisualComponent.h"
+#include "Console/GlobalVar.h"
+
+GlobalVar<int> gAnimPoseCache("animPoseCache", 1);
+GlobalVar<float> gAnimPoseCacheTimeStep("animPoseCacheTimeStep", 4.0f);
+GlobalVar<int> gAnimLod("animLod", 1);
+GlobalVar<float> gAnimLodFullRateSize("animLodFullRateSize", 0.2f);
+GlobalVar<float> gAnimLodHalfRateSize("animLodHalfRateSize", 0.08f);
+GlobalVar<int> gAnimLodReducedBoneLevels("animLodReducedBoneLevels", 0);
+GlobalVar<int> gStatAnimPoseCacheHitRate("statAnimPoseCacheHitRate", 0);
+GlobalVar<int> gStatAnimLodHeldPoses("statAnimLodHeldPoses", 0);
+GlobalVar<int> gStatAnimLodFrozen("statAnimLodFrozen", 0);
+GlobalVar<float> gStatAnimBlendUs("statAnimBlendUs", 0.0f);
+
+// bones only span the skeleton, the skin around them sticks out a bit
+constexpr float lodBoundsMargin = 1.5f;
+
+size_t AnimationSystem::PoseKeyHash::operator()(const PoseKey& key) const
+{
+	size_t hash = std::hash<const void*>()(key.animation);
+	for (size_t value : { std::hash<const void*>()(key.skeleton), std::hash<const void*>()(key.bindFrame), std::hash<int>()(key.timeStep), std::hash<float>()(key.rate), std::hash<bool>()(key.reducedBones) })
+		hash ^= value + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+AnimationSystem::LodBand AnimationSystem::getLodBand(const VisualComponent& visual)
+{
+	const LodView& view = *lodView;
+
+	// the skinned bounds of the clips if they have them, else a guess around the bind skeleton
+	Mtx transform = visual.getTransform();
+	V4 scale = transform.getScale();
+	float maxScale = std::max({ scale.x, scale.y, scale.z });
+	float radius;
+	V4 center;
+	if (auto bounds = visual.getAnimationBounds())
+	{
+		V4 boundsCenter = bounds->getCenter();
+		boundsCenter.w = 1.0f;
+		center = boundsCenter * transform;
+		radius = bounds->getRadius() * maxScale;
+	}
+	else
+	{
+		float bindRadius = 1.0f;
+		if (visual.initialFrame)
+		{
+			auto [it, inserted] = bindRadii.try_emplace(visual.initialFrame, 0.0f);
+			if (inserted)
+			{
+				for (auto& bone : visual.initialFrame->bones)
+					it->second = std::max(it->second, bone.position.xyz().length());
+			}
+			bindRadius = it->second;
+		}
+		center = transform.getPosition();
+		radius = bindRadius * maxScale * lodBoundsMargin;
+	}
+	V4 toCenter = (center - view.position).xyz();
+	float distance = toCenter.length();
+	if (distance <= radius)
+		return LodBand::EveryFrame;
+
+	// the cone around the view direction that holds the whole frustum, a sphere outside of it can't be seen
+	float tanHalfFovY = tanf(view.fovY * 0.5f);
+	float coneAngle = atanf(tanHalfFovY * sqrtf(1.0f + view.aspect * view.aspect));
+	float cosAngle = toCenter.dot(view.forward.xyz()) / (distance * view.forward.xyz().length());
+	if (acosf(std::clamp(cosAngle, -1.0f, 1.0f)) - asinf(radius / distance) > coneAngle)
+		return LodBand::Frozen;
+
+	// the sphere's diameter as a fraction of the screen height
+	float size = radius / (distance * tanHalfFovY);
+	if (size >= gAnimLodFullRateSize.get())
+		return LodBand::EveryFrame;
+	if (size >= gAnimLodHalfRateSize.get())
+		return LodBand::EverySecondFrame;
+	return LodBand::EveryFourthFrame;
+}
+
+const uint* AnimationSystem::getBoneRemap(const Skeleton& skeleton, uint numKeptLevels)
+{
+	if (boneRemapsLevels != numKeptLevels)
+	{
+		boneRemaps.clear();
+		boneRemapsLevels = numKeptLevels;
+	}
+
+	auto [it, inserted] = boneRemaps.try_emplace(&skeleton);
+	if (inserted)
+	{
+		// the deepest levels are dropped, not the last bones: IQM stores joints depth-first, so a cut by index
+		// would lose whole limbs. Dropped bones ride along rigidly with their closest kept ancestor, which comes
+		// before them, so the remap can be applied in one forward pass.
+		auto& remap = it->second;
+		remap.resize(skeleton.getNumBones());
+		for (uint bone = 0; bone < skeleton.getNumBones(); ++bone)
+			remap[bone] = skeleton.getDepth(bone) < numKeptLevels ? bone : remap[skeleton.getParent(bone)];
+	}
+	return it->second.data();
+}
+
+void AnimationSystem::evaluateBlend(VisualComponent& visual, BlendScratch& scratch)
+{
+	auto evaluate = [&](const VisualComponent::AnimationSource& source, Pose& pose)
+	{
+		if (source.blendTree)
+		{
+			source.blendTree->evaluate(source.time, source.parameters, pose, scratch.tree);
+			return;
+		}
+		source.animation->sample(source.time, pose);
+		++scratch.tree.numClipSamples;
+	};
+
+	evaluate(visual.current, visual.pose);
+	if (visual.isFading())
+	{
+		evaluate(visual.previous, scratch.fading);
+		visual.pose.blend(scratch.fading, visual.pose, visual.fadeTime / visual.fadeDuration);
+	}
+}
+
+void AnimationSystem::update(Scene& scene)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// visuals still point into the last update's arenas, keep those around for the held poses
+	std::swap(arena, previousArena);
+	std::swap(paletteArena, previousPaletteArena);
+
+	instances.clear();
+	instancePoses.clear();
+	poses.clear();
+	poseCache.clear();
+	skippedPoses.clear();
+	arenaSize = 0u;
+	paletteArenaSize = 0u;
+	stats = {};
+	bool useCache = gAnimPoseCache.get() && gAnimPoseCacheTimeStep.get() > 0.0f;
+	bool useLod = lodView && gAnimLod.get();
+	uint reducedBoneLevels = (uint)std::max(gAnimLodReducedBoneLevels.get(), 0);
+	scene.forAllActors([&](Actor* actor)
+	{
+		for (VisualComponent* visual : actor->getComponents<VisualComponent>())
+		{
+			if (!visual->current.isSet())
+			{
+				// a visual that went from a skeletal to a baked animation still points into the last update's arenas,
+				// its pose is carried over like a held one so holding right away once it's back doesn't read the arena
+				// this update rewrites
+				if (visual->pose.getNumBones() > 0u)
+				{
+					skippedPoses.push_back((uint)poses.size());
+					poses.push_back({ visual, 0.0f, arenaSize, paletteArenaSize, visual->pose.getData(), visual->palette.data() });
+					arenaSize += Pose::getSize(visual->pose.getNumBones());
+					paletteArenaSize += visual->palette.size();
+				}
+				continue;
+			}
+
+			uint numBones = visual->current.getNumBones();
+			uint instanceIndex = (uint)instances.size();
+			instances.push_back(visual);
+
+			// reduced rates evaluate every 2nd or 4th update, staggered so the work is spread evenly
+			LodBand band = useLod ? getLodBand(*visual) : LodBand::EveryFrame;
+			++stats.numInstancesPerBand[(int)band];
+			uint interval = 1u << (uint)band;
+			bool hold = band == LodBand::Frozen || (band != LodBand::EveryFrame && (frameIndex + instanceIndex) % interval != 0u);
+			bool canHold = visual->pose.getNumBones() == numBones && (!visual->initialFrame || visual->palette.size() == numBones * Pose::paletteFloatsPerBone);
+			if (hold && canHold)
+			{
+				instancePoses.push_back((uint)poses.size());
+				poses.push_back({ visual, visual->current.time, arenaSize, paletteArenaSize, visual->pose.getData(), visual->palette.data() });
+				arenaSize += Pose::getSize(numBones);
+				if (visual->initialFrame)
+					paletteArenaSize += numBones * Pose::paletteFloatsPerBone;
+				++stats.numHeldPoses;
+				continue;
+			}
+
+			bool reduceBones = band == LodBand::EveryFourthFrame && reducedBoneLevels > 0u && visual->skeleton && reducedBoneLevels < visual->skeleton->getNumLevels() && visual->initialFrame;
+
+			// instances of the same clip at the same quantized point of its loop share one evaluated pose,
+			// blends depend on too many parameters to ever meet
+			float time = visual->current.time;
+			bool blended = visual->current.blendTree || visual->isFading();
+			if (useCache && !blended)
+			{
+				float timeStep = gAnimPoseCacheTimeStep.get();
+				float duration = visual->current.animation->getDuration();
+				float loopTime = duration > 0.0f ? fmodf(std::max(time, 0.0f), duration) : 0.0f;
+				PoseKey key = { visual->current.animation, visual->skeleton, visual->initialFrame, (int)roundf(loopTime / timeStep), visual->animationSpeed, reduceBones };
+				time = key.timeStep * timeStep;
+				auto [it, inserted] = poseCache.try_emplace(key, (uint)poses.size());
+				if (!inserted)
+				{
+					instancePoses.push_back(it->second);
+					continue;
+				}
+			}
+
+			instancePoses.push_back((uint)poses.size());
+			poses.push_back({ visual, time, arenaSize, paletteArenaSize });
+			if (blended)
+				++stats.numBlendedInstances;
+			if (reduceBones)
+			{
+				poses.back().boneRemap = getBoneRemap(*visual->skeleton, reducedBoneLevels);
+				++stats.numReducedBoneInstances;
+			}
+			arenaSize += Pose::getSize(numBones);
+			if (visual->initialFrame)
+				paletteArenaSize += numBones * Pose::paletteFloatsPerBone;
+			++stats.numPoses;
+		}
+	});
+
+	// slots are handed out again every update, growing the arena only moves poses nobody reads yet
+	if (arena.size() < arenaSize)
+		arena.resize(arenaSize);
+	if (paletteArena.size() < paletteArenaSize)
+		paletteArena.resize(paletteArenaSize);
+	for (uint i = 0; i < instances.size(); ++i)
+	{
+		VisualComponent* visual = instances[i];
+		const CachedPose& cached = poses[instancePoses[i]];
+		uint numBones = visual->current.getNumBones();
+		visual->pose.setStorage({ arena.data() + cached.offset, Pose::getSize(numBones) });
+		// sized up front, so instances sharing the slot don't touch it while the owner samples
+		visual->pose.resize(numBones);
+		visual->palette = {};
+		if (visual->initialFrame)
+			visual->palette = { paletteArena.data() + cached.paletteOffset, numBones * Pose::paletteFloatsPerBone };
+	}
+	for (uint i : skippedPoses)
+	{
+		const CachedPose& cached = poses[i];
+		VisualComponent* visual = cached.visual;
+		uint numBones = visual->pose.getNumBones();
+		visual->pose.setStorage({ arena.data() + cached.offset, Pose::getSize(numBones) });
+		visual->pose.resize(numBones);
+		if (!visual->palette.empty())
+			visual->palette = { paletteArena.data() + cached.paletteOffset, visual->palette.size() };
+	}
+
+	std::atomic<uint64> blendNs = 0u;
+	std::atomic<uint> clipSamples = 0u;
+	workers.parallelFor((uint)poses.size(), chunkSize, [&](uint begin, uint end)
+	{
+		// every thread keeps its scratch poses from update to update
+		static thread_local BlendScratch scratch;
+		uint64 chunkBlendNs = 0u;
+		scratch.tree.numClipSamples = 0u;
+		for (uint i = begin; i < end; ++i)
+		{
+			const CachedPose& cached = poses[i];
+			VisualComponent* visual = cached.visual;
+			if (cached.heldPose)
+			{
+				memcpy(visual->pose.getData(), cached.heldPose, Pose::getSize(visual->pose.getNumBones()) * sizeof(float));
+				if (!visual->palette.empty())
+					memcpy(paletteArena.data() + cached.paletteOffset, cached.heldPalette, visual->palette.size_bytes());
+				continue;
+			}
+
+			if (!visual->current.blendTree && !visual->isFading())
+			{
+				visual->current.animation->sample(cached.time, visual->pose, cached.boneRemap);
+				++scratch.tree.numClipSamples;
+			}
+			else
+			{
+				auto blendStart = std::chrono::high_resolution_clock::now();
+				evaluateBlend(*visual, scratch);
+				chunkBlendNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - blendStart).count();
+			}
+			if (visual->skeleton)
+				visual->pose.convertToRootSpace(*visual->skeleton, cached.boneRemap ? boneRemapsLevels : (uint)-1);
+			if (cached.boneRemap)
+			{
+				// the dropped bones were neither sampled nor converted, they take their kept ancestor's transform
+				for (uint bone = 0; bone < visual->pose.getNumBones(); ++bone)
+					if (cached.boneRemap[bone] != bone)
+						visual->pose.setBone(bone, { visual->pose.getPosition(cached.boneRemap[bone]), visual->pose.getRotation(cached.boneRemap[bone]), visual->pose.getScale(cached.boneRemap[bone]) });
+			}
+			if (visual->initialFrame)
+				visual->pose.writeSkinningPalette(*visual->initialFrame, paletteArena.data() + cached.paletteOffset, cached.boneRemap);
+		}
+		blendNs += chunkBlendNs;
+		clipSamples += scratch.tree.numClipSamples;
+	});
+	++frameIndex;
+
+	stats.numInstances = (uint)instances.size();
+	stats.numThreads = workers.getNumThreads();
+	stats.arenaBytes = arenaSize * sizeof(float);
+	stats.paletteBytes = paletteArenaSize * sizeof(float);
+	stats.numClipSamples = clipSamples;
+	stats.blendMs = blendNs / 1e6f;
+	stats.updateMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	gStatAnimPoseCacheHitRate.set((int)(stats.getCacheHitRate() * 100.0f));
+	gStatAnimLodHeldPoses.set((int)stats.numHeldPoses);
+	gStatAnimLodFrozen.set((int)stats.numInstancesPerBand[(int)LodBand::Frozen]);
+	gStatAnimBlendUs.set(stats.getBlendUsPerInstance());
+}
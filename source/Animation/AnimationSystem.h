@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Engine/Scene.h"
+#include "Engine/WorkerPool.h"
+#include "SkelAnimation.h"
+#include "BlendTree.h"
+#include <span>
+
+class VisualComponent;
+
+// Poses every animated VisualComponent of a scene once per frame. The instances are gathered first, then
+// sampled, converted to model space and turned into skinning palettes in chunks across worker threads.
+// All poses live back to back in one arena and all palettes in another, each VisualComponent points at
+// its slots, so the renderer reads them without copying.
+// Instances playing the same clip at the same rate and, quantized to animPoseCacheTimeStep ms, the same point
+// of its loop share one slot, so a herd in sync is evaluated and uploaded once.
+// With a LOD view set, small instances on screen are only evaluated every 2nd or 4th update and ones out of
+// view not at all, they keep their last pose in the meantime, see the animLod* vars. Instances are sized by the
+// skinned bounds of what they play at their current time where the clips have them, see SkelAnimation::getBounds.
+// Blend trees and crossfades are evaluated per instance in parent space, before the conversion to model space.
+// Animation time still advances in VisualComponent::tick, run this after the scene's tick.
+class AnimationSystem
+{
+public:
+
+	// numThreads counts the calling thread, zero picks one per hardware thread
+	explicit AnimationSystem(uint numThreads = 0u) : workers(numThreads) {}
+
+	void update(Scene& scene);
+
+	// The camera the LOD bands are picked for, fovY is the vertical field of view in radians
+	struct LodView
+	{
+		V4 position;
+		V4 forward;
+		float fovY = PI / 4.0f;
+		float aspect = 1.0f;
+	};
+	void setLodView(std::optional<LodView> view) { lodView = view; }
+
+	enum class LodBand : uchar
+	{
+		EveryFrame,
+		EverySecondFrame,
+		EveryFourthFrame,
+		Frozen
+	};
+
+	// Every pose of the last update, laid out like Pose::getData() one after another
+	std::span<const float> getPoseArena() const { return { arena.data(), arenaSize }; }
+	// Every skinning palette of the last update, Pose::paletteFloatsPerBone floats per bone
+	std::span<const float> getPaletteArena() const { return { paletteArena.data(), paletteArenaSize }; }
+
+	struct Stats
+	{
+		uint numInstances = 0u;
+		// evaluated poses, instances that are neither evaluated nor held were cache hits
+		uint numPoses = 0u;
+		// instances that kept their last pose because of their LOD band
+		uint numHeldPoses = 0u;
+		uint numInstancesPerBand[4] = {}; // per LodBand
+		// instances that only evaluated the first animLodReducedBoneLevels levels of their skeleton
+		uint numReducedBoneInstances = 0u;
+		// evaluated instances playing a blend tree or fading between two sources
+		uint numBlendedInstances = 0u;
+		// clips sampled for all evaluated poses, a blended instance samples every clip with weight
+		uint numClipSamples = 0u;
+		// sampling and blending of the blended instances, summed over all threads
+		float blendMs = 0.0f;
+		uint numThreads = 0u;
+		size_t arenaBytes = 0u;
+		size_t paletteBytes = 0u;
+		float updateMs = 0.0f;
+
+		float getBlendUsPerInstance() const { return numBlendedInstances > 0u ? blendMs * 1000.0f / numBlendedInstances : 0.0f; }
+		float getCacheHitRate() const { return numInstances > 0u ? (float)(numInstances - numPoses - numHeldPoses) / numInstances : 0.0f; }
+	};
+	const Stats& getStats() const { return stats; }
+
+private:
+
+	static constexpr uint chunkSize = 8u;
+
+	struct PoseKey
+	{
+		const SkelAnimation* animation = nullptr;
+		const Skeleton* skeleton = nullptr;
+		const SkelAnimation::Frame* bindFrame = nullptr;
+		int timeStep = 0;
+		float rate = 1.0f;
+		bool reducedBones = false;
+
+		bool operator==(const PoseKey& other) const = default;
+	};
+
+	struct PoseKeyHash
+	{
+		size_t operator()(const PoseKey& key) const;
+	};
+
+	// An evaluated pose, sampled into visual's pose at time and shared by every instance with the same key.
+	// A held pose is instead copied over from the slots the visual pointed at in the last update.
+	struct CachedPose
+	{
+		VisualComponent* visual = nullptr;
+		float time = 0.0f;
+		size_t offset = 0u;
+		size_t paletteOffset = 0u;
+		const float* heldPose = nullptr;
+		const float* heldPalette = nullptr;
+		// for reduced bones, the kept bone each bone follows, itself for kept ones
+		const uint* boneRemap = nullptr;
+	};
+
+	struct BlendScratch
+	{
+		BlendTree::Scratch tree;
+		Pose fading;
+	};
+
+	// Samples and blends everything the visual plays into its pose
+	static void evaluateBlend(VisualComponent& visual, BlendScratch& scratch);
+	LodBand getLodBand(const VisualComponent& visual);
+	const uint* getBoneRemap(const Skeleton& skeleton, uint numKeptLevels);
+
+	WorkerPool workers;
+	std::vector<VisualComponent*> instances;
+	std::vector<uint> instancePoses;
+	std::vector<CachedPose> poses;
+	std::unordered_map<PoseKey, uint, PoseKeyHash> poseCache;
+	// held poses of visuals that play nothing skeletal anymore, they aren't instances
+	std::vector<uint> skippedPoses;
+	// the arenas of the last update, held poses are copied from there
+	std::vector<float> arena;
+	std::vector<float> previousArena;
+	std::vector<float> paletteArena;
+	std::vector<float> previousPaletteArena;
+	size_t arenaSize = 0u;
+	size_t paletteArenaSize = 0u;
+	std::unordered_map<const SkelAnimation::Frame*, float> bindRadii;
+	std::unordered_map<const Skeleton*, std::vector<uint>> boneRemaps;
+	uint boneRemapsLevels = 0u;
+	std::optional<LodView> lodView;
+	uint frameIndex = 0u;
+	Stats stats;
+};
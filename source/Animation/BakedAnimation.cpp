@@ -0,0 +1,156 @@
+#include "BakedAnimation.h"
+#include "Mesh.h"
+#include "Pose.h"
+#include "Skeleton.h"
+#include "Engine/WorkerPool.h"
+#include "Engine/Log.h"
+
+constexpr float positionSteps = 65535.0f;
+constexpr float normalSteps = 255.0f;
+
+uint BakedAnimation::encodeNormal(const V3& normal)
+{
+	// onto the octahedron, the lower half folded over the upper one's diagonals
+	float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	float u = normal.x / sum;
+	float v = normal.y / sum;
+	if (normal.z < 0.0f)
+	{
+		float foldedU = (1.0f - fabsf(v)) * copysignf(1.0f, u);
+		v = (1.0f - fabsf(u)) * copysignf(1.0f, v);
+		u = foldedU;
+	}
+	uint encodedU = (uint)lroundf((u * 0.5f + 0.5f) * normalSteps);
+	uint encodedV = (uint)lroundf((v * 0.5f + 0.5f) * normalSteps);
+	return encodedU | encodedV << 8;
+}
+
+V3 BakedAnimation::decodeNormal(uint encoded)
+{
+	float u = (encoded & 0xffu) / normalSteps * 2.0f - 1.0f;
+	float v = (encoded >> 8 & 0xffu) / normalSteps * 2.0f - 1.0f;
+	V3 normal = { u, v, 1.0f - fabsf(u) - fabsf(v) };
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x -= copysignf(fold, normal.x);
+	normal.y -= copysignf(fold, normal.y);
+	return normal.normalize();
+}
+
+void BakedAnimation::bake(const Mesh& mesh, const SkelAnimation& animation, const Skeleton& skeleton, const SkelAnimation::Frame& bindFrame, float framerate, WorkerPool& workers)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const std::vector<Mesh::Vertex>& vertices = mesh.getVertices();
+	uint numBones = animation.getNumBones();
+	assert(framerate > 0.0f && bindFrame.bones.size() == numBones);
+	numVertices = (uint)vertices.size();
+	numFrames = std::max(1u, (uint)lroundf(animation.getDuration() * framerate / 1000.0f));
+	frameDuration = animation.getDuration() / numFrames;
+
+	// skinned at full precision first, the positions are quantized over the bounds of all frames
+	std::vector<V3> positions((size_t)numFrames * numVertices);
+	std::vector<V3> normals((size_t)numFrames * numVertices);
+	frameBounds.assign(numFrames, {});
+	workers.parallelFor(numFrames, 1u, [&](uint begin, uint end)
+	{
+		Pose pose;
+		std::vector<float> palette(numBones * Pose::paletteFloatsPerBone);
+		for (uint frame = begin; frame < end; ++frame)
+		{
+			pose.resize(numBones);
+			animation.sample(frame * frameDuration, pose);
+			pose.convertToRootSpace(skeleton);
+			pose.writeSkinningPalette(bindFrame, palette.data());
+
+			size_t first = (size_t)frame * numVertices;
+			mesh.skinVertices(palette.data(), positions.data() + first, normals.data() + first);
+
+			for (uint i = 0; i < numVertices; ++i)
+				frameBounds[frame].add(positions[first + i]);
+		}
+	});
+
+	SkelAnimation::Bounds clipBounds;
+	for (const SkelAnimation::Bounds& bounds : frameBounds)
+		clipBounds = clipBounds.merged(bounds);
+	boundsMin = { clipBounds.min.x, clipBounds.min.y, clipBounds.min.z };
+	for (uint axis = 0; axis < 3; ++axis)
+	{
+		float extent = (&clipBounds.max.x)[axis] - (&boundsMin.x)[axis];
+		(&boundsScale.x)[axis] = extent > 0.0f ? extent / positionSteps : 1.0f;
+	}
+
+	data.resize((size_t)numFrames * numVertices * wordsPerVertex);
+	std::vector<float> frameErrors(numFrames * 2u);
+	workers.parallelFor(numFrames, 1u, [&](uint begin, uint end)
+	{
+		for (uint frame = begin; frame < end; ++frame)
+		{
+			float positionError = 0.0f;
+			float normalError = 0.0f;
+			for (uint i = 0; i < numVertices; ++i)
+			{
+				size_t index = (size_t)frame * numVertices + i;
+				const V3& position = positions[index];
+				uint x = (uint)lroundf((position.x - boundsMin.x) / boundsScale.x);
+				uint y = (uint)lroundf((position.y - boundsMin.y) / boundsScale.y);
+				uint z = (uint)lroundf((position.z - boundsMin.z) / boundsScale.z);
+				uint32_t* out = data.data() + index * wordsPerVertex;
+				out[0] = std::min(x, 0xffffu) | std::min(y, 0xffffu) << 16;
+				out[1] = std::min(z, 0xffffu) | encodeNormal(normals[index]) << 16;
+
+				positionError = std::max(positionError, (getPosition(frame, i) - position).length());
+				normalError = std::max(normalError, acosf(std::clamp(getNormal(frame, i).dot(normals[index]), -1.0f, 1.0f)));
+			}
+			frameErrors[frame * 2u] = positionError;
+			frameErrors[frame * 2u + 1u] = normalError;
+		}
+	});
+
+	stats = {};
+	for (uint frame = 0; frame < numFrames; ++frame)
+	{
+		stats.maxPositionError = std::max(stats.maxPositionError, frameErrors[frame * 2u]);
+		stats.maxNormalError = std::max(stats.maxNormalError, frameErrors[frame * 2u + 1u]);
+	}
+	stats.numThreads = workers.getNumThreads();
+	stats.bakeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	logLine(x, Verbose, "Baked {} frames of {} vertices into {} bytes in {:.1f} ms on {} threads, max error position {} normal {}",
+		numFrames, numVertices, getSize(), stats.bakeMs, stats.numThreads, stats.maxPositionError, stats.maxNormalError);
+}
+
+void BakedAnimation::getFrames(float time, uint& frame0, uint& frame1, float& alpha) const
+{
+	assert(numFrames > 0u);
+	float frameTime = fmodf(time / frameDuration, (float)numFrames);
+	if (frameTime < 0.0f)
+		frameTime += numFrames;
+	frame0 = std::min((uint)frameTime, numFrames - 1u);
+	frame1 = frame0 + 1u < numFrames ? frame0 + 1u : 0u;
+	alpha = frameTime - frame0;
+}
+
+SkelAnimation::Bounds BakedAnimation::getBounds(float time) const
+{
+	uint frame0, frame1;
+	float alpha;
+	getFrames(time, frame0, frame1, alpha);
+	return frameBounds[frame0].merged(frameBounds[frame1]);
+}
+
+V3 BakedAnimation::getPosition(uint frame, uint vertex) const
+{
+	const uint32_t* in = data.data() + ((size_t)frame * numVertices + vertex) * wordsPerVertex;
+	return
+	{
+		boundsMin.x + (in[0] & 0xffffu) * boundsScale.x,
+		boundsMin.y + (in[0] >> 16) * boundsScale.y,
+		boundsMin.z + (in[1] & 0xffffu) * boundsScale.z
+	};
+}
+
+V3 BakedAnimation::getNormal(uint frame, uint vertex) const
+{
+	const uint32_t* in = data.data() + ((size_t)frame * numVertices + vertex) * wordsPerVertex;
+	return decodeNormal(in[1] >> 16);
+}
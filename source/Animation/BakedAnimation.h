@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include "SkelAnimation.h"
+
+class Mesh;
+class WorkerPool;
+struct Skeleton;
+
+// A clip skinned onto one mesh ahead of time, so instances playing it need no bones at all: the vertex shader
+// reads the two baked frames around the instance's time and blends them, see shaderBaked.vert. Meant for crowds,
+// every instance plays the whole clip as it is, no blending or per-instance poses.
+// A vertex of a frame takes wordsPerVertex words: the position as three 16 bit values over the bounds of the whole
+// clip and the normal octahedral in two bytes. Tangents aren't baked, the shaders straighten the bind tangent
+// against the baked normal.
+class BakedAnimation
+{
+public:
+
+	static constexpr uint wordsPerVertex = 2u;
+
+	struct Stats
+	{
+		float bakeMs = 0.0f;
+		uint numThreads = 0u;
+		float maxPositionError = 0.0f;
+		float maxNormalError = 0.0f; // radians
+	};
+
+	// Samples the clip evenly over its loop at about framerate frames per second and skins the mesh with every pose
+	// on the worker threads. The clip is parent-relative and bindFrame in root space, like VisualComponent plays them.
+	void bake(const Mesh& mesh, const SkelAnimation& animation, const Skeleton& skeleton, const SkelAnimation::Frame& bindFrame, float framerate, WorkerPool& workers);
+
+	uint getNumFrames() const { return numFrames; }
+	uint getNumVertices() const { return numVertices; }
+	float getDuration() const { return numFrames * frameDuration; }
+	// Every frame's vertices, frame after frame
+	const std::vector<uint32_t>& getData() const { return data; }
+	size_t getSize() const { return data.size() * sizeof(uint32_t); }
+	const Stats& getStats() const { return stats; }
+
+	// A quantized position is boundsMin + value * boundsScale
+	const V3& getBoundsMin() const { return boundsMin; }
+	const V3& getBoundsScale() const { return boundsScale; }
+
+	// The frames around time in ms, which wraps, and how far it is from frame0 to frame1
+	void getFrames(float time, uint& frame0, uint& frame1, float& alpha) const;
+
+	// Bounds of the skinned mesh between the frames around time, exact for the baked vertices
+	SkelAnimation::Bounds getBounds(float time) const;
+
+	// Decoded like the shaders do
+	V3 getPosition(uint frame, uint vertex) const;
+	V3 getNormal(uint frame, uint vertex) const;
+
+private:
+
+	static uint encodeNormal(const V3& normal);
+	static V3 decodeNormal(uint encoded);
+
+	std::vector<uint32_t> data;
+	uint numFrames = 0u;
+	uint numVertices = 0u;
+	float frameDuration = 0.0f;
+	V3 boundsMin = V3::zero();
+	V3 boundsScale = V3::zero();
+	std::vector<SkelAnimation::Bounds> frameBounds;
+	Stats stats;
+};
@@ -0,0 +1,311 @@
+#include "BlendTree.h"
+#include "Skeleton.h"
+
+// children of one blend node, so their weights fit on the stack while the tree recurses
+constexpr uint maxBlendChildren = 16u;
+
+BoneMask* BoneMask::setSubtree(const Skeleton& skeleton, uint bone, float weight)
+{
+	std::vector<bool> inSubtree(skeleton.getNumBones());
+	inSubtree[bone] = true;
+	weights[bone] = weight;
+	for (uint i = bone + 1u; i < skeleton.getNumBones(); ++i)
+	{
+		int parent = skeleton.getParent(i);
+		if (parent >= 0 && inSubtree[parent])
+		{
+			inSubtree[i] = true;
+			weights[i] = weight;
+		}
+	}
+	return this;
+}
+
+uint BlendTree::addParameter(std::string name, float defaultValue)
+{
+	parameterNames.push_back(std::move(name));
+	parameterDefaults.push_back(defaultValue);
+	return (uint)parameterNames.size() - 1u;
+}
+
+uint BlendTree::findParameter(std::string_view name) const
+{
+	for (uint i = 0; i < parameterNames.size(); ++i)
+	{
+		if (parameterNames[i] == name)
+			return i;
+	}
+	return (uint)-1;
+}
+
+BlendTree::NodeIndex BlendTree::addNode(Node node)
+{
+	assert(node.children.size() <= maxBlendChildren);
+	uint nodeDepth = 1u;
+	for (NodeIndex child : node.children)
+	{
+		assert(child < nodes.size());
+		nodeDepth = std::max(nodeDepth, nodeDepths[child] + 1u);
+	}
+	nodeDepths.push_back(nodeDepth);
+	treeDepth = std::max(treeDepth, nodeDepth);
+	nodes.push_back(std::move(node));
+	return (NodeIndex)nodes.size() - 1u;
+}
+
+BlendTree::NodeIndex BlendTree::addClip(const SkelAnimation* animation)
+{
+	assert(numBones == 0u || animation->getNumBones() == numBones);
+	numBones = animation->getNumBones();
+	Node node;
+	node.type = NodeType::Clip;
+	node.animation = animation;
+	return addNode(std::move(node));
+}
+
+BlendTree::NodeIndex BlendTree::addFrame(const SkelAnimation::Frame* frame)
+{
+	assert(numBones == 0u || frame->bones.size() == numBones);
+	numBones = (uint)frame->bones.size();
+	Node node;
+	node.type = NodeType::Frame;
+	node.frame = frame;
+	return addNode(std::move(node));
+}
+
+BlendTree::NodeIndex BlendTree::addBlend1D(uint parameter, std::vector<NodeIndex> children, std::vector<float> thresholds)
+{
+	assert(!children.empty() && children.size() == thresholds.size());
+	Node node;
+	node.type = NodeType::Blend1D;
+	node.parameters[0] = parameter;
+	node.children = std::move(children);
+	for (uint i = 0; i < thresholds.size(); ++i)
+	{
+		assert(i == 0 || thresholds[i] > thresholds[i - 1]);
+		node.points.push_back({ thresholds[i], 0.0f });
+	}
+	return addNode(std::move(node));
+}
+
+BlendTree::NodeIndex BlendTree::addBlend2D(uint parameterX, uint parameterY, std::vector<NodeIndex> children, std::vector<V2> points)
+{
+	assert(!children.empty() && children.size() == points.size());
+	Node node;
+	node.type = NodeType::Blend2D;
+	node.parameters[0] = parameterX;
+	node.parameters[1] = parameterY;
+	node.children = std::move(children);
+	node.points = std::move(points);
+	return addNode(std::move(node));
+}
+
+BlendTree::NodeIndex BlendTree::addLayer(NodeIndex base, NodeIndex layer, uint weightParameter, const BoneMask* mask)
+{
+	Node node;
+	node.type = NodeType::Layer;
+	node.parameters[0] = weightParameter;
+	node.children = { base, layer };
+	node.mask = mask;
+	return addNode(std::move(node));
+}
+
+BlendTree::NodeIndex BlendTree::addAdditive(NodeIndex base, NodeIndex additive, NodeIndex reference, uint weightParameter, const BoneMask* mask)
+{
+	Node node;
+	node.type = NodeType::Additive;
+	node.parameters[0] = weightParameter;
+	node.children = { base, additive, reference };
+	node.mask = mask;
+	return addNode(std::move(node));
+}
+
+void BlendTree::getChildWeights(const Node& node, std::span<const float> parameters, float* weights) const
+{
+	uint numChildren = (uint)node.children.size();
+	std::fill(weights, weights + numChildren, 0.0f);
+	if (node.type == NodeType::Blend1D)
+	{
+		float value = parameters[node.parameters[0]];
+		if (value <= node.points.front().x)
+		{
+			weights[0] = 1.0f;
+			return;
+		}
+		for (uint i = 1; i < numChildren; ++i)
+		{
+			if (value < node.points[i].x)
+			{
+				float alpha = (value - node.points[i - 1].x) / (node.points[i].x - node.points[i - 1].x);
+				weights[i - 1] = 1.0f - alpha;
+				weights[i] = alpha;
+				return;
+			}
+		}
+		weights[numChildren - 1] = 1.0f;
+		return;
+	}
+
+	// gradient band: every point's weight falls off towards each other point along the line between them
+	V2 value = { parameters[node.parameters[0]], parameters[node.parameters[1]] };
+	float total = 0.0f;
+	for (uint i = 0; i < numChildren; ++i)
+	{
+		float weight = 1.0f;
+		V2 toValue = value - node.points[i];
+		for (uint j = 0; j < numChildren && weight > 0.0f; ++j)
+		{
+			if (j == i)
+				continue;
+			V2 toOther = node.points[j] - node.points[i];
+			weight = std::min(weight, std::clamp(1.0f - toValue.dot(toOther) / toOther.length2(), 0.0f, 1.0f));
+		}
+		weights[i] = weight;
+		total += weight;
+	}
+	if (total > 0.0f)
+	{
+		for (uint i = 0; i < numChildren; ++i)
+			weights[i] /= total;
+		return;
+	}
+
+	uint closest = 0u;
+	for (uint i = 1; i < numChildren; ++i)
+	{
+		if ((value - node.points[i]).length2() < (value - node.points[closest]).length2())
+			closest = i;
+	}
+	weights[closest] = 1.0f;
+}
+
+float BlendTree::getNodeDuration(NodeIndex index, std::span<const float> parameters) const
+{
+	const Node& node = nodes[index];
+	switch (node.type)
+	{
+	case NodeType::Clip:
+		return node.animation->getDuration();
+	case NodeType::Frame:
+		return 0.0f;
+	case NodeType::Layer:
+	case NodeType::Additive:
+		return getNodeDuration(node.children[0], parameters);
+	default:
+		break;
+	}
+
+	// weighted by the children that loop at all, a fixed frame doesn't stretch the others
+	float weights[maxBlendChildren];
+	getChildWeights(node, parameters, weights);
+	float duration = 0.0f;
+	float totalWeight = 0.0f;
+	for (uint i = 0; i < node.children.size(); ++i)
+	{
+		if (weights[i] <= 0.0f)
+			continue;
+		float childDuration = getNodeDuration(node.children[i], parameters);
+		if (childDuration > 0.0f)
+		{
+			duration += childDuration * weights[i];
+			totalWeight += weights[i];
+		}
+	}
+	return totalWeight > 0.0f ? duration / totalWeight : 0.0f;
+}
+
+float BlendTree::getDuration(std::span<const float> parameters) const
+{
+	return nodes.empty() ? 0.0f : getNodeDuration((NodeIndex)nodes.size() - 1u, parameters);
+}
+
+std::optional<SkelAnimation::Bounds> BlendTree::getBounds(float phase) const
+{
+	std::optional<SkelAnimation::Bounds> bounds;
+	for (const Node& node : nodes)
+	{
+		if (node.type != NodeType::Clip)
+			continue;
+		if (!node.animation->hasBounds())
+			return std::nullopt;
+		SkelAnimation::Bounds clipBounds = node.animation->getBounds(phase * node.animation->getDuration());
+		bounds = bounds ? bounds->merged(clipBounds) : clipBounds;
+	}
+	return bounds;
+}
+
+void BlendTree::evaluate(float phase, std::span<const float> parameters, Pose& pose, Scratch& scratch) const
+{
+	assert(!nodes.empty() && parameters.size() == parameterNames.size());
+	if (scratch.poses.size() < treeDepth * 2u)
+		scratch.poses.resize(treeDepth * 2u);
+	evaluateNode((NodeIndex)nodes.size() - 1u, phase, parameters, pose, scratch, 0u);
+}
+
+void BlendTree::evaluateNode(NodeIndex index, float phase, std::span<const float> parameters, Pose& pose, Scratch& scratch, uint depth) const
+{
+	const Node& node = nodes[index];
+	if (node.type == NodeType::Clip)
+	{
+		node.animation->sample(phase * node.animation->getDuration(), pose);
+		++scratch.numClipSamples;
+		return;
+	}
+	if (node.type == NodeType::Frame)
+	{
+		pose.setFrame(*node.frame);
+		return;
+	}
+
+	// two poses per level of the tree for the children that don't go straight into pose, evaluate() made room
+	Pose& temp = scratch.poses[depth * 2u];
+	Pose& temp2 = scratch.poses[depth * 2u + 1u];
+
+	if (node.type == NodeType::Layer || node.type == NodeType::Additive)
+	{
+		float weight = std::clamp(parameters[node.parameters[0]], 0.0f, 1.0f);
+		evaluateNode(node.children[0], phase, parameters, pose, scratch, depth + 1u);
+		if (weight <= 0.0f)
+			return;
+
+		evaluateNode(node.children[1], phase, parameters, temp, scratch, depth + 1u);
+		if (node.type == NodeType::Additive)
+			evaluateNode(node.children[2], phase, parameters, temp2, scratch, depth + 1u);
+
+		// filled only now, masked nodes below use the same buffer
+		uint stride = pose.getStride();
+		scratch.weights.assign(stride, weight);
+		if (node.mask)
+		{
+			assert(node.mask->getStride() == stride);
+			for (uint i = 0; i < stride; ++i)
+				scratch.weights[i] *= node.mask->getWeights()[i];
+		}
+
+		if (node.type == NodeType::Layer)
+			blendPoseChannels(pose.getData(), temp.getData(), scratch.weights.data(), pose.getData(), stride);
+		else
+			addPoseChannels(pose.getData(), temp.getData(), temp2.getData(), scratch.weights.data(), pose.getData(), stride);
+		return;
+	}
+
+	// blend spaces accumulate their children one by one, each weighted against the sum so far
+	float weights[maxBlendChildren];
+	getChildWeights(node, parameters, weights);
+	float totalWeight = 0.0f;
+	for (uint i = 0; i < node.children.size(); ++i)
+	{
+		if (weights[i] <= 0.0f)
+			continue;
+		if (totalWeight == 0.0f)
+		{
+			evaluateNode(node.children[i], phase, parameters, pose, scratch, depth + 1u);
+		}
+		else
+		{
+			evaluateNode(node.children[i], phase, parameters, temp, scratch, depth + 1u);
+			pose.blend(pose, temp, weights[i] / (totalWeight + weights[i]));
+		}
+		totalWeight += weights[i];
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include "SkelAnimation.h"
+#include "Pose.h"
+#include <span>
+
+struct Skeleton;
+
+// Per-bone weights of a blend or layer, 0 leaves a bone to the pose below. Padded to Pose::getStride(),
+// so the blend kernels read it as one more channel.
+class BoneMask
+{
+public:
+
+	BoneMask() = default;
+	explicit BoneMask(uint numBones, float weight = 1.0f) : weights(Pose::getStride(numBones), weight) {}
+
+	// The bone and everything below it, parents come first so one forward pass finds them all
+	BoneMask* setSubtree(const Skeleton& skeleton, uint bone, float weight);
+	BoneMask* setBone(uint bone, float weight) { weights[bone] = weight; return this; }
+
+	const float* getWeights() const { return weights.data(); }
+	uint getStride() const { return (uint)weights.size(); }
+
+private:
+
+	std::vector<float> weights;
+};
+
+// A tree of blend nodes over clips of one skeleton, evaluated into a parent-relative pose. Nodes are added
+// children first and refer to each other by index, the last added node is the root.
+// All clips of a tree play in sync: they are sampled at the same phase of their loop and the phase advances
+// with the clips' duration weighted like they are blended (see getDuration), so a walk and a run blended 50/50
+// keep their feet together. Parameters like a speed drive the blend spaces and weights, every instance has
+// its own values, see VisualComponent::setBlendParameter.
+class BlendTree
+{
+public:
+
+	using NodeIndex = uint;
+
+	uint addParameter(std::string name, float defaultValue = 0.0f);
+	uint getNumParameters() const { return (uint)parameterNames.size(); }
+	// (uint)-1 if the tree has no such parameter
+	uint findParameter(std::string_view name) const;
+	const std::vector<float>& getDefaultParameters() const { return parameterDefaults; }
+
+	NodeIndex addClip(const SkelAnimation* animation);
+	// A fixed pose, like a rest frame, parent-relative like the clips
+	NodeIndex addFrame(const SkelAnimation::Frame* frame);
+	// Blends the children of the two thresholds around the parameter's value, thresholds go up
+	NodeIndex addBlend1D(uint parameter, std::vector<NodeIndex> children, std::vector<float> thresholds);
+	// Gradient band interpolation between children placed at points of the plane of two parameters,
+	// it handles any layout, like a ring of walk directions with idle in the middle
+	NodeIndex addBlend2D(uint parameterX, uint parameterY, std::vector<NodeIndex> children, std::vector<V2> points);
+	// layer over base by the parameter's value, optionally only on the mask's bones
+	NodeIndex addLayer(NodeIndex base, NodeIndex layer, uint weightParameter, const BoneMask* mask = nullptr);
+	// additive's difference to reference on top of base, see addPoseChannels
+	NodeIndex addAdditive(NodeIndex base, NodeIndex additive, NodeIndex reference, uint weightParameter, const BoneMask* mask = nullptr);
+
+	uint getNumBones() const { return numBones; }
+
+	// Length of one synced loop in ms for these parameter values
+	float getDuration(std::span<const float> parameters) const;
+
+	// Poses the nodes are blended in, owned by whoever evaluates and reused between trees and instances.
+	// One per thread.
+	struct Scratch
+	{
+		std::vector<Pose> poses;
+		std::vector<float> weights;
+		uint numClipSamples = 0u;
+	};
+
+	// Evaluates the tree at phase (0..1 of the synced loop) into pose, which is only resized
+	void evaluate(float phase, std::span<const float> parameters, Pose& pose, Scratch& scratch) const;
+
+	// Bounds of every clip at phase put together, whatever the weights. Fixed frames are taken to lie within them.
+	// None if a clip has no bounds.
+	std::optional<SkelAnimation::Bounds> getBounds(float phase) const;
+
+private:
+
+	enum class NodeType : uchar
+	{
+		Clip,
+		Frame,
+		Blend1D,
+		Blend2D,
+		Layer,
+		Additive
+	};
+
+	struct Node
+	{
+		NodeType type = NodeType::Clip;
+		const SkelAnimation* animation = nullptr;
+		const SkelAnimation::Frame* frame = nullptr;
+		uint parameters[2] = {};
+		std::vector<NodeIndex> children;
+		std::vector<V2> points; // the thresholds of a 1D blend in x
+		const BoneMask* mask = nullptr;
+	};
+
+	NodeIndex addNode(Node node);
+	// Weights of a blend node's children for these parameters, they add up to one
+	void getChildWeights(const Node& node, std::span<const float> parameters, float* weights) const;
+	float getNodeDuration(NodeIndex index, std::span<const float> parameters) const;
+	void evaluateNode(NodeIndex index, float phase, std::span<const float> parameters, Pose& pose, Scratch& scratch, uint depth) const;
+
+	std::vector<Node> nodes;
+	std::vector<uint> nodeDepths;
+	uint treeDepth = 0u;
+	std::vector<std::string> parameterNames;
+	std::vector<float> parameterDefaults;
+	uint numBones = 0u;
+};
@@ -0,0 +1,360 @@
+#include "CompressedClip.h"
+#include "Pose.h"
+#include <bit>
+
+namespace
+{
+	constexpr float smallestThreeRange = 0.70710678f; // the three smaller components of a unit quaternion are within +-1/sqrt(2)
+
+	uint getFirstChannel(uint type)
+	{
+		static constexpr uint firstChannels[] = { Pose::PositionX, Pose::RotationX, Pose::ScaleX };
+		return firstChannels[type];
+	}
+
+	V4 readTrack(const float* channels, uint stride, uint frame, uint bone, uint firstChannel, uint numComponents)
+	{
+		const float* frameChannels = channels + frame * Pose::NumChannels * stride;
+		V4 value = V4::zero();
+		for (uint c = 0; c < numComponents; ++c)
+			value[c] = frameChannels[(firstChannel + c) * stride + bone];
+		return value;
+	}
+
+	Quat toQuat(const V4& v)
+	{
+		return { v.x, v.y, v.z, v.w };
+	}
+
+	// Angle between two rotations, source frames aren't quite unit length so both get normalized
+	float rotationError(const Quat& a, const Quat& b)
+	{
+		float dot = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+		float length2 = (a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w) * (b.x * b.x + b.y * b.y + b.z * b.z + b.w * b.w);
+		return 2.0f * acosf(std::min(dot / sqrtf(std::max(length2, 1e-12f)), 1.0f));
+	}
+
+	Quat nlerp(const Quat& a, const Quat& b, float alpha)
+	{
+		float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+		float wb = dot < 0.0f ? -alpha : alpha;
+		float wa = 1.0f - alpha;
+		Quat q = { a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb };
+		float invLength = 1.0f / sqrtf(std::max(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w, 1e-12f));
+		return { q.x * invLength, q.y * invLength, q.z * invLength, q.w * invLength };
+	}
+
+	float trackError(const V4& a, const V4& b, bool rotation)
+	{
+		return rotation ? rotationError(toQuat(a), toQuat(b)) : sqrtf((a - b).xyz().length2());
+	}
+
+	// Greedy: extend every segment as far as lerping its end keys stays within tolerance of all frames it skips
+	std::vector<uint> selectKeys(const std::vector<V4>& values, float tolerance, bool rotation)
+	{
+		uint n = (uint)values.size();
+		std::vector<uint> result;
+		if (tolerance <= 0.0f)
+		{
+			for (uint f = 0; f < n; ++f)
+				result.push_back(f);
+			return result;
+		}
+
+		auto fits = [&](uint start, uint end)
+		{
+			for (uint f = start + 1; f < end; ++f)
+			{
+				float alpha = (float)(f - start) / (end - start);
+				bool withinTolerance = rotation ?
+					rotationError(toQuat(values[f]), nlerp(toQuat(values[start]), toQuat(values[end]), alpha)) <= tolerance :
+					trackError(values[f], values[start] + (values[end] - values[start]) * alpha, false) <= tolerance;
+				if (!withinTolerance)
+					return false;
+			}
+			return true;
+		};
+
+		result.push_back(0u);
+		uint start = 0u;
+		while (start + 1 < n)
+		{
+			uint end = start + 1;
+			while (end + 1 < n && fits(start, end + 1))
+				++end;
+			result.push_back(end);
+			start = end;
+		}
+		return result;
+	}
+}
+
+void CompressedClip::build(const float* channels, uint numFrames_, uint numBones_, const Settings& settings)
+{
+	numFrames = numFrames_;
+	numBones = numBones_;
+	tracks.clear();
+	keyFrames.clear();
+	keys.clear();
+	stats = {};
+	stats.rawSize = (size_t)numFrames * numBones * sizeof(SkelAnimation::Bone);
+	if (numFrames == 0u)
+		return;
+
+	uint stride = Pose::getStride(numBones);
+	const float tolerances[] = { settings.positionTolerance, settings.rotationTolerance, settings.scaleTolerance };
+	std::vector<V4> values(numFrames);
+	std::vector<Track> vectorTracks, rotationTracks;
+	for (uint bone = 0; bone < numBones; ++bone)
+	{
+		for (uint type = 0; type < 3; ++type)
+		{
+			bool rotation = type == (uint)TrackType::Rotation;
+			for (uint frame = 0; frame < numFrames; ++frame)
+				values[frame] = readTrack(channels, stride, frame, bone, getFirstChannel(type), rotation ? 4u : 3u);
+
+			Track track;
+			track.bone = (ushort)bone;
+			track.type = (TrackType)type;
+			track.firstKey = (uint)keys.size();
+			track.firstKeyFrame = (uint)keyFrames.size();
+			track.offset = values[0];
+
+			bool constant = std::all_of(values.begin(), values.end(), [&](const V4& value) { return trackError(values[0], value, rotation) <= settings.constantTolerance; });
+			if (constant)
+			{
+				tracks.push_back(track);
+				++stats.numConstantTracks;
+				continue;
+			}
+
+			if (!rotation)
+			{
+				V4 max = values[0];
+				for (auto& value : values)
+				{
+					for (uint c = 0; c < 3; ++c)
+					{
+						track.offset[c] = std::min(track.offset[c], value[c]);
+						max[c] = std::max(max[c], value[c]);
+					}
+				}
+				track.range = max - track.offset;
+			}
+
+			auto keptFrames = selectKeys(values, tolerances[type], rotation);
+			if (keptFrames.size() * (sizeof(Key) + sizeof(ushort)) >= numFrames * sizeof(Key))
+				keptFrames = selectKeys(values, 0.0f, rotation); // storing the frame indices would cost more than the dropped keys
+			for (uint frame : keptFrames)
+			{
+				Key key;
+				if (rotation)
+					key = encodeRotation(toQuat(values[frame]));
+				else
+				{
+					for (uint c = 0; c < 3; ++c)
+					{
+						float range = track.range[c];
+						key.values[c] = range > 0.0f ? (ushort)std::clamp(lroundf((values[frame][c] - track.offset[c]) / range * 65535.0f), 0l, 65535l) : 0u;
+					}
+				}
+				// tracks that kept every key find them by frame index, only reduced ones store their frames
+				if (keptFrames.size() < numFrames)
+					keyFrames.push_back((ushort)frame);
+				keys.push_back(key);
+			}
+			track.numKeys = (uint)keys.size() - track.firstKey;
+			(rotation ? rotationTracks : vectorTracks).push_back(track);
+			++stats.numAnimatedTracks;
+			stats.numRawKeys += numFrames;
+		}
+	}
+
+	// constant tracks first, then animated vectors and rotations, so sample() runs a branch-free loop per kind
+	numVectorTracks = (uint)vectorTracks.size();
+	tracks.insert(tracks.end(), vectorTracks.begin(), vectorTracks.end());
+	tracks.insert(tracks.end(), rotationTracks.begin(), rotationTracks.end());
+
+	stats.numKeys = (uint)keys.size();
+	stats.compressedSize = getSize();
+	measureError(channels);
+}
+
+void CompressedClip::sample(float frameTime, Pose& pose, const uint* boneRemap) const
+{
+	pose.resize(numBones);
+	if (numFrames == 0u)
+		return;
+
+	float time = fmodf(std::max(frameTime, 0.0f), (float)numFrames);
+	uint frame = std::min((uint)time, numFrames - 1u);
+	float alpha = time - frame;
+	float* data = pose.getData();
+	uint stride = pose.getStride();
+
+	auto findKeys = [&](const Track& track, const Key*& a, const Key*& b)
+	{
+		const Key* trackKeys = keys.data() + track.firstKey;
+		if (track.numKeys == numFrames)
+		{
+			// the last frame blends into the first one like the uncompressed clip does
+			a = trackKeys + frame;
+			b = trackKeys + (frame + 1u == numFrames ? 0u : frame + 1u);
+			return alpha;
+		}
+
+		const ushort* frames = keyFrames.data() + track.firstKeyFrame;
+		if (frame >= frames[track.numKeys - 1])
+		{
+			a = trackKeys + track.numKeys - 1;
+			b = trackKeys;
+			return alpha;
+		}
+		uint key = (uint)(std::upper_bound(frames, frames + track.numKeys, frame) - frames) - 1u;
+		a = trackKeys + key;
+		b = trackKeys + key + 1u;
+		return (time - frames[key]) / (frames[key + 1] - frames[key]);
+	};
+
+	uint numConstantTracks = stats.numConstantTracks;
+	for (uint i = 0; i < numConstantTracks; ++i)
+	{
+		const Track& track = tracks[i];
+		if (boneRemap && boneRemap[track.bone] != track.bone)
+			continue;
+		float* out = data + getFirstChannel((uint)track.type) * stride + track.bone;
+		out[0] = track.offset.x;
+		out[stride] = track.offset.y;
+		out[stride * 2] = track.offset.z;
+		if (track.type == TrackType::Rotation)
+			out[stride * 3] = track.offset.w;
+	}
+
+	for (uint i = numConstantTracks; i < numConstantTracks + numVectorTracks; ++i)
+	{
+		const Track& track = tracks[i];
+		if (boneRemap && boneRemap[track.bone] != track.bone)
+			continue;
+		const Key* a;
+		const Key* b;
+		float keyAlpha = findKeys(track, a, b);
+		V4 v0 = decodeVector(track, *a);
+		V4 v = v0 + (decodeVector(track, *b) - v0) * keyAlpha;
+		float* out = data + getFirstChannel((uint)track.type) * stride + track.bone;
+		out[0] = v.x;
+		out[stride] = v.y;
+		out[stride * 2] = v.z;
+	}
+
+	float* rotationOut = data + Pose::RotationX * stride;
+	for (uint i = numConstantTracks + numVectorTracks; i < tracks.size(); ++i)
+	{
+		const Track& track = tracks[i];
+		if (boneRemap && boneRemap[track.bone] != track.bone)
+			continue;
+		const Key* a;
+		const Key* b;
+		float keyAlpha = findKeys(track, a, b);
+		Quat q = nlerp(decodeRotation(*a), decodeRotation(*b), keyAlpha);
+		float* out = rotationOut + track.bone;
+		out[0] = q.x;
+		out[stride] = q.y;
+		out[stride * 2] = q.z;
+		out[stride * 3] = q.w;
+	}
+}
+
+size_t CompressedClip::getSize() const
+{
+	return sizeof(*this) + tracks.size() * sizeof(Track) + keyFrames.size() * sizeof(ushort) + keys.size() * sizeof(Key);
+}
+
+size_t CompressedClip::getSampleSize() const
+{
+	size_t size = tracks.size() * sizeof(Track);
+	for (uint i = stats.numConstantTracks; i < tracks.size(); ++i)
+	{
+		size += 2u * sizeof(Key);
+		if (tracks[i].numKeys != numFrames)
+			size += std::bit_width(tracks[i].numKeys) * sizeof(ushort);
+	}
+	return size;
+}
+
+V4 CompressedClip::decodeVector(const Track& track, const Key& key) const
+{
+	constexpr float scale = 1.0f / 65535.0f;
+	return { track.offset.x + key.values[0] * scale * track.range.x, track.offset.y + key.values[1] * scale * track.range.y, track.offset.z + key.values[2] * scale * track.range.z };
+}
+
+Quat CompressedClip::decodeRotation(const Key& key)
+{
+	// 15 bits for the first two components, their low bits hold the index of the dropped one, 16 bits for the third
+	constexpr float scale15 = 2.0f * smallestThreeRange / 32767.0f;
+	constexpr float scale16 = 2.0f * smallestThreeRange / 65535.0f;
+	float a = (key.values[0] >> 1) * scale15 - smallestThreeRange;
+	float b = (key.values[1] >> 1) * scale15 - smallestThreeRange;
+	float c = key.values[2] * scale16 - smallestThreeRange;
+	float largest = sqrtf(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+	switch ((key.values[0] & 1u) | ((key.values[1] & 1u) << 1))
+	{
+	case 0: return { largest, a, b, c };
+	case 1: return { a, largest, b, c };
+	case 2: return { a, b, largest, c };
+	default: return { a, b, c, largest };
+	}
+}
+
+CompressedClip::Key CompressedClip::encodeRotation(Quat rotation)
+{
+	rotation = rotation.normalize();
+	float q[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+	uint largest = 0u;
+	for (uint c = 1; c < 4; ++c)
+	{
+		if (fabsf(q[c]) > fabsf(q[largest]))
+			largest = c;
+	}
+	float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+
+	auto quantize = [sign](float value, float maxValue)
+	{
+		float t = (value * sign + smallestThreeRange) / (2.0f * smallestThreeRange);
+		return (uint)std::clamp(lroundf(t * maxValue), 0l, (long)maxValue);
+	};
+
+	uint small[3];
+	for (uint c = 0, s = 0; c < 4; ++c)
+	{
+		if (c != largest)
+		{
+			small[s] = quantize(q[c], s < 2 ? 32767.0f : 65535.0f);
+			++s;
+		}
+	}
+
+	Key key;
+	key.values[0] = (ushort)((small[0] << 1) | (largest & 1u));
+	key.values[1] = (ushort)((small[1] << 1) | (largest >> 1));
+	key.values[2] = (ushort)small[2];
+	return key;
+}
+
+void CompressedClip::measureError(const float* channels)
+{
+	uint stride = Pose::getStride(numBones);
+	Pose pose;
+	for (uint frame = 0; frame < numFrames; ++frame)
+	{
+		sample((float)frame, pose);
+		for (uint bone = 0; bone < numBones; ++bone)
+		{
+			V4 position = readTrack(channels, stride, frame, bone, Pose::PositionX, 3u);
+			V4 rotation = readTrack(channels, stride, frame, bone, Pose::RotationX, 4u);
+			V4 scale = readTrack(channels, stride, frame, bone, Pose::ScaleX, 3u);
+			stats.maxPositionError = std::max(stats.maxPositionError, trackError(position, pose.getPosition(bone), false));
+			stats.maxRotationError = std::max(stats.maxRotationError, rotationError(toQuat(rotation), pose.getRotation(bone)));
+			stats.maxScaleError = std::max(stats.maxScaleError, trackError(scale, pose.getScale(bone), false));
+		}
+	}
+}
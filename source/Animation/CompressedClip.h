@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+
+class Pose;
+
+// Animation clip packed for memory. Every bone has a position, rotation and scale track: tracks that don't move
+// are stored once as a constant, animated ones as 16 bit keys quantized over the track's range, rotations as
+// smallest-three (the largest component is dropped and rebuilt from the unit length). Keys that linear
+// interpolation between their neighbours reproduces within the tolerance are dropped, the first and last frame are
+// always kept. Sampling decodes and blends just the two keys around the time, like the uncompressed sampler.
+class CompressedClip
+{
+public:
+
+	struct Settings
+	{
+		// Keyframe reduction, zero keeps every key
+		float positionTolerance = 0.0f;
+		float rotationTolerance = 0.0f; // radians
+		float scaleTolerance = 0.0f;
+		// Tracks that stay within this of their first frame are stored as constants
+		float constantTolerance = 1e-5f;
+	};
+
+	struct Stats
+	{
+		size_t rawSize = 0u; // a Bone per bone per frame
+		size_t compressedSize = 0u;
+		uint numConstantTracks = 0u;
+		uint numAnimatedTracks = 0u;
+		uint numKeys = 0u;
+		uint numRawKeys = 0u; // of the animated tracks
+		float maxPositionError = 0.0f;
+		float maxRotationError = 0.0f; // radians
+		float maxScaleError = 0.0f;
+
+		float getRatio() const { return compressedSize ? (float)rawSize / compressedSize : 0.0f; }
+	};
+
+	// channels holds numFrames poses laid out like Pose::getData(), frame after frame
+	void build(const float* channels, uint numFrames, uint numBones, const Settings& settings);
+
+	// frameTime is in frames and wraps, past the last frame it blends back into the first. With a boneRemap only
+	// the tracks of bones mapped to themselves are decoded, the other bones keep what the pose held.
+	void sample(float frameTime, Pose& pose, const uint* boneRemap = nullptr) const;
+
+	uint getNumFrames() const { return numFrames; }
+	uint getNumBones() const { return numBones; }
+	size_t getSize() const;
+	// Clip bytes one sample() reads: every track, two keys per animated track and, on reduced tracks, the key frames
+	// the binary search looks at
+	size_t getSampleSize() const;
+	const Stats& getStats() const { return stats; }
+
+private:
+
+	enum class TrackType : uchar
+	{
+		Position,
+		Rotation,
+		Scale
+	};
+
+	struct Track
+	{
+		ushort bone = 0u;
+		TrackType type = TrackType::Position;
+		uint firstKey = 0u;
+		uint firstKeyFrame = 0u; // unused when the track kept every frame's key
+		uint numKeys = 0u; // zero for constant tracks
+		V4 offset = V4::zero(); // the value of constant tracks, the range minimum of quantized vectors
+		V4 range = V4::zero();
+	};
+
+	struct Key
+	{
+		ushort values[3];
+	};
+
+	V4 decodeVector(const Track& track, const Key& key) const;
+	static Quat decodeRotation(const Key& key);
+	static Key encodeRotation(Quat rotation);
+	void measureError(const float* channels);
+
+	std::vector<Track> tracks; // constant ones first, then animated vectors, then animated rotations
+	std::vector<ushort> keyFrames; // frame index of every key of reduced tracks, ascending within a track
+	std::vector<Key> keys;
+	uint numVectorTracks = 0u;
+	uint numFrames = 0u;
+	uint numBones = 0u;
+	Stats stats;
+};
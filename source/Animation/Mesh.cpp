@@ -1,10 +1,19 @@
 #include "Mesh.h"
-#include "Importers/Importer_IQM.h"
+#include "Pose.h"
+#include "MeshSimplifier.h"
+#include "Engine/WorkerPool.h"
+#include "Importers/IqmFile.h"
 #include "Engine/Log.h"
+#include "Console/GlobalVar.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "third_party/tiny_obj_loader.h"
 
+#include <bit>
+
+// 0 leaves meshes as loaded, 1 optimizes them for the vertex cache and fetch, 2 also sorts them against overdraw
+GlobalVar<int> gMeshOptimize("meshOptimize", 2);
+
 #define FILL_VERTEX(Type, xxx) \
 if (vertarray.type == Type) \
 { \
@@ -20,102 +29,79 @@ if (vertarray.type == Type) \
 }
 
 std::vector<Mesh> Mesh::loadiqm(std::string_view filepath)
+{
+	return loadiqm(IqmFile(filepath));
+}
+
+std::vector<Mesh> Mesh::loadiqm(const IqmFile& file)
 {
 	std::vector<Mesh> result;
-	std::ifstream f(filepath.data(), std::ios_base::binary);
-	if (!f)
+	auto meshes = file.getMeshes();
+	if (meshes.empty())
 		return result;
 
-	iqmheader header;
-	f.read(reinterpret_cast<char*>(&header), sizeof(header));
-
-	std::vector<Mesh::Vertex> vertices;
-	std::vector<uint> indices;
-
-	if (header.num_meshes > 0 && header.ofs_meshes > 0)
+	const iqmheader& header = file.getHeader();
+	std::vector<Mesh::Vertex> vertices(header.num_vertexes);
+	assert(header.num_vertexarrays > 0);
+	for (auto& vertarray : file.getVertexArrays())
 	{
-		vertices.resize(header.num_vertexes);
-		indices.resize(header.num_triangles * 3);
-		assert(header.num_vertexarrays > 0);
-		f.seekg(header.ofs_vertexarrays);
-		std::vector<iqmvertexarray> vertexarrays;
-		vertexarrays.resize(header.num_vertexarrays);
-		f.read(reinterpret_cast<char*>(vertexarrays.data()), sizeof(iqmvertexarray) * header.num_vertexarrays);
-		for (auto& vertarray : vertexarrays)
+		if (vertarray.format == IQM_Format::IQM_FLOAT)
 		{
-			f.seekg(vertarray.offset);
-			
-			std::vector<float> floats;
-			std::vector<uchar> uchars;
-			uint numElements = vertarray.size * header.num_vertexes;
-
-			if (vertarray.format == IQM_Format::IQM_FLOAT)
+			auto floats = file.getVertexArray<float>(vertarray);
+			FILL_VERTEX(IQM_VertexArrayType::IQM_POSITION, pos);
+			FILL_VERTEX(IQM_VertexArrayType::IQM_TEXCOORD, tex);
+			FILL_VERTEX(IQM_VertexArrayType::IQM_NORMAL, normal);
+			FILL_VERTEX(IQM_VertexArrayType::IQM_TANGENT, tangent); //TO DO
+		}
+		else if (vertarray.format == IQM_Format::IQM_UBYTE)
+		{
+			auto uchars = file.getVertexArray<uchar>(vertarray);
+			if (vertarray.type == IQM_VertexArrayType::IQM_BLENDINDEXES)
 			{
-				floats.resize(numElements);
-				f.read(reinterpret_cast<char*>(floats.data()), numElements * sizeof(float));
-				FILL_VERTEX(IQM_VertexArrayType::IQM_POSITION, pos);
-				FILL_VERTEX(IQM_VertexArrayType::IQM_TEXCOORD, tex);
-				FILL_VERTEX(IQM_VertexArrayType::IQM_NORMAL, normal);
-				FILL_VERTEX(IQM_VertexArrayType::IQM_TANGENT, tangent); //TO DO
+				auto it = uchars.begin();
+				for (auto& v : vertices) 
+				{ 
+					v.boneIndices[0] = *it++;
+					v.boneIndices[1] = *it++;
+					v.boneIndices[2] = *it++;
+					v.boneIndices[3] = *it++;
+				}
 			}
-			else if (vertarray.format == IQM_Format::IQM_UBYTE)
+			if (vertarray.type == IQM_VertexArrayType::IQM_BLENDWEIGHTS)
 			{
-				uchars.resize(numElements);
-				f.read(reinterpret_cast<char*>(uchars.data()), numElements * sizeof(char));
-				if (vertarray.type == IQM_VertexArrayType::IQM_BLENDINDEXES)
-				{
-					auto it = uchars.begin();
-					for (auto& v : vertices) 
-					{ 
-						v.boneIndices[0] = *it++;
-						v.boneIndices[1] = *it++;
-						v.boneIndices[2] = *it++;
-						v.boneIndices[3] = *it++;
-					}
-				}
-				if (vertarray.type == IQM_VertexArrayType::IQM_BLENDWEIGHTS)
+				auto it = uchars.begin();
+				for (auto& v : vertices)
 				{
-					auto it = uchars.begin();
-					for (auto& v : vertices)
-					{
-						v.weights.x = *it++ / 255.0f;
-						v.weights.y = *it++ / 255.0f;
-						v.weights.z = *it++ / 255.0f;
-						v.weights.w = *it++ / 255.0f;
-					}
+					v.weights.x = *it++ / 255.0f;
+					v.weights.y = *it++ / 255.0f;
+					v.weights.z = *it++ / 255.0f;
+					v.weights.w = *it++ / 255.0f;
 				}
 			}
-			else
-				assert(false && "Unsupported type");
 		}
+		else
+			assert(false && "Unsupported type");
+	}
 
-		f.seekg(header.ofs_triangles);
-		f.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(uint));
-
-		result.reserve(header.num_meshes);
-		for (uint i = 0; i < header.num_meshes; ++i)
+	auto triangles = file.getTriangles();
+	result.reserve(meshes.size());
+	for (auto& meshIQM : meshes)
+	{
+		Mesh mesh;
+		std::copy_n(vertices.begin() + meshIQM.first_vertex, meshIQM.num_vertexes, std::back_inserter(mesh.vertices));
+		mesh.indices.reserve(meshIQM.num_triangles * 3);
+		// the file's indices count from the first vertex of all meshes, and its triangles wind the other way round
+		for (auto& triangle : triangles.subspan(meshIQM.first_triangle, meshIQM.num_triangles))
 		{
-			iqmmesh meshIQM;
-			f.seekg(header.ofs_meshes);
-			f.read(reinterpret_cast<char*>(&meshIQM), sizeof(meshIQM));
-
-			Mesh mesh;
-			std::copy_n(vertices.begin() + meshIQM.first_vertex, meshIQM.num_vertexes, std::back_inserter(mesh.vertices));
-			std::copy_n(indices.begin() + meshIQM.first_triangle * 3, meshIQM.num_triangles * 3, std::back_inserter(mesh.indices));
-			// TODO: recalculate indices accounting to their local vertexes
-
-
-			int s = mesh.indices.size()-1;
-			for (int i = 0; i <= s/2;i++)
-			{ 
-				std::swap(mesh.indices[i], mesh.indices[s - i]);
-			}
-			result.push_back(std::move(mesh));
+			for (int corner = 2; corner >= 0; --corner)
+				mesh.indices.push_back(triangle.vertex[corner] - meshIQM.first_vertex);
 		}
-		
+
+		if (gMeshOptimize.get() > 0)
+			mesh.optimize(gMeshOptimize.get() > 1);
+		result.push_back(std::move(mesh));
 	}
 
-	
 	logLine(x, Verbose, "Read meshes");
 	return result;
 }
@@ -131,11 +117,11 @@ std::vector<Mesh> Mesh::loadobj(std::string_view filepath)
 
 	assert(tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.data()));
 
-	//std::unordered_map<Vertex, uint32_t> uniqueVertices{};//TO DO
-
 	for (const auto& shape : shapes)
 	{
 		Mesh mesh;
+		mesh.vertices.reserve(shape.mesh.indices.size());
+		mesh.indices.reserve(shape.mesh.indices.size());
 		for (const auto& index : shape.mesh.indices)
 		{
 			Vertex vertex{};
@@ -175,22 +161,333 @@ std::vector<Mesh> Mesh::loadobj(std::string_view filepath)
 				};
 			}
 
-			/*if (uniqueVertices.count(vertex) == 0)
-			{
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				
-			}*/
-
 			mesh.vertices.push_back(vertex);
 			mesh.indices.push_back(mesh.vertices.size()-1);
 		}
+
+		// OBJ faces index every attribute separately, so each corner came in as a vertex of its own
+		auto weldStart = std::chrono::high_resolution_clock::now();
+		uint numCorners = (uint)mesh.vertices.size();
+		mesh.weldVertices();
+		float weldMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - weldStart).count();
+		logLine(x, Verbose, "Welded {} vertices of {} '{}' into {} ({:.1f}x fewer) in {:.2f} ms",
+			numCorners, filepath, shape.name, mesh.vertices.size(), mesh.vertices.empty() ? 0.0f : (float)numCorners / mesh.vertices.size(), weldMs);
+
 		mesh.computeTangents();
+		if (gMeshOptimize.get() > 0)
+			mesh.optimize(gMeshOptimize.get() > 1);
 		result.push_back(mesh);
 	}
 
 	return result;
 }
 
+uint Mesh::weldVertices()
+{
+	// no padding in a vertex, so equal bits mean an equal vertex and the words can be hashed as they are
+	constexpr uint vertexWords = sizeof(Vertex) / sizeof(uint32_t);
+	static_assert(sizeof(Vertex) == vertexWords * sizeof(uint32_t) && sizeof(Vertex) == 22u * sizeof(float));
+	auto hash = [](const Vertex& vertex)
+	{
+		uint32_t words[vertexWords];
+		memcpy(words, &vertex, sizeof(Vertex));
+		uint32_t hash = 2166136261u;
+		for (uint32_t word : words)
+			hash = (hash ^ word) * 16777619u;
+		return hash ^ hash >> 15;
+	};
+
+	// open addressing with linear probing, at most half full. Slots hold indices of the welded vertices, which
+	// are moved to the front of the array in place as they're found.
+	constexpr uint emptySlot = ~0u;
+	uint numVertices = (uint)vertices.size();
+	std::vector<uint> slots(std::bit_ceil(std::max(numVertices, 1u) * 2u), emptySlot);
+	uint slotMask = (uint)slots.size() - 1u;
+	std::vector<uint> remap(numVertices);
+	uint numWelded = 0u;
+	for (uint i = 0; i < numVertices; ++i)
+	{
+		uint slot = hash(vertices[i]) & slotMask;
+		while (slots[slot] != emptySlot && memcmp(&vertices[slots[slot]], &vertices[i], sizeof(Vertex)) != 0)
+			slot = (slot + 1u) & slotMask;
+		if (slots[slot] == emptySlot)
+		{
+			vertices[numWelded] = vertices[i];
+			slots[slot] = numWelded++;
+		}
+		remap[i] = slots[slot];
+	}
+
+	for (uint32_t& index : indices)
+		index = remap[index];
+	vertices.resize(numWelded);
+	return numVertices - numWelded;
+}
+
+Mesh::CacheStats Mesh::getCacheStats(std::span<const uint32_t> indices, uint numVertices, uint cacheSize)
+{
+	// a vertex stays in a FIFO cache until cacheSize other vertices came in after it
+	std::vector<uint> missTimes(numVertices, 0u);
+	std::vector<bool> isUsed(numVertices);
+	uint time = cacheSize + 1u;
+	uint numMisses = 0u;
+	uint numUsed = 0u;
+	for (uint32_t index : indices)
+	{
+		if (time - missTimes[index] > cacheSize)
+		{
+			missTimes[index] = time++;
+			++numMisses;
+		}
+		if (!isUsed[index])
+		{
+			isUsed[index] = true;
+			++numUsed;
+		}
+	}
+
+	CacheStats stats;
+	if (!indices.empty())
+	{
+		stats.acmr = numMisses * 3.0f / indices.size();
+		stats.atvr = (float)numMisses / numUsed;
+	}
+	return stats;
+}
+
+std::vector<uint> Mesh::optimizeVertexCache(std::vector<uint32_t>& indices, uint numVertices, uint cacheSize)
+{
+	uint numTriangles = (uint)indices.size() / 3u;
+	std::vector<uint> clusterStarts;
+	if (numTriangles == 0u)
+		return clusterStarts;
+
+	// the triangles around every vertex, and how many of them are still to go
+	std::vector<uint> liveTriangles(numVertices, 0u);
+	for (uint32_t index : indices)
+		++liveTriangles[index];
+	std::vector<uint> adjacencyOffsets(numVertices + 1u, 0u);
+	for (uint vertex = 0; vertex < numVertices; ++vertex)
+		adjacencyOffsets[vertex + 1u] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+	std::vector<uint> adjacency(indices.size());
+	{
+		std::vector<uint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint i = 0; i < indices.size(); ++i)
+			adjacency[fill[indices[i]]++] = i / 3u;
+	}
+
+	// fans out the triangles around one vertex after the other, each next vertex picked among the ones just used
+	std::vector<uint> cacheTimes(numVertices, 0u);
+	std::vector<bool> isEmitted(numTriangles);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	uint time = cacheSize + 1u;
+	uint cursor = 0u;
+	int fanning = (int)indices[0];
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (uint i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; ++i)
+		{
+			uint triangle = adjacency[i];
+			if (isEmitted[triangle])
+				continue;
+			isEmitted[triangle] = true;
+			for (uint corner = 0; corner < 3u; ++corner)
+			{
+				uint32_t vertex = indices[triangle * 3u + corner];
+				result.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				--liveTriangles[vertex];
+				if (time - cacheTimes[vertex] > cacheSize)
+					cacheTimes[vertex] = time++;
+			}
+		}
+
+		// the candidate in the cache the longest that stays there while its remaining triangles are emitted,
+		// if none would, any with triangles left
+		int next = -1;
+		uint bestPriority = 0u;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0u)
+				continue;
+			uint age = time - cacheTimes[vertex];
+			uint priority = age + 2u * liveTriangles[vertex] <= cacheSize ? age : 0u;
+			if (next < 0 || priority > bestPriority)
+			{
+				next = (int)vertex;
+				bestPriority = priority;
+			}
+		}
+
+		// a dead end, back to the most recently used vertex with triangles left or on in input order
+		while (next < 0 && !deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0u)
+				next = (int)vertex;
+		}
+		for (; next < 0 && cursor < numVertices; ++cursor)
+		{
+			if (liveTriangles[cursor] > 0u)
+				next = (int)cursor;
+		}
+		fanning = next;
+	}
+	indices = std::move(result);
+
+	// clusters start where a triangle misses the cache with every vertex
+	std::fill(cacheTimes.begin(), cacheTimes.end(), 0u);
+	time = cacheSize + 1u;
+	for (uint triangle = 0; triangle < numTriangles; ++triangle)
+	{
+		uint numMisses = 0u;
+		for (uint corner = 0; corner < 3u; ++corner)
+		{
+			uint32_t vertex = indices[triangle * 3u + corner];
+			if (time - cacheTimes[vertex] > cacheSize)
+			{
+				cacheTimes[vertex] = time++;
+				++numMisses;
+			}
+		}
+		if (numMisses == 3u)
+			clusterStarts.push_back(triangle);
+	}
+	return clusterStarts;
+}
+
+void Mesh::sortClustersForOverdraw(std::span<const uint> clusterStarts)
+{
+	// clusters on the outside of a mesh facing away from its center tend to hide the ones behind them, so they go first
+	struct Cluster
+	{
+		uint begin = 0u;
+		uint end = 0u;
+		V4 center = V4::zero();
+		V4 normal = V4::zero();
+		float outwardness = 0.0f;
+	};
+
+	uint numTriangles = (uint)indices.size() / 3u;
+	std::vector<Cluster> clusters(clusterStarts.size());
+	V4 meshCenter = V4::zero();
+	float meshArea = 0.0f;
+	for (uint i = 0; i < clusters.size(); ++i)
+	{
+		Cluster& cluster = clusters[i];
+		cluster.begin = clusterStarts[i];
+		cluster.end = i + 1u < clusters.size() ? clusterStarts[i + 1u] : numTriangles;
+
+		// area weighted, the cross product's length is twice the triangle's area
+		float area = 0.0f;
+		for (uint triangle = cluster.begin; triangle < cluster.end; ++triangle)
+		{
+			const V3& p0 = vertices[indices[triangle * 3u]].pos;
+			const V3& p1 = vertices[indices[triangle * 3u + 1u]].pos;
+			const V3& p2 = vertices[indices[triangle * 3u + 2u]].pos;
+			V4 normal = V4{ p1.x - p0.x, p1.y - p0.y, p1.z - p0.z }.cross(V4{ p2.x - p0.x, p2.y - p0.y, p2.z - p0.z });
+			float triangleArea = normal.length();
+			cluster.center = cluster.center + V4{ p0.x + p1.x + p2.x, p0.y + p1.y + p2.y, p0.z + p1.z + p2.z } * (triangleArea / 3.0f);
+			cluster.normal = cluster.normal + normal;
+			area += triangleArea;
+		}
+		meshCenter = meshCenter + cluster.center;
+		meshArea += area;
+		if (area > 0.0f)
+			cluster.center = cluster.center * (1.0f / area);
+	}
+	if (meshArea > 0.0f)
+		meshCenter = meshCenter * (1.0f / meshArea);
+
+	for (Cluster& cluster : clusters)
+	{
+		float normalLength = cluster.normal.length();
+		cluster.outwardness = normalLength > 0.0f ? (cluster.center - meshCenter).dot(cluster.normal) / normalLength : 0.0f;
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.outwardness > b.outwardness; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for (const Cluster& cluster : clusters)
+		sorted.insert(sorted.end(), indices.begin() + cluster.begin * 3u, indices.begin() + cluster.end * 3u);
+	indices = std::move(sorted);
+}
+
+void Mesh::optimizeVertexFetch()
+{
+	constexpr uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = (uint32_t)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+}
+
+void Mesh::optimize(bool reduceOverdraw)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	CacheStats before = getCacheStats(indices, (uint)vertices.size());
+	std::vector<uint> clusterStarts = optimizeVertexCache(indices, (uint)vertices.size());
+	if (reduceOverdraw)
+		sortClustersForOverdraw(clusterStarts);
+	optimizeVertexFetch();
+	CacheStats after = getCacheStats(indices, (uint)vertices.size());
+	float optimizeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	logLine(x, Verbose, "Optimized {} triangles in {:.2f} ms: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, {} clusters{}",
+		indices.size() / 3u, optimizeMs, before.acmr, after.acmr, before.atvr, after.atvr, clusterStarts.size(), reduceOverdraw ? " sorted for overdraw" : "");
+}
+
+void Mesh::generateLods(const LodSettings& settings)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	lods.clear();
+	MeshSimplifier simplifier(*this);
+	uint previousIndexCount = (uint)indices.size();
+	std::string lodTriangles;
+	while (lods.size() < settings.maxLods)
+	{
+		uint targetIndexCount = (uint)(previousIndexCount / 3u * settings.reduction) * 3u;
+		if (targetIndexCount < settings.minTriangles * 3u)
+			break;
+
+		Lod lod;
+		lod.indices = simplifier.simplify(targetIndexCount, settings.maxError * simplifier.getRadius(), lod.error);
+		// stuck on the error bound
+		if (lod.indices.empty() || lod.indices.size() > previousIndexCount * (1.0f + settings.reduction) * 0.5f)
+			break;
+		optimizeVertexCache(lod.indices, (uint)vertices.size());
+		previousIndexCount = (uint)lod.indices.size();
+		lodTriangles += std::format(" {} ({:.4f})", lod.indices.size() / 3u, lod.error);
+		lods.push_back(std::move(lod));
+	}
+
+	float lodMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	logLine(x, Verbose, "Generated {} LODs of {} triangles in {:.1f} ms, triangles (error):{}", lods.size(), indices.size() / 3u, lodMs, lodTriangles);
+}
+
+void Mesh::generateLods(std::span<Mesh> meshes, const LodSettings& settings, WorkerPool& workers)
+{
+	workers.parallelFor((uint)meshes.size(), 1u, [&](uint begin, uint end)
+	{
+		for (uint i = begin; i < end; ++i)
+			meshes[i].generateLods(settings);
+	});
+}
+
 void Mesh::generatePlane(float size)
 {
 	float x = size / 2.0f;
@@ -357,4 +654,40 @@ void Mesh::computeTangents()
 	{
 		vertices[i].tangent = vertices[i].tangent.normalize();
 	}
+}
+
+void Mesh::skinVertices(const float* palette, V3* positions, V3* normals) const
+{
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		// the weighted sum of the bones' matrices
+		const Vertex& vertex = vertices[i];
+		float rows[Pose::paletteFloatsPerBone] = {};
+		for (uint influence = 0; influence < 4; ++influence)
+		{
+			float weight = vertex.weights[influence];
+			if (weight <= 0.0f)
+				continue;
+			const float* matrix = palette + vertex.boneIndices[influence] * Pose::paletteFloatsPerBone;
+			for (uint j = 0; j < Pose::paletteFloatsPerBone; ++j)
+				rows[j] += weight * matrix[j];
+		}
+
+		positions[i] =
+		{
+			rows[0] * vertex.pos.x + rows[1] * vertex.pos.y + rows[2] * vertex.pos.z + rows[3],
+			rows[4] * vertex.pos.x + rows[5] * vertex.pos.y + rows[6] * vertex.pos.z + rows[7],
+			rows[8] * vertex.pos.x + rows[9] * vertex.pos.y + rows[10] * vertex.pos.z + rows[11]
+		};
+		if (normals)
+		{
+			V3 normal =
+			{
+				rows[0] * vertex.normal.x + rows[1] * vertex.normal.y + rows[2] * vertex.normal.z,
+				rows[4] * vertex.normal.x + rows[5] * vertex.normal.y + rows[6] * vertex.normal.z,
+				rows[8] * vertex.normal.x + rows[9] * vertex.normal.y + rows[10] * vertex.normal.z
+			};
+			normals[i] = normal.normalize();
+		}
+	}
 }
\ No newline at end of file
@@ -2,15 +2,19 @@
 
 #include "Common.h"
 #include "Engine/Math/Math.h"
+#include <span>
 
 
 class Model;
+class IqmFile;
+class WorkerPool;
 
 class Mesh
 {
 public:
 
 	static std::vector<Mesh> loadiqm(std::string_view filepath);
+	static std::vector<Mesh> loadiqm(const IqmFile& file);
 	static std::vector<Mesh> loadobj(std::string_view filepath);
 
 	void generatePlane(float size = 1.0f);
@@ -29,11 +33,69 @@ public:
 		V4 weights = V4::zero();
 	};
 
+	const std::vector<Vertex>& getVertices() const { return vertices; }
+	const std::vector<uint32_t>& getIndices() const { return indices; }
+
+	// Merges vertices that are equal bit for bit and points the indices at the ones kept, in first use order.
+	// Returns how many vertices were removed.
+	uint weldVertices();
+
+	// How well an index buffer uses a FIFO post-transform cache of cacheSize vertices: cache misses per triangle
+	// (ACMR, 3 at worst, about 0.5 for a large regular grid) and per referenced vertex (ATVR, 1 at best)
+	struct CacheStats
+	{
+		float acmr = 0.0f;
+		float atvr = 0.0f;
+	};
+	static CacheStats getCacheStats(std::span<const uint32_t> indices, uint numVertices, uint cacheSize = 16u);
+
+	// Reorders the triangles for the vertex cache with Tipsify, see optimizeVertexCache, and with reduceOverdraw
+	// sorts the resulting clusters so that ones facing out of the mesh come first. Then reorders the vertices in the
+	// order the triangles use them. The loaders run this, ACMR and ATVR before and after are logged.
+	void optimize(bool reduceOverdraw = true);
+	// Tipsify (Sander et al. 2007) for a cache of cacheSize. Returns the first triangle of every cluster, where
+	// the cache starts over from nothing, the points triangles can be reordered at without costing cache misses.
+	static std::vector<uint> optimizeVertexCache(std::vector<uint32_t>& indices, uint numVertices, uint cacheSize = 16u);
+
+	// A coarser version of the triangles over the same vertices, see MeshSimplifier
+	struct Lod
+	{
+		std::vector<uint32_t> indices;
+		// how far the simplified surface is from the full one in model units, see MeshSimplifier::simplify
+		float error = 0.0f;
+	};
+
+	struct LodSettings
+	{
+		// every LOD aims for this fraction of the previous one's triangles
+		float reduction = 0.5f;
+		// relative to the mesh's radius, no LOD is further from the full mesh
+		float maxError = 0.05f;
+		uint maxLods = 4u;
+		uint minTriangles = 32u;
+	};
+
+	// The LODs after the full mesh, finer ones first. Each is simplified from the full triangles and optimized for
+	// the vertex cache, the chain stops early once the error bound or minTriangles keep a LOD from getting smaller.
+	void generateLods(const LodSettings& settings);
+	// One mesh per job across the workers
+	static void generateLods(std::span<Mesh> meshes, const LodSettings& settings, WorkerPool& workers);
+	const std::vector<Lod>& getLods() const { return lods; }
+
+	// Positions and optionally normals posed by a skinning palette, the way the skinning shaders do it,
+	// see Pose::writeSkinningPalette. One of each per vertex.
+	void skinVertices(const float* palette, V3* positions, V3* normals = nullptr) const;
+
 protected:
 	friend class Model;
 
 	void computeTangents();
+	// Orders clusters of optimizeVertexCache by how far out of the mesh they face
+	void sortClustersForOverdraw(std::span<const uint> clusterStarts);
+	// Vertices in the order the indices first use them, unused ones dropped
+	void optimizeVertexFetch();
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	std::vector<Lod> lods;
 };
@@ -0,0 +1,368 @@
+#include "MeshSimplifier.h"
+#include "Mesh.h"
+#include <bit>
+
+// edge planes along borders and seams weigh this much more than the triangles' planes, so they keep their shape
+constexpr double boundaryWeight = 10.0;
+// a complete change of skin weights costs as much as moving the surface this far, relative to the mesh's radius
+constexpr float skinWeightDistance = 0.1f;
+
+namespace
+{
+	uint64 getEdgeKey(uint32_t a, uint32_t b)
+	{
+		return (uint64)a << 32 | b;
+	}
+
+	// Half the summed difference of two vertices' bone weights, from 0 for the same influences to 1 for none shared
+	float getSkinWeightDifference(const Mesh::Vertex& a, const Mesh::Vertex& b)
+	{
+		float difference = 0.0f;
+		for (uint i = 0; i < 4u; ++i)
+		{
+			float weightInB = 0.0f;
+			for (uint j = 0; j < 4u; ++j)
+			{
+				if (b.boneIndices[j] == a.boneIndices[i])
+					weightInB += b.weights[j];
+			}
+			difference += fabsf(a.weights[i] - weightInB);
+		}
+		for (uint j = 0; j < 4u; ++j)
+		{
+			bool isInA = false;
+			for (uint i = 0; i < 4u; ++i)
+				isInA |= a.boneIndices[i] == b.boneIndices[j] && a.weights[i] > 0.0f;
+			if (!isInA)
+				difference += b.weights[j];
+		}
+		return std::min(difference * 0.5f, 1.0f);
+	}
+
+	V4 getNormal(const V3& p0, const V3& p1, const V3& p2)
+	{
+		return V4{ p1.x - p0.x, p1.y - p0.y, p1.z - p0.z }.cross(V4{ p2.x - p0.x, p2.y - p0.y, p2.z - p0.z });
+	}
+}
+
+MeshSimplifier::Quadric MeshSimplifier::Quadric::fromPlane(double a, double b, double c, double d, double weight)
+{
+	Quadric quadric;
+	quadric.xx = a * a * weight;
+	quadric.xy = a * b * weight;
+	quadric.xz = a * c * weight;
+	quadric.xw = a * d * weight;
+	quadric.yy = b * b * weight;
+	quadric.yz = b * c * weight;
+	quadric.yw = b * d * weight;
+	quadric.zz = c * c * weight;
+	quadric.zw = c * d * weight;
+	quadric.ww = d * d * weight;
+	quadric.weight = weight;
+	return quadric;
+}
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& other)
+{
+	xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+	yy += other.yy; yz += other.yz; yw += other.yw;
+	zz += other.zz; zw += other.zw;
+	ww += other.ww;
+	weight += other.weight;
+	return *this;
+}
+
+double MeshSimplifier::Quadric::evaluate(const V3& point) const
+{
+	double x = point.x;
+	double y = point.y;
+	double z = point.z;
+	if (weight <= 0.0)
+		return 0.0;
+	return (x * x * xx + y * y * yy + z * z * zz + ww
+		+ 2.0 * (x * y * xy + x * z * xz + y * z * yz + x * xw + y * yw + z * zw)) / weight;
+}
+
+MeshSimplifier::MeshSimplifier(const Mesh& mesh_)
+	: mesh(mesh_)
+{
+	const std::vector<Mesh::Vertex>& vertices = mesh.getVertices();
+	const std::vector<uint32_t>& indices = mesh.getIndices();
+	uint numVertices = (uint)vertices.size();
+
+	// vertices with the same position bits, sorted next to each other
+	auto getPositionBits = [&](uint32_t vertex)
+	{
+		const V3& pos = vertices[vertex].pos;
+		return std::array<uint32_t, 3>{ std::bit_cast<uint32_t>(pos.x), std::bit_cast<uint32_t>(pos.y), std::bit_cast<uint32_t>(pos.z) };
+	};
+	std::vector<uint32_t> order(numVertices);
+	for (uint32_t i = 0; i < numVertices; ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return getPositionBits(a) < getPositionBits(b); });
+	positionRemap.resize(numVertices);
+	siblings.resize(numVertices);
+	for (uint first = 0, last = 0; first < numVertices; first = last)
+	{
+		for (last = first + 1u; last < numVertices && getPositionBits(order[last]) == getPositionBits(order[first]); ++last);
+		for (uint i = first; i < last; ++i)
+		{
+			positionRemap[order[i]] = order[first];
+			siblings[order[i]] = order[i + 1u < last ? i + 1u : first];
+		}
+	}
+
+	// an edge only one triangle has is open, on a border if no triangle has it at the same positions either
+	std::unordered_set<uint64> halfEdges;
+	std::unordered_set<uint64> positionHalfEdges;
+	for (uint i = 0; i < indices.size(); ++i)
+	{
+		uint32_t a = indices[i];
+		uint32_t b = indices[i % 3u == 2u ? i - 2u : i + 1u];
+		halfEdges.insert(getEdgeKey(a, b));
+		positionHalfEdges.insert(getEdgeKey(positionRemap[a], positionRemap[b]));
+	}
+	std::vector<uint> numOpenOut(numVertices, 0u);
+	std::vector<uint> numOpenIn(numVertices, 0u);
+	std::vector<bool> isOnBorder(numVertices);
+	quadrics.resize(numVertices);
+	for (uint triangle = 0; triangle < indices.size() / 3u; ++triangle)
+	{
+		const uint32_t* corners = indices.data() + triangle * 3u;
+		const V3& p0 = vertices[corners[0]].pos;
+		V4 normal = getNormal(p0, vertices[corners[1]].pos, vertices[corners[2]].pos);
+		double area = normal.length();
+		if (area > 0.0)
+		{
+			normal = normal * (1.0f / (float)area);
+			Quadric plane = Quadric::fromPlane(normal.x, normal.y, normal.z, -(normal.x * p0.x + normal.y * p0.y + normal.z * p0.z), area * 0.5);
+			for (uint corner = 0; corner < 3u; ++corner)
+				quadrics[positionRemap[corners[corner]]] += plane;
+		}
+
+		for (uint corner = 0; corner < 3u; ++corner)
+		{
+			uint32_t a = corners[corner];
+			uint32_t b = corners[(corner + 1u) % 3u];
+			if (halfEdges.contains(getEdgeKey(b, a)))
+				continue;
+			++numOpenOut[a];
+			++numOpenIn[b];
+			if (!positionHalfEdges.contains(getEdgeKey(positionRemap[b], positionRemap[a])))
+				isOnBorder[a] = isOnBorder[b] = true;
+
+			// a plane through the edge upright on the triangle keeps the border or seam from moving sideways
+			const V3& pa = vertices[a].pos;
+			const V3& pb = vertices[b].pos;
+			V4 edge = { pb.x - pa.x, pb.y - pa.y, pb.z - pa.z };
+			V4 edgeNormal = edge.cross(normal);
+			float edgeNormalLength = edgeNormal.length();
+			if (area <= 0.0 || edgeNormalLength <= 0.0f)
+				continue;
+			edgeNormal = edgeNormal * (1.0f / edgeNormalLength);
+			Quadric edgePlane = Quadric::fromPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, -(edgeNormal.x * pa.x + edgeNormal.y * pa.y + edgeNormal.z * pa.z), edge.length2() * boundaryWeight);
+			quadrics[positionRemap[a]] += edgePlane;
+			quadrics[positionRemap[b]] += edgePlane;
+		}
+	}
+
+	kinds.resize(numVertices);
+	for (uint32_t vertex = 0; vertex < numVertices; ++vertex)
+	{
+		uint32_t sibling = siblings[vertex];
+		bool hasOneOpenEdgeEach = numOpenOut[vertex] == 1u && numOpenIn[vertex] == 1u;
+		if (sibling == vertex)
+			kinds[vertex] = numOpenOut[vertex] == 0u && numOpenIn[vertex] == 0u ? VertexKind::Manifold : hasOneOpenEdgeEach ? VertexKind::Border : VertexKind::Locked;
+		else if (siblings[sibling] == vertex && hasOneOpenEdgeEach && numOpenOut[sibling] == 1u && numOpenIn[sibling] == 1u && !isOnBorder[vertex] && !isOnBorder[sibling])
+			kinds[vertex] = VertexKind::Seam;
+		else
+			kinds[vertex] = VertexKind::Locked;
+	}
+
+	if (!vertices.empty())
+	{
+		V3 min = vertices[0].pos;
+		V3 max = vertices[0].pos;
+		for (const Mesh::Vertex& vertex : vertices)
+		{
+			min = { std::min(min.x, vertex.pos.x), std::min(min.y, vertex.pos.y), std::min(min.z, vertex.pos.z) };
+			max = { std::max(max.x, vertex.pos.x), std::max(max.y, vertex.pos.y), std::max(max.z, vertex.pos.z) };
+		}
+		radius = (max - min).length() * 0.5f;
+	}
+	skinWeightCost = (radius * skinWeightDistance) * (radius * skinWeightDistance);
+}
+
+bool MeshSimplifier::canCollapse(uint32_t source, uint32_t target, const std::unordered_set<uint64>& halfEdges) const
+{
+	auto isOpen = [&](uint32_t a, uint32_t b)
+	{
+		return halfEdges.contains(getEdgeKey(a, b)) != halfEdges.contains(getEdgeKey(b, a));
+	};
+
+	if (positionRemap[source] == positionRemap[target])
+		return false;
+	VertexKind targetKind = kinds[target];
+	switch (kinds[source])
+	{
+	case VertexKind::Manifold:
+		return true;
+	case VertexKind::Border:
+		return (targetKind == VertexKind::Border || targetKind == VertexKind::Locked) && isOpen(source, target);
+	case VertexKind::Seam:
+		return targetKind == VertexKind::Seam && isOpen(source, target) && isOpen(siblings[source], siblings[target]);
+	default:
+		return false;
+	}
+}
+
+MeshSimplifier::Collapse MeshSimplifier::getCollapse(uint32_t source, uint32_t target, const std::vector<Quadric>& currentQuadrics) const
+{
+	const Mesh::Vertex& sourceVertex = mesh.getVertices()[source];
+	const Mesh::Vertex& targetVertex = mesh.getVertices()[target];
+	Collapse collapse;
+	collapse.source = source;
+	collapse.target = target;
+	collapse.error = (float)std::max(currentQuadrics[positionRemap[source]].evaluate(targetVertex.pos), 0.0);
+	float skinWeightDifference = getSkinWeightDifference(sourceVertex, targetVertex);
+	collapse.cost = collapse.error + skinWeightDifference * skinWeightDifference * skinWeightCost;
+	return collapse;
+}
+
+bool MeshSimplifier::flipsTriangle(uint32_t source, uint32_t target, std::span<const uint32_t> indices, std::span<const uint> adjacencyOffsets, std::span<const uint> adjacency) const
+{
+	const std::vector<Mesh::Vertex>& vertices = mesh.getVertices();
+	uint32_t sourcePosition = positionRemap[source];
+	uint32_t targetPosition = positionRemap[target];
+	for (uint i = adjacencyOffsets[sourcePosition]; i < adjacencyOffsets[sourcePosition + 1u]; ++i)
+	{
+		const uint32_t* corners = indices.data() + adjacency[i] * 3u;
+		V3 before[3];
+		V3 after[3];
+		bool collapses = false;
+		for (uint corner = 0; corner < 3u; ++corner)
+		{
+			uint32_t position = positionRemap[corners[corner]];
+			collapses |= position == targetPosition;
+			before[corner] = vertices[corners[corner]].pos;
+			after[corner] = position == sourcePosition ? vertices[target].pos : before[corner];
+		}
+		if (collapses)
+			continue;
+		if (getNormal(before[0], before[1], before[2]).dot(getNormal(after[0], after[1], after[2])) <= 0.0f)
+			return true;
+	}
+	return false;
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(uint targetIndexCount, float maxError, float& error) const
+{
+	std::vector<uint32_t> indices = mesh.getIndices();
+	uint numVertices = (uint)mesh.getVertices().size();
+	std::vector<Quadric> currentQuadrics = quadrics;
+	float maxSquaredError = maxError * maxError;
+	float largestSquaredError = 0.0f;
+
+	std::unordered_set<uint64> halfEdges;
+	std::vector<uint> adjacencyOffsets(numVertices + 1u);
+	std::vector<uint> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseRemap(numVertices);
+	std::vector<bool> isLocked(numVertices);
+	while (indices.size() > targetIndexCount)
+	{
+		// the edges and the triangles around every position as they are now
+		halfEdges.clear();
+		for (uint i = 0; i < indices.size(); ++i)
+			halfEdges.insert(getEdgeKey(indices[i], indices[i % 3u == 2u ? i - 2u : i + 1u]));
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0u);
+		for (uint32_t index : indices)
+			++adjacencyOffsets[positionRemap[index] + 1u];
+		for (uint vertex = 0; vertex < numVertices; ++vertex)
+			adjacencyOffsets[vertex + 1u] += adjacencyOffsets[vertex];
+		adjacency.resize(indices.size());
+		{
+			std::vector<uint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint i = 0; i < indices.size(); ++i)
+				adjacency[fill[positionRemap[indices[i]]]++] = i / 3u;
+		}
+
+		// the cheaper way to collapse every edge, once per edge
+		collapses.clear();
+		for (uint i = 0; i < indices.size(); ++i)
+		{
+			uint32_t a = indices[i];
+			uint32_t b = indices[i % 3u == 2u ? i - 2u : i + 1u];
+			if (a > b && halfEdges.contains(getEdgeKey(b, a)))
+				continue;
+			Collapse best;
+			best.cost = std::numeric_limits<float>::max();
+			for (auto [source, target] : { std::pair{ a, b }, std::pair{ b, a } })
+			{
+				if (!canCollapse(source, target, halfEdges))
+					continue;
+				Collapse collapse = getCollapse(source, target, currentQuadrics);
+				if (collapse.error <= maxSquaredError && collapse.cost < best.cost)
+					best = collapse;
+			}
+			if (best.cost < std::numeric_limits<float>::max())
+				collapses.push_back(best);
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// cheapest first, a collapse locks the triangles around it for the rest of the pass so the flip checks hold
+		for (uint32_t vertex = 0; vertex < numVertices; ++vertex)
+			collapseRemap[vertex] = vertex;
+		std::fill(isLocked.begin(), isLocked.end(), false);
+		uint numTrianglesToRemove = ((uint)indices.size() - targetIndexCount + 2u) / 3u;
+		uint numRemovedTriangles = 0u;
+		uint numCollapses = 0u;
+		for (const Collapse& collapse : collapses)
+		{
+			if (numRemovedTriangles >= numTrianglesToRemove)
+				break;
+			uint32_t sourcePosition = positionRemap[collapse.source];
+			uint32_t targetPosition = positionRemap[collapse.target];
+			if (isLocked[sourcePosition] || isLocked[targetPosition] || flipsTriangle(collapse.source, collapse.target, indices, adjacencyOffsets, adjacency))
+				continue;
+
+			collapseRemap[collapse.source] = collapse.target;
+			if (kinds[collapse.source] == VertexKind::Seam)
+				collapseRemap[siblings[collapse.source]] = siblings[collapse.target];
+			currentQuadrics[targetPosition] += currentQuadrics[sourcePosition];
+			for (uint i = adjacencyOffsets[sourcePosition]; i < adjacencyOffsets[sourcePosition + 1u]; ++i)
+			{
+				bool hasTarget = false;
+				for (uint corner = 0; corner < 3u; ++corner)
+				{
+					uint32_t position = positionRemap[indices[adjacency[i] * 3u + corner]];
+					isLocked[position] = true;
+					hasTarget |= position == targetPosition;
+				}
+				numRemovedTriangles += hasTarget;
+			}
+			largestSquaredError = std::max(largestSquaredError, collapse.error);
+			++numCollapses;
+		}
+		if (numCollapses == 0u)
+			break;
+
+		// triangles that lost their area, at the same position even if not the same vertex, are gone
+		uint numIndices = 0u;
+		for (uint i = 0; i < indices.size(); i += 3u)
+		{
+			uint32_t a = collapseRemap[indices[i]];
+			uint32_t b = collapseRemap[indices[i + 1u]];
+			uint32_t c = collapseRemap[indices[i + 2u]];
+			if (positionRemap[a] == positionRemap[b] || positionRemap[b] == positionRemap[c] || positionRemap[c] == positionRemap[a])
+				continue;
+			indices[numIndices++] = a;
+			indices[numIndices++] = b;
+			indices[numIndices++] = c;
+		}
+		indices.resize(numIndices);
+	}
+
+	error = sqrtf(largestSquaredError);
+	return indices;
+}
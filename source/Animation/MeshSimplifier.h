@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include <span>
+
+class Mesh;
+
+// Quadric error edge collapse (Garland and Heckbert) over the triangles of a Mesh. A vertex only ever collapses onto
+// one of its neighbours, so simplified indices still point at the mesh's own vertices and UVs, normals and skin
+// weights stay exactly as they were. Vertices that share a position but differ otherwise, like both sides of a UV
+// seam, only move along their seam and both at once, so the seam stays closed. Open borders only move along
+// themselves, anything else around a shared position is locked. Collapses between vertices with different skin
+// weights are ordered as if they cost extra, so joints keep their triangles the longest, the error bound only
+// counts how far the surface moves.
+class MeshSimplifier
+{
+public:
+
+	explicit MeshSimplifier(const Mesh& mesh);
+
+	// Collapses edges of the mesh's triangles until at most targetIndexCount indices are left or the next collapse
+	// would move the surface further than maxError (in model units), measured as the weighted mean distance to the
+	// planes the collapsed vertices started on. error is set to the furthest any collapse did.
+	std::vector<uint32_t> simplify(uint targetIndexCount, float maxError, float& error) const;
+
+	// Half the diagonal of the mesh's bounds
+	float getRadius() const { return radius; }
+
+private:
+
+	enum class VertexKind : uchar
+	{
+		Manifold,
+		Border,
+		Seam,
+		Locked
+	};
+
+	// Symmetric 4x4 matrix of the weighted squared distances to planes, summed, and the sum of the weights.
+	// evaluate divides one by the other, so it's a squared distance in model units whatever the weights are.
+	struct Quadric
+	{
+		double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+		double yy = 0.0, yz = 0.0, yw = 0.0;
+		double zz = 0.0, zw = 0.0;
+		double ww = 0.0;
+		double weight = 0.0;
+
+		static Quadric fromPlane(double a, double b, double c, double d, double weight);
+		Quadric& operator+=(const Quadric& other);
+		double evaluate(const V3& point) const;
+	};
+
+	struct Collapse
+	{
+		uint32_t source = 0u;
+		uint32_t target = 0u;
+		float cost = 0.0f; // what collapses are ordered by
+		float error = 0.0f; // how far the surface moves, squared
+	};
+
+	bool canCollapse(uint32_t source, uint32_t target, const std::unordered_set<uint64>& halfEdges) const;
+	Collapse getCollapse(uint32_t source, uint32_t target, const std::vector<Quadric>& quadrics) const;
+	bool flipsTriangle(uint32_t source, uint32_t target, std::span<const uint32_t> indices, std::span<const uint> adjacencyOffsets, std::span<const uint> adjacency) const;
+
+	const Mesh& mesh;
+	// every vertex points at the first one with the same position, and on to the next one in a ring of them
+	std::vector<uint32_t> positionRemap;
+	std::vector<uint32_t> siblings;
+	std::vector<VertexKind> kinds;
+	// triangle and edge planes around every position, before any collapse
+	std::vector<Quadric> quadrics;
+	float radius = 0.0f;
+	// squared model units one unit of skin weight difference costs
+	float skinWeightCost = 0.0f;
+};
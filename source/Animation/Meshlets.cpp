@@ -0,0 +1,338 @@
+#include "Meshlets.h"
+#include "Mesh.h"
+#include "Engine/Log.h"
+
+// a normal cone whose furthest normal is at a lower cosine from the axis is too wide to ever cull
+constexpr float minConeSpread = 0.1f;
+// how many new vertices a triangle facing away from the meshlet's normals at a right angle is worth
+constexpr float coneWeight = 0.5f;
+
+namespace
+{
+	V4 getNormal(const V3& p0, const V3& p1, const V3& p2)
+	{
+		return V4{ p1.x - p0.x, p1.y - p0.y, p1.z - p0.z }.cross(V4{ p2.x - p0.x, p2.y - p0.y, p2.z - p0.z });
+	}
+}
+
+void Meshlets::build(const Mesh& mesh)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	clear();
+
+	const std::vector<Mesh::Vertex>& meshVertices = mesh.getVertices();
+	const std::vector<uint32_t>& indices = mesh.getIndices();
+	constexpr uchar notInMeshlet = 0xffu;
+	static_assert(maxVertices < notInMeshlet && maxTriangles <= 0xffu);
+	// where every mesh vertex is in the meshlet being built
+	std::vector<uchar> localIndices(meshVertices.size(), notInMeshlet);
+
+	auto finishMeshlet = [&]()
+	{
+		Meshlet& meshlet = meshlets.back();
+		Bounds& meshletBounds = bounds.emplace_back();
+
+		V3 min = meshVertices[vertices[meshlet.vertexOffset]].pos;
+		V3 max = min;
+		for (uint i = 0; i < meshlet.numVertices; ++i)
+		{
+			uint32_t vertex = vertices[meshlet.vertexOffset + i];
+			const V3& position = meshVertices[vertex].pos;
+			min = { std::min(min.x, position.x), std::min(min.y, position.y), std::min(min.z, position.z) };
+			max = { std::max(max.x, position.x), std::max(max.y, position.y), std::max(max.z, position.z) };
+			localIndices[vertex] = notInMeshlet;
+		}
+		meshletBounds.center = (min + max) * 0.5f;
+		for (uint i = 0; i < meshlet.numVertices; ++i)
+			meshletBounds.radius = std::max(meshletBounds.radius, (meshVertices[vertices[meshlet.vertexOffset + i]].pos - meshletBounds.center).length());
+
+		V4 normals[maxTriangles];
+		uint numNormals = 0u;
+		V4 axis = V4{ 0.0f, 0.0f, 0.0f };
+		for (uint triangle = 0; triangle < meshlet.numTriangles; ++triangle)
+		{
+			const uchar* corners = triangles.data() + meshlet.firstIndex + triangle * 3u;
+			const uint32_t* meshletVertices = vertices.data() + meshlet.vertexOffset;
+			V4 normal = getNormal(meshVertices[meshletVertices[corners[0]]].pos, meshVertices[meshletVertices[corners[1]]].pos, meshVertices[meshletVertices[corners[2]]].pos);
+			float length = normal.length();
+			if (length == 0.0f)
+				continue;
+			normals[numNormals++] = normal * (1.0f / length);
+			axis += normals[numNormals - 1u];
+		}
+		float axisLength = axis.length();
+		if (axisLength == 0.0f)
+			return;
+		axis = axis * (1.0f / axisLength);
+		float minDot = 1.0f;
+		for (uint i = 0; i < numNormals; ++i)
+			minDot = std::min(minDot, axis.dot(normals[i]));
+		meshletBounds.coneAxis = { axis.x, axis.y, axis.z };
+		// the triangles face away once the view direction is within 90 degrees minus the cone's spread of the axis
+		meshletBounds.coneCutoff = minDot > minConeSpread ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+	};
+
+	// the triangles around every vertex and which way they face, counter-clockwise triangles face their normals
+	uint numTriangles = (uint)indices.size() / 3u;
+	std::vector<uint> adjacencyOffsets(meshVertices.size() + 1u, 0u);
+	for (uint32_t index : indices)
+		++adjacencyOffsets[index + 1u];
+	for (size_t vertex = 0; vertex < meshVertices.size(); ++vertex)
+		adjacencyOffsets[vertex + 1u] += adjacencyOffsets[vertex];
+	std::vector<uint> adjacency(indices.size());
+	{
+		std::vector<uint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint i = 0; i < indices.size(); ++i)
+			adjacency[fill[indices[i]]++] = i / 3u;
+	}
+	std::vector<V4> triangleNormals(numTriangles);
+	for (uint triangle = 0; triangle < numTriangles; ++triangle)
+	{
+		const uint32_t* corners = indices.data() + triangle * 3u;
+		triangleNormals[triangle] = getNormal(meshVertices[corners[0]].pos, meshVertices[corners[1]].pos, meshVertices[corners[2]].pos);
+		float length = triangleNormals[triangle].length();
+		if (length > 0.0f)
+			triangleNormals[triangle] = triangleNormals[triangle] * (1.0f / length);
+	}
+
+	// Grown a triangle at a time from the ones around the meshlet's vertices, the one that adds the fewest vertices
+	// and bends the meshlet's normals the least first. Without any the next triangle in index order starts over,
+	// vertex cache order keeps those close as well.
+	std::vector<bool> isAdded(numTriangles, false);
+	uint nextSeed = 0u;
+	V4 normalSum = V4{ 0.0f, 0.0f, 0.0f };
+	for (uint numAdded = 0; numAdded < numTriangles; ++numAdded)
+	{
+		uint best = ~0u;
+		uint bestNewVertices = 0u;
+		if (!meshlets.empty())
+		{
+			const Meshlet& meshlet = meshlets.back();
+			float normalSumLength = normalSum.length();
+			V4 axis = normalSumLength > 0.0f ? normalSum * (1.0f / normalSumLength) : normalSum;
+			float bestScore = std::numeric_limits<float>::max();
+			for (uint i = 0; i < meshlet.numVertices; ++i)
+			{
+				uint32_t vertex = vertices[meshlet.vertexOffset + i];
+				for (uint j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1u]; ++j)
+				{
+					uint triangle = adjacency[j];
+					if (isAdded[triangle])
+						continue;
+					uint numNewVertices = 0u;
+					for (uint corner = 0; corner < 3u; ++corner)
+						numNewVertices += localIndices[indices[triangle * 3u + corner]] == notInMeshlet;
+					float score = numNewVertices + (1.0f - axis.dot(triangleNormals[triangle])) * coneWeight;
+					if (score < bestScore)
+					{
+						bestScore = score;
+						best = triangle;
+						bestNewVertices = numNewVertices;
+					}
+				}
+			}
+		}
+		if (best == ~0u)
+		{
+			while (isAdded[nextSeed])
+				++nextSeed;
+			best = nextSeed;
+			bestNewVertices = 0u;
+			for (uint corner = 0; corner < 3u; ++corner)
+				bestNewVertices += localIndices[indices[best * 3u + corner]] == notInMeshlet;
+		}
+
+		if (meshlets.empty() || meshlets.back().numVertices + bestNewVertices > maxVertices || meshlets.back().numTriangles == maxTriangles)
+		{
+			if (!meshlets.empty())
+				finishMeshlet();
+			meshlets.push_back({ (uint32_t)triangles.size(), (uint32_t)vertices.size(), 0u, 0u });
+			normalSum = V4{ 0.0f, 0.0f, 0.0f };
+		}
+
+		Meshlet& meshlet = meshlets.back();
+		for (uint corner = 0; corner < 3u; ++corner)
+		{
+			uint32_t vertex = indices[best * 3u + corner];
+			if (localIndices[vertex] == notInMeshlet)
+			{
+				localIndices[vertex] = meshlet.numVertices++;
+				vertices.push_back(vertex);
+			}
+			triangles.push_back(localIndices[vertex]);
+		}
+		++meshlet.numTriangles;
+		isAdded[best] = true;
+		normalSum += triangleNormals[best];
+	}
+	if (!meshlets.empty())
+		finishMeshlet();
+
+	// growing by fewest new vertices hops around the meshlet in an order the vertex cache doesn't like, Tipsify puts
+	// each meshlet's triangles back in cache order, the meshlets and their bounds stay the same. Vertices on the seams
+	// are still missed once per meshlet they're in, which is why Model keeps the mesh's own order for unculled draws:
+	// the bunny goes from ACMR 0.71 for the whole mesh to 0.82 in meshlet order sorted for overdraw, 0.88 without
+	// this pass
+	std::vector<uint32_t> meshletIndices;
+	for (const Meshlet& meshlet : meshlets)
+	{
+		uchar* meshletTriangles = triangles.data() + meshlet.firstIndex;
+		meshletIndices.assign(meshletTriangles, meshletTriangles + meshlet.numTriangles * 3u);
+		Mesh::optimizeVertexCache(meshletIndices, meshlet.numVertices);
+		std::copy(meshletIndices.begin(), meshletIndices.end(), meshletTriangles);
+	}
+
+	// the same overdraw order as Mesh::optimize gives its clusters, meshlets facing out of the mesh first
+	V3 meshCenter = V3::zero();
+	for (uint i = 0; i < meshlets.size(); ++i)
+		meshCenter = meshCenter + bounds[i].center * (float)meshlets[i].numTriangles;
+	meshCenter = meshCenter * (1.0f / std::max(numTriangles, 1u));
+	std::vector<uint> order(meshlets.size());
+	std::vector<float> outwardness(meshlets.size());
+	for (uint i = 0; i < meshlets.size(); ++i)
+	{
+		order[i] = i;
+		outwardness[i] = (bounds[i].center - meshCenter).dot(bounds[i].coneAxis);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint a, uint b) { return outwardness[a] > outwardness[b]; });
+	std::vector<Meshlet> sortedMeshlets;
+	std::vector<Bounds> sortedBounds;
+	std::vector<uint32_t> sortedVertices;
+	std::vector<uchar> sortedTriangles;
+	sortedMeshlets.reserve(meshlets.size());
+	sortedBounds.reserve(bounds.size());
+	sortedVertices.reserve(vertices.size());
+	sortedTriangles.reserve(triangles.size());
+	for (uint i : order)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		sortedMeshlets.push_back({ (uint32_t)sortedTriangles.size(), (uint32_t)sortedVertices.size(), meshlet.numVertices, meshlet.numTriangles });
+		sortedBounds.push_back(bounds[i]);
+		sortedVertices.insert(sortedVertices.end(), vertices.begin() + meshlet.vertexOffset, vertices.begin() + meshlet.vertexOffset + meshlet.numVertices);
+		sortedTriangles.insert(sortedTriangles.end(), triangles.begin() + meshlet.firstIndex, triangles.begin() + meshlet.firstIndex + meshlet.numTriangles * 3u);
+	}
+	meshlets = std::move(sortedMeshlets);
+	bounds = std::move(sortedBounds);
+	vertices = std::move(sortedVertices);
+	triangles = std::move(sortedTriangles);
+
+	uint numConeCullable = 0u;
+	for (const Bounds& meshletBounds : bounds)
+		numConeCullable += meshletBounds.coneCutoff < 1.0f;
+	float buildMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	logLine(x, Verbose, "Built {} meshlets of {} triangles in {:.2f} ms, {:.1f} vertices and {:.1f} triangles per meshlet, {} with a normal cone",
+		meshlets.size(), indices.size() / 3u, buildMs, (float)vertices.size() / std::max<size_t>(meshlets.size(), 1u),
+		indices.size() / 3.0f / std::max<size_t>(meshlets.size(), 1u), numConeCullable);
+}
+
+void Meshlets::writeIndices(uint32_t* indices) const
+{
+	for (const Meshlet& meshlet : meshlets)
+	{
+		for (uint i = 0; i < meshlet.numTriangles * 3u; ++i)
+			indices[meshlet.firstIndex + i] = vertices[meshlet.vertexOffset + triangles[meshlet.firstIndex + i]];
+	}
+}
+
+void Meshlets::clear()
+{
+	meshlets.clear();
+	bounds.clear();
+	vertices.clear();
+	triangles.clear();
+}
+
+void Meshlets::cull(const V4& viewPosition, std::span<const V4> frustumPlanes, std::vector<IndexRange>& ranges, CullStats& stats) const
+{
+	// planes scaled to unit normals, so they give distances to compare radii against
+	std::array<V4, 6> planes;
+	assert(frustumPlanes.size() <= planes.size());
+	for (size_t i = 0; i < frustumPlanes.size(); ++i)
+	{
+		const V4& plane = frustumPlanes[i];
+		float length = plane.xyz().length();
+		planes[i] = length > 0.0f ? plane * (1.0f / length) : V4{ 0.0f, 0.0f, 0.0f, 1.0f };
+	}
+
+	size_t firstRange = ranges.size();
+	for (size_t i = 0; i < meshlets.size(); ++i)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		const Bounds& meshletBounds = bounds[i];
+		const V3& center = meshletBounds.center;
+		++stats.numMeshlets;
+		stats.numTriangles += meshlet.numTriangles;
+
+		bool isOutside = false;
+		for (size_t plane = 0; plane < frustumPlanes.size() && !isOutside; ++plane)
+			isOutside = planes[plane].x * center.x + planes[plane].y * center.y + planes[plane].z * center.z + planes[plane].w < -meshletBounds.radius;
+		if (isOutside)
+		{
+			++stats.numFrustumCulledMeshlets;
+			stats.numCulledTriangles += meshlet.numTriangles;
+			continue;
+		}
+
+		V3 toCenter = { center.x - viewPosition.x, center.y - viewPosition.y, center.z - viewPosition.z };
+		if (toCenter.dot(meshletBounds.coneAxis) >= meshletBounds.coneCutoff * toCenter.length() + meshletBounds.radius)
+		{
+			++stats.numConeCulledMeshlets;
+			stats.numCulledTriangles += meshlet.numTriangles;
+			continue;
+		}
+
+		uint32_t numIndices = meshlet.numTriangles * 3u;
+		if (ranges.size() > firstRange && ranges.back().firstIndex + ranges.back().numIndices == meshlet.firstIndex)
+			ranges.back().numIndices += numIndices;
+		else
+			ranges.push_back({ meshlet.firstIndex, numIndices });
+	}
+}
+
+void testMeshletCulling()
+{
+	std::vector<Mesh> meshes = Mesh::loadobj("models/stanford_bunny.obj");
+	assert(!meshes.empty());
+	const Mesh& mesh = meshes.front();
+	Meshlets meshlets;
+	meshlets.build(mesh);
+
+	// from in front of the bunny, with no frustum planes only the normal cones cull
+	const std::vector<Mesh::Vertex>& vertices = mesh.getVertices();
+	V3 min = vertices.front().pos;
+	V3 max = min;
+	for (const Mesh::Vertex& vertex : vertices)
+	{
+		min = { std::min(min.x, vertex.pos.x), std::min(min.y, vertex.pos.y), std::min(min.z, vertex.pos.z) };
+		max = { std::max(max.x, vertex.pos.x), std::max(max.y, vertex.pos.y), std::max(max.z, vertex.pos.z) };
+	}
+	V3 center = (min + max) * 0.5f;
+	V4 viewPosition = { center.x, center.y, center.z + (max - min).length() * 2.0f };
+	std::vector<Meshlets::IndexRange> ranges;
+	Meshlets::CullStats stats;
+	meshlets.cull(viewPosition, {}, ranges, stats);
+
+	uint numDrawnTriangles = 0u;
+	std::vector<bool> isDrawn(meshlets.getNumIndices() / 3u, false);
+	for (const Meshlets::IndexRange& range : ranges)
+	{
+		numDrawnTriangles += range.numIndices / 3u;
+		for (uint32_t i = range.firstIndex; i < range.firstIndex + range.numIndices; i += 3u)
+			isDrawn[i / 3u] = true;
+	}
+	assert(numDrawnTriangles + stats.numCulledTriangles == mesh.getIndices().size() / 3u);
+	assert(stats.numCulledTriangles > 0u);
+
+	std::vector<uint32_t> indices(meshlets.getNumIndices());
+	meshlets.writeIndices(indices.data());
+	for (uint triangle = 0; triangle < isDrawn.size(); ++triangle)
+	{
+		if (isDrawn[triangle])
+			continue;
+		const V3& p0 = vertices[indices[triangle * 3u]].pos;
+		V4 normal = getNormal(p0, vertices[indices[triangle * 3u + 1u]].pos, vertices[indices[triangle * 3u + 2u]].pos);
+		V4 toView = { viewPosition.x - p0.x, viewPosition.y - p0.y, viewPosition.z - p0.z };
+		assert(normal.dot(toView) <= 1e-6f * normal.length() * toView.length());
+	}
+	logLine(x, Verbose, "Meshlet culling test: {} of {} triangles culled", stats.numCulledTriangles, isDrawn.size());
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include <span>
+
+class Mesh;
+
+// A mesh's triangles split into small clusters that can be culled on their own. Every meshlet has its vertices and
+// triangles in a local form, at most maxVertices vertices and maxTriangles triangles indexing into them, the layout
+// mesh shaders want. Written out with writeIndices the meshlets are runs of an index buffer in meshlet order, so a
+// culled mesh is drawn as the ranges of it that are left, merged where they touch.
+class Meshlets
+{
+public:
+
+	static constexpr uint maxVertices = 64u;
+	static constexpr uint maxTriangles = 124u;
+
+	struct Meshlet
+	{
+		uint32_t firstIndex = 0u; // where writeIndices puts its triangles, also where they start in getTriangles()
+		uint32_t vertexOffset = 0u; // in getVertices()
+		uchar numVertices = 0u;
+		uchar numTriangles = 0u;
+	};
+
+	// What the culler reads, kept apart from the rest so a pass over them stays in few cache lines
+	struct Bounds
+	{
+		V3 center = V3::zero();
+		float radius = 0.0f;
+		// The triangles face away from any view position for which dot(center - view, coneAxis) is at least
+		// coneCutoff * |center - view| + radius, a cutoff of 1 never culls
+		V3 coneAxis = V3::zero();
+		float coneCutoff = 1.0f;
+	};
+
+	struct IndexRange
+	{
+		uint32_t firstIndex = 0u;
+		uint32_t numIndices = 0u;
+	};
+
+	struct CullStats
+	{
+		uint numMeshlets = 0u;
+		uint numTriangles = 0u;
+		uint numFrustumCulledMeshlets = 0u;
+		uint numConeCulledMeshlets = 0u;
+		uint numCulledTriangles = 0u;
+	};
+
+	// Grows meshlets over the mesh's triangles, see Meshlets.cpp
+	void build(const Mesh& mesh);
+	void clear();
+
+	bool isEmpty() const { return meshlets.empty(); }
+	const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+	const std::vector<Bounds>& getBounds() const { return bounds; }
+	// Mesh vertex indices of every meshlet, one after the other
+	const std::vector<uint32_t>& getVertices() const { return vertices; }
+	// Three local vertex indices per triangle, the meshlets' triangles one after the other
+	const std::vector<uchar>& getTriangles() const { return triangles; }
+	uint getNumIndices() const { return (uint)triangles.size(); }
+
+	// The mesh's triangles in meshlet order as mesh vertex indices, getNumIndices of them
+	void writeIndices(uint32_t* indices) const;
+
+	// Appends to ranges the index ranges, counted from where writeIndices started, of the meshlets that can be seen
+	// from viewPosition and aren't fully outside one of frustumPlanes, all in the mesh's space. A plane keeps the side
+	// where dot(plane.xyz, p) + plane.w is positive, it doesn't need to be normalized.
+	void cull(const V4& viewPosition, std::span<const V4> frustumPlanes, std::vector<IndexRange>& ranges, CullStats& stats) const;
+
+private:
+
+	std::vector<Meshlet> meshlets;
+	std::vector<Bounds> bounds;
+	std::vector<uint32_t> vertices;
+	std::vector<uchar> triangles;
+};
+
+void testMeshletCulling();
@@ -0,0 +1,317 @@
+#include "Pose.h"
+#include "Skeleton.h"
+
+void Pose::resize(uint numBones_)
+{
+	numBones = numBones_;
+	stride = getStride(numBones);
+	if (!external.empty())
+		assert(external.size() >= getSize(numBones));
+	else if (data.size() < getSize(numBones))
+		data.resize(getSize(numBones));
+
+	// padding bones stay identity, so whole-stride loops never see garbage
+	for (uint bone = numBones; bone < stride; ++bone)
+		setBone(bone, identityBone());
+}
+
+void Pose::setStorage(std::span<float> storage)
+{
+	external = storage;
+	numBones = 0u;
+	stride = 0u;
+}
+
+V4 Pose::getPosition(uint bone) const
+{
+	return { getChannel(PositionX)[bone], getChannel(PositionY)[bone], getChannel(PositionZ)[bone] };
+}
+
+Quat Pose::getRotation(uint bone) const
+{
+	return { getChannel(RotationX)[bone], getChannel(RotationY)[bone], getChannel(RotationZ)[bone], getChannel(RotationW)[bone] };
+}
+
+V4 Pose::getScale(uint bone) const
+{
+	return { getChannel(ScaleX)[bone], getChannel(ScaleY)[bone], getChannel(ScaleZ)[bone] };
+}
+
+void Pose::writeBone(float* data, uint stride, uint bone, const SkelAnimation::Bone& value)
+{
+	float channels[NumChannels] = { value.position.x, value.position.y, value.position.z,
+		value.rotation.x, value.rotation.y, value.rotation.z, value.rotation.w,
+		value.size.x, value.size.y, value.size.z };
+	for (uint channel = 0; channel < NumChannels; ++channel)
+		data[channel * stride + bone] = channels[channel];
+}
+
+void Pose::setBone(uint bone, const SkelAnimation::Bone& value)
+{
+	writeBone(getData(), stride, bone, value);
+}
+
+void Pose::setFrame(const SkelAnimation::Frame& frame)
+{
+	resize((uint)frame.bones.size());
+	for (uint bone = 0; bone < numBones; ++bone)
+		setBone(bone, frame.bones[bone]);
+}
+
+void Pose::blend(const Pose& a, const Pose& b, float alpha)
+{
+	assert(a.numBones == b.numBones);
+	resize(a.numBones);
+	blendPoseChannels(a.getData(), b.getData(), alpha, getData(), stride);
+}
+
+void Pose::convertToRootSpace(const Skeleton& skeleton, uint numLevels)
+{
+	assert(skeleton.getNumBones() == numBones);
+
+	// Level by level, every bone of a level only reads parents of earlier levels. A batch of a level is gathered
+	// into contiguous arrays, composed in straight loops the compiler vectorizes and scattered back.
+	constexpr uint batchSize = 16u;
+	float* channels[NumChannels];
+	for (uint channel = 0; channel < NumChannels; ++channel)
+		channels[channel] = getChannel((Channel)channel);
+
+	for (uint level = 1; level < std::min(skeleton.getNumLevels(), numLevels); ++level)
+	{
+		std::span<const uint> levelBones = skeleton.getLevel(level);
+		for (uint begin = 0; begin < levelBones.size(); begin += batchSize)
+		{
+			uint count = std::min(batchSize, (uint)levelBones.size() - begin);
+			const uint* bones = levelBones.data() + begin;
+
+			float parent[NumChannels][batchSize];
+			float local[NumChannels][batchSize];
+			for (uint channel = 0; channel < NumChannels; ++channel)
+			{
+				for (uint i = 0; i < count; ++i)
+				{
+					parent[channel][i] = channels[channel][skeleton.getParent(bones[i])];
+					local[channel][i] = channels[channel][bones[i]];
+				}
+			}
+
+			float out[NumChannels][batchSize];
+			for (uint i = 0; i < count; ++i)
+			{
+				float qx = parent[RotationX][i], qy = parent[RotationY][i], qz = parent[RotationZ][i], qw = parent[RotationW][i];
+
+				// the parent's scale applies to the child's offset before the parent's rotation
+				float vx = local[PositionX][i] * parent[ScaleX][i];
+				float vy = local[PositionY][i] * parent[ScaleY][i];
+				float vz = local[PositionZ][i] * parent[ScaleZ][i];
+
+				// v + 2w(q x v) + 2q x (q x v), what Quat::rotate does for unit quaternions
+				float tx = 2.0f * (qy * vz - qz * vy);
+				float ty = 2.0f * (qz * vx - qx * vz);
+				float tz = 2.0f * (qx * vy - qy * vx);
+				out[PositionX][i] = parent[PositionX][i] + vx + qw * tx + (qy * tz - qz * ty);
+				out[PositionY][i] = parent[PositionY][i] + vy + qw * ty + (qz * tx - qx * tz);
+				out[PositionZ][i] = parent[PositionZ][i] + vz + qw * tz + (qx * ty - qy * tx);
+
+				// local * parent, the same product as Quat::operator*
+				float lx = local[RotationX][i], ly = local[RotationY][i], lz = local[RotationZ][i], lw = local[RotationW][i];
+				out[RotationX][i] = lw * qx + lx * qw - ly * qz + lz * qy;
+				out[RotationY][i] = lw * qy + lx * qz + ly * qw - lz * qx;
+				out[RotationZ][i] = lw * qz - lx * qy + ly * qx + lz * qw;
+				out[RotationW][i] = lw * qw - lx * qx - ly * qy - lz * qz;
+
+				out[ScaleX][i] = local[ScaleX][i] * parent[ScaleX][i];
+				out[ScaleY][i] = local[ScaleY][i] * parent[ScaleY][i];
+				out[ScaleZ][i] = local[ScaleZ][i] * parent[ScaleZ][i];
+			}
+
+			for (uint channel = 0; channel < NumChannels; ++channel)
+			{
+				for (uint i = 0; i < count; ++i)
+					channels[channel][bones[i]] = out[channel][i];
+			}
+		}
+	}
+}
+
+void Pose::writeSkinningPalette(const SkelAnimation::Frame& bindFrame, float* palette, const uint* boneRemap) const
+{
+	assert(bindFrame.bones.size() == numBones);
+	for (uint bone = 0; bone < numBones; ++bone)
+	{
+		if (boneRemap && boneRemap[bone] != bone)
+		{
+			assert(boneRemap[bone] < bone);
+			memcpy(palette + bone * paletteFloatsPerBone, palette + boneRemap[bone] * paletteFloatsPerBone, paletteFloatsPerBone * sizeof(float));
+			continue;
+		}
+
+		// undoing the bind rotation and applying the posed one is a single rotation by their product
+		const SkelAnimation::Bone& bind = bindFrame.bones[bone];
+		Quat q = (bind.rotation.inversed() * getRotation(bone)).normalize();
+
+		float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+		float rows[3][3] =
+		{
+			{ 1.0f - 2.0f * (yy + zz), 2.0f * (xy - wz), 2.0f * (xz + wy) },
+			{ 2.0f * (xy + wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz - wx) },
+			{ 2.0f * (xz - wy), 2.0f * (yz + wx), 1.0f - 2.0f * (xx + yy) },
+		};
+
+		V4 position = getPosition(bone);
+		float* out = palette + bone * paletteFloatsPerBone;
+		for (uint row = 0; row < 3; ++row)
+		{
+			out[row * 4 + 0] = rows[row][0];
+			out[row * 4 + 1] = rows[row][1];
+			out[row * 4 + 2] = rows[row][2];
+			out[row * 4 + 3] = position[row] - (rows[row][0] * bind.position.x + rows[row][1] * bind.position.y + rows[row][2] * bind.position.z);
+		}
+	}
+}
+
+// Rotations are blended in blocks of bones into local arrays and copied out after. out may alias the inputs,
+// checking every channel pointer against every other at runtime is more than compilers do, so they'd give up on
+// vectorizing. Locals can't alias anything.
+constexpr uint rotationBlockSize = 16u;
+
+// Lerp and nlerp shared by the blends, alpha(i) is the weight of b for bone i
+template<typename Alpha>
+static void blendChannels(const float* a, const float* b, Alpha alpha, float* out, uint stride)
+{
+	for (uint channel : { Pose::PositionX, Pose::PositionY, Pose::PositionZ, Pose::ScaleX, Pose::ScaleY, Pose::ScaleZ })
+	{
+		const float* ca = a + channel * stride;
+		const float* cb = b + channel * stride;
+		float* co = out + channel * stride;
+		for (uint i = 0; i < stride; ++i)
+			co[i] = ca[i] + (cb[i] - ca[i]) * alpha(i);
+	}
+
+	const float* ax = a + Pose::RotationX * stride;
+	const float* ay = a + Pose::RotationY * stride;
+	const float* az = a + Pose::RotationZ * stride;
+	const float* aw = a + Pose::RotationW * stride;
+	const float* bx = b + Pose::RotationX * stride;
+	const float* by = b + Pose::RotationY * stride;
+	const float* bz = b + Pose::RotationZ * stride;
+	const float* bw = b + Pose::RotationW * stride;
+	float* ox = out + Pose::RotationX * stride;
+	float* oy = out + Pose::RotationY * stride;
+	float* oz = out + Pose::RotationZ * stride;
+	float* ow = out + Pose::RotationW * stride;
+	for (uint begin = 0; begin < stride; begin += rotationBlockSize)
+	{
+		uint count = std::min(rotationBlockSize, stride - begin);
+		float rx[rotationBlockSize], ry[rotationBlockSize], rz[rotationBlockSize], rw[rotationBlockSize];
+		for (uint j = 0; j < count; ++j)
+		{
+			uint i = begin + j;
+			// q and -q are the same rotation, blend towards whichever is closer
+			float dot = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i];
+			float wb = copysignf(alpha(i), dot);
+			float wa = 1.0f - alpha(i);
+			float x = ax[i] * wa + bx[i] * wb;
+			float y = ay[i] * wa + by[i] * wb;
+			float z = az[i] * wa + bz[i] * wb;
+			float w = aw[i] * wa + bw[i] * wb;
+			// the epsilon instead of a max, which compilers won't vectorize for its NaN handling
+			float invLength = 1.0f / sqrtf(x * x + y * y + z * z + w * w + 1e-12f);
+			rx[j] = x * invLength;
+			ry[j] = y * invLength;
+			rz[j] = z * invLength;
+			rw[j] = w * invLength;
+		}
+		std::copy_n(rx, count, ox + begin);
+		std::copy_n(ry, count, oy + begin);
+		std::copy_n(rz, count, oz + begin);
+		std::copy_n(rw, count, ow + begin);
+	}
+}
+
+void blendPoseChannels(const float* a, const float* b, float alpha, float* out, uint stride)
+{
+	blendChannels(a, b, [alpha](uint) { return alpha; }, out, stride);
+}
+
+void blendPoseChannels(const float* a, const float* b, const float* boneAlphas, float* out, uint stride)
+{
+	blendChannels(a, b, [boneAlphas](uint bone) { return boneAlphas[bone]; }, out, stride);
+}
+
+void addPoseChannels(const float* base, const float* additive, const float* reference, const float* boneWeights, float* out, uint stride)
+{
+	for (uint channel = Pose::PositionX; channel <= Pose::PositionZ; ++channel)
+	{
+		const float* cb = base + channel * stride;
+		const float* ca = additive + channel * stride;
+		const float* cr = reference + channel * stride;
+		float* co = out + channel * stride;
+		for (uint i = 0; i < stride; ++i)
+			co[i] = cb[i] + (ca[i] - cr[i]) * boneWeights[i];
+	}
+	for (uint channel = Pose::ScaleX; channel <= Pose::ScaleZ; ++channel)
+	{
+		const float* cb = base + channel * stride;
+		const float* ca = additive + channel * stride;
+		const float* cr = reference + channel * stride;
+		float* co = out + channel * stride;
+		for (uint i = 0; i < stride; ++i)
+			co[i] = cb[i] * (1.0f + (ca[i] / cr[i] - 1.0f) * boneWeights[i]);
+	}
+
+	const float* bx = base + Pose::RotationX * stride;
+	const float* by = base + Pose::RotationY * stride;
+	const float* bz = base + Pose::RotationZ * stride;
+	const float* bw = base + Pose::RotationW * stride;
+	const float* ax = additive + Pose::RotationX * stride;
+	const float* ay = additive + Pose::RotationY * stride;
+	const float* az = additive + Pose::RotationZ * stride;
+	const float* aw = additive + Pose::RotationW * stride;
+	const float* rx = reference + Pose::RotationX * stride;
+	const float* ry = reference + Pose::RotationY * stride;
+	const float* rz = reference + Pose::RotationZ * stride;
+	const float* rw = reference + Pose::RotationW * stride;
+	float* ox = out + Pose::RotationX * stride;
+	float* oy = out + Pose::RotationY * stride;
+	float* oz = out + Pose::RotationZ * stride;
+	float* ow = out + Pose::RotationW * stride;
+	for (uint begin = 0; begin < stride; begin += rotationBlockSize)
+	{
+		uint count = std::min(rotationBlockSize, stride - begin);
+		float qx[rotationBlockSize], qy[rotationBlockSize], qz[rotationBlockSize], qw[rotationBlockSize];
+		for (uint j = 0; j < count; ++j)
+		{
+			uint i = begin + j;
+			// the additive's rotation relative to the reference in the bone's own frame, conjugate(reference) * additive
+			float dx = rw[i] * ax[i] - rx[i] * aw[i] - ry[i] * az[i] + rz[i] * ay[i];
+			float dy = rw[i] * ay[i] + rx[i] * az[i] - ry[i] * aw[i] - rz[i] * ax[i];
+			float dz = rw[i] * az[i] - rx[i] * ay[i] + ry[i] * ax[i] - rz[i] * aw[i];
+			float dw = rw[i] * aw[i] + rx[i] * ax[i] + ry[i] * ay[i] + rz[i] * az[i];
+
+			// nlerp from identity by the weight, along the shorter arc
+			float weight = copysignf(boneWeights[i], dw);
+			dx *= weight;
+			dy *= weight;
+			dz *= weight;
+			dw = 1.0f - boneWeights[i] + dw * weight;
+
+			// base * delta
+			float x = bw[i] * dx + bx[i] * dw + by[i] * dz - bz[i] * dy;
+			float y = bw[i] * dy - bx[i] * dz + by[i] * dw + bz[i] * dx;
+			float z = bw[i] * dz + bx[i] * dy - by[i] * dx + bz[i] * dw;
+			float w = bw[i] * dw - bx[i] * dx - by[i] * dy - bz[i] * dz;
+			float invLength = 1.0f / sqrtf(x * x + y * y + z * z + w * w + 1e-12f);
+			qx[j] = x * invLength;
+			qy[j] = y * invLength;
+			qz[j] = z * invLength;
+			qw[j] = w * invLength;
+		}
+		std::copy_n(qx, count, ox + begin);
+		std::copy_n(qy, count, oy + begin);
+		std::copy_n(qz, count, oz + begin);
+		std::copy_n(qw, count, ow + begin);
+	}
+}
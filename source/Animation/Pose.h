@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include "SkelAnimation.h"
+#include <span>
+
+struct Skeleton;
+
+// One skeleton pose in structure-of-arrays form: each of the ten bone channels (position xyz, rotation xyzw, scale xyz)
+// is a contiguous float array over all bones, padded to a multiple of four bones, so sampling and blending
+// are straight loops over the whole skeleton. Channels use the same order as IQM frame data.
+class Pose
+{
+public:
+
+	enum Channel : uint
+	{
+		PositionX, PositionY, PositionZ,
+		RotationX, RotationY, RotationZ, RotationW,
+		ScaleX, ScaleY, ScaleZ,
+		NumChannels
+	};
+
+	static constexpr uint getStride(uint numBones) { return (numBones + 3u) & ~3u; }
+	// Writes one bone into channel data laid out like getData(), for buffers that aren't a Pose, e.g. a clip's frames
+	static void writeBone(float* data, uint stride, uint bone, const SkelAnimation::Bone& value);
+	static SkelAnimation::Bone identityBone() { return { V4::zero(), Quat::identity(), V4{ 1.0f, 1.0f, 1.0f } }; }
+
+	static constexpr size_t getSize(uint numBones) { return NumChannels * getStride(numBones); }
+
+	// Only allocates when the pose grows, resizing back and forth between skeletons of similar size is free
+	void resize(uint numBones);
+	uint getNumBones() const { return numBones; }
+	uint getStride() const { return stride; }
+
+	// Makes the pose live in memory owned by someone else, like a slot of a pose arena. It has to hold
+	// getSize() floats for every size the pose is resized to. An empty span goes back to the pose's own storage.
+	// Either way the pose is empty until the next resize.
+	void setStorage(std::span<float> storage);
+
+	float* getChannel(Channel channel) { return getData() + channel * stride; }
+	const float* getChannel(Channel channel) const { return getData() + channel * stride; }
+	// All channels back to back, NumChannels * getStride() floats
+	float* getData() { return external.empty() ? data.data() : external.data(); }
+	const float* getData() const { return external.empty() ? data.data() : external.data(); }
+
+	V4 getPosition(uint bone) const;
+	Quat getRotation(uint bone) const;
+	V4 getScale(uint bone) const;
+	void setBone(uint bone, const SkelAnimation::Bone& value);
+
+	void setFrame(const SkelAnimation::Frame& frame);
+	void blend(const Pose& a, const Pose& b, float alpha);
+
+	// Parent-relative bones to root space, the same composition as SkelAnimation::Frame::convertToRootSpace.
+	// A parent's scale scales its children's offsets and multiplies into their scale.
+	// Only the bones of the skeleton's first numLevels levels are converted.
+	void convertToRootSpace(const Skeleton& skeleton, uint numLevels = (uint)-1);
+
+	// Skinning matrices taking vertices from bindFrame to this pose, both in root space. Every bone gets a 3x4 matrix
+	// as three rows of four floats, rotation in xyz and translation in w, the layout the skinned vertex shaders read.
+	// Scale isn't applied, same as before the palette moved to the CPU. With a boneRemap only the bones mapped to
+	// themselves are computed, every other one copies the entry of the bone it maps to, which has to come before it.
+	static constexpr uint paletteFloatsPerBone = 12u;
+	void writeSkinningPalette(const SkelAnimation::Frame& bindFrame, float* palette, const uint* boneRemap = nullptr) const;
+
+private:
+
+	std::vector<float> data;
+	std::span<float> external;
+	uint numBones = 0u;
+	uint stride = 0u;
+};
+
+// Lerps positions and scales and nlerps rotations (along the shorter arc) of two poses laid out like Pose::getData().
+// out may alias a or b.
+void blendPoseChannels(const float* a, const float* b, float alpha, float* out, uint stride);
+// The same with a weight per bone, boneAlphas holds stride floats
+void blendPoseChannels(const float* a, const float* b, const float* boneAlphas, float* out, uint stride);
+// Layers additive on top of base as its difference to reference: positions add, scales multiply and rotations
+// apply in the bone's own frame, each scaled by the bone's weight. out may alias base.
+void addPoseChannels(const float* base, const float* additive, const float* reference, const float* boneWeights, float* out, uint stride);
@@ -1,130 +1,211 @@
 #include "SkelAnimation.h"
 
 #include "Skeleton.h"
-#include "Importers/Importer_IQM.h"
+#include "Pose.h"
+#include "Mesh.h"
+#include "Importers/IqmFile.h"
 #include "Engine/Log.h"
 
 void SkelAnimation::load(std::string_view filename, Animations& animations)
 {
-	std::vector<SkelAnimation>& result = animations.animations;
-	std::ifstream f(filename.data(), std::ios_base::binary);
-	if (!f)
-		return;
+	load(IqmFile(filename), animations);
+}
 
-	iqmheader header;
-	f.read(reinterpret_cast<char*>(&header), sizeof(header));
+void SkelAnimation::load(const IqmFile& file, Animations& animations)
+{
+	std::vector<SkelAnimation>& result = animations.animations;
+	auto poses = file.getPoses();
+	auto anims = file.getAnims();
 
-	std::vector<uint> boneMasks;
-	struct BoneFloats
+	// Every channel stored in a frame, in file order: which of the bone's ten floats it adds to and its scale.
+	// Missing channels keep the pose's offset.
+	struct FrameChannel
 	{
-		float data[10];
-		float dataScale[10];
+		uint target;
+		float scale;
 	};
-	std::vector<BoneFloats> boneDefaults;
-	if (header.num_poses > 0 && header.ofs_poses > 0)
+	std::vector<FrameChannel> frameChannels;
+	std::vector<float> defaults(poses.size() * 10);
+	for (uint boneIndex = 0; boneIndex < poses.size(); ++boneIndex)
 	{
-		boneMasks.reserve(header.num_poses);
-		boneDefaults.reserve(header.num_poses);
-		f.seekg(header.ofs_poses);
-		for (uint i = 0; i < header.num_poses; ++i)
+		auto& pose = poses[boneIndex];
+		for (uint k = 0; k < 10; ++k)
 		{
-			iqmpose pose;
-			f.read(reinterpret_cast<char*>(&pose), sizeof(pose));
-			boneMasks.push_back(pose.channelmask);
-			BoneFloats floats;
-			memcpy(floats.data, pose.channeloffset, sizeof(pose.channeloffset));
-			memcpy(floats.dataScale, pose.channelscale, sizeof(pose.channelscale));
-			boneDefaults.push_back(floats);
+			defaults[boneIndex * 10 + k] = pose.channeloffset[k];
+			if (pose.channelmask & (1 << k))
+				frameChannels.push_back({ boneIndex * 10 + k, pose.channelscale[k] });
 		}
 	}
 
-	if (header.num_anims > 0 && header.ofs_anims > 0)
+	result.reserve(result.size() + anims.size());
+	std::vector<float> values(defaults.size());
+	for (auto& anim : anims)
 	{
-		result.reserve(header.num_anims);
-		f.seekg(header.ofs_anims);
-		for (uint i = 0; i < header.num_anims; ++i)
+		SkelAnimation skelAnim;
+		skelAnim.name = anim.name;
+		skelAnim.framerate = anim.framerate;
+		skelAnim.frames.resize(anim.num_frames);
+
+		auto animFrames = file.getFrames(anim);
+		for (uint j = 0; j < anim.num_frames; ++j)
 		{
-			iqmanim anim;
-			f.read(reinterpret_cast<char*>(&anim), sizeof(anim));
-			
-			SkelAnimation skelAnim;
-			skelAnim.name = anim.name;
-			skelAnim.framerate = anim.framerate;
-			
-			f.seekg(header.ofs_frames/* + anim.first_frame * frame_size */);
-			for (int j = 0; j < anim.num_frames; ++j)
+			const ushort* data = animFrames.data() + j * frameChannels.size();
+			std::copy(defaults.begin(), defaults.end(), values.begin());
+			for (uint c = 0; c < frameChannels.size(); ++c)
+				values[frameChannels[c].target] += (float)data[c] * frameChannels[c].scale;
+
+			auto& bones = skelAnim.frames[j].bones;
+			bones.reserve(poses.size());
+			for (uint boneIndex = 0; boneIndex < poses.size(); ++boneIndex)
 			{
-				Frame frame;
-				for (int boneIndex = 0; boneIndex < boneMasks.size(); ++boneIndex)
-				{
-					uint mask = boneMasks[boneIndex];
-					int numChannels = std::popcount(mask);
-					ushort data[10];
-					memset(data, 0, sizeof(data));
-					for (int k = 0; k < 10; ++k)
-					{
-						if (mask & (1 << k))
-						{
-							f.read(reinterpret_cast<char*>(&data[k]), sizeof(ushort));
-						}
-					}
-					float dataFloat[10];
-					memset(dataFloat, 0, sizeof(dataFloat));
-					for (int k = 0; k < 10; ++k)
-					{
-						dataFloat[k] = boneDefaults[boneIndex].data[k];
-						if (boneMasks[boneIndex] & (1 << k))
-						{
-							dataFloat[k] += (float)data[k] * boneDefaults[boneIndex].dataScale[k];
-						}
-					}
-					auto& d = dataFloat;
-					frame.bones.emplace_back(V4{ d[0], d[1], d[2] }, Quat{ d[3], d[4], d[5], d[6] }, V4{ d[7], d[8], d[9] });
-				}
-				skelAnim.frames.push_back(std::move(frame));
+				const float* d = &values[boneIndex * 10];
+				bones.emplace_back(V4{ d[0], d[1], d[2] }, Quat{ d[3], d[4], d[5], d[6] }, V4{ d[7], d[8], d[9] });
 			}
-			result.push_back(std::move(skelAnim));
 		}
-	}
-	
-	if (header.num_joints > 0 && header.ofs_joints > 0)
-	{
-		f.seekg(header.ofs_joints);
-		for (uint i = 0; i < header.num_joints; ++i)
+		for (auto& bounds : file.getBounds(anim))
 		{
-			iqmjoint joint;
-			f.read(reinterpret_cast<char*>(&joint), sizeof(joint));
-			animations.initialFrame.bones.emplace_back
-			(
-				V4{joint.translate[0],joint.translate[1],joint.translate[2]},
-				Quat{joint.rotate[0],joint.rotate[1],joint.rotate[2], joint.rotate[3]},
-				V4{joint.scale[0],joint.scale[1],joint.scale[2]}
-			);
+			skelAnim.frameBounds.push_back({ V4{ bounds.bbmin[0], bounds.bbmin[1], bounds.bbmin[2] }, V4{ bounds.bbmax[0], bounds.bbmax[1], bounds.bbmax[2] } });
 		}
+		skelAnim.buildChannels();
+		result.push_back(std::move(skelAnim));
+	}
+
+	for (auto& joint : file.getJoints())
+	{
+		animations.initialFrame.bones.emplace_back
+		(
+			V4{joint.translate[0],joint.translate[1],joint.translate[2]},
+			Quat{joint.rotate[0],joint.rotate[1],joint.rotate[2], joint.rotate[3]},
+			V4{joint.scale[0],joint.scale[1],joint.scale[2]}
+		);
 	}
 }
 
 
 void SkelAnimation::convertToRootSpace(const Skeleton& skeleton)
 {
+	assert(!compressed);
 	for (auto& frame : frames)
 		frame.convertToRootSpace(skeleton);
+	buildChannels();
+}
+
+void SkelAnimation::buildChannels()
+{
+	numFrames = (uint)frames.size();
+	numBones = frames.empty() ? 0u : (uint)frames[0].bones.size();
+	uint stride = Pose::getStride(numBones);
+	channels.assign(frames.size() * Pose::NumChannels * stride, 0.0f);
+	for (size_t frameIndex = 0; frameIndex < frames.size(); ++frameIndex)
+	{
+		float* frameChannels = channels.data() + frameIndex * Pose::NumChannels * stride;
+		for (uint bone = 0; bone < stride; ++bone)
+			Pose::writeBone(frameChannels, stride, bone, bone < numBones ? frames[frameIndex].bones[bone] : Pose::identityBone());
+	}
+}
+
+void SkelAnimation::compress(const CompressedClip::Settings& settings)
+{
+	assert(!compressed);
+	compressedClip.build(channels.data(), numFrames, numBones, settings);
+	compressed = true;
+	std::vector<Frame>().swap(frames);
+	std::vector<float>().swap(channels);
+
+	auto& stats = compressedClip.getStats();
+	logLine(x, Verbose, "Animation {} compressed {} -> {} bytes ({:.1f}x), {} constant and {} animated tracks, {} of {} keys, max error position {} rotation {} scale {}",
+		name, stats.rawSize, stats.compressedSize, stats.getRatio(), stats.numConstantTracks, stats.numAnimatedTracks, stats.numKeys, stats.numRawKeys,
+		stats.maxPositionError, stats.maxRotationError, stats.maxScaleError);
+}
+
+void SkelAnimation::sample(float time, Pose& pose, const uint* boneRemap) const
+{
+	float frameTime = std::max(0.0f, time / 1000.0f * framerate);
+	if (compressed)
+	{
+		compressedClip.sample(frameTime, pose, boneRemap);
+		return;
+	}
+
+	pose.resize(numBones);
+	if (numFrames == 0u)
+		return;
+
+	float frameFloor = floorf(frameTime);
+	uint frame0 = (uint)fmodf(frameFloor, (float)numFrames);
+	uint frame1 = (frame0 + 1u) % numFrames;
+	float alpha = frameTime - frameFloor;
+
+	size_t frameSize = Pose::NumChannels * pose.getStride();
+	blendPoseChannels(channels.data() + frame0 * frameSize, channels.data() + frame1 * frameSize, alpha, pose.getData(), pose.getStride());
 }
 		
-void SkelAnimation::Frame::convertToRootSpace(const Skeleton& skeleton)
+size_t SkelAnimation::getSampleSize() const
+{
+	return compressed ? compressedClip.getSampleSize() : 2u * Pose::getSize(numBones) * sizeof(float);
+}
+
+void SkelAnimation::Bounds::add(const V3& point)
 {
-	skeleton.Visit([this](const Skeleton::Bone& skelBone, uint index, uint parentIndex)
+	min = { std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+	max = { std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+}
+
+SkelAnimation::Bounds SkelAnimation::Bounds::merged(const Bounds& other) const
+{
+	return
 	{
-		auto& bone = bones[index];
-		if (parentIndex != (uint)-1)
+		{ std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z) },
+		{ std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z) }
+	};
+}
+
+SkelAnimation::Bounds SkelAnimation::getBounds(float time) const
+{
+	assert(hasBounds());
+	float frameTime = std::max(0.0f, time / 1000.0f * framerate);
+	uint frame0 = (uint)fmodf(floorf(frameTime), (float)frameBounds.size());
+	uint frame1 = (frame0 + 1u) % (uint)frameBounds.size();
+	return frameBounds[frame0].merged(frameBounds[frame1]);
+}
+
+void SkelAnimation::computeBounds(std::span<const Mesh> meshes, const Skeleton& skeleton, const Frame& bindFrame)
+{
+	frameBounds.assign(numFrames, {});
+	Pose pose;
+	std::vector<float> palette(numBones * Pose::paletteFloatsPerBone);
+	std::vector<V3> positions;
+	for (uint frame = 0; frame < numFrames; ++frame)
+	{
+		sample(frame * 1000.0f / framerate, pose);
+		pose.convertToRootSpace(skeleton);
+		pose.writeSkinningPalette(bindFrame, palette.data());
+		for (const Mesh& mesh : meshes)
 		{
-			auto& parentBone = bones[parentIndex];
-			
-			bone.position = parentBone.position + parentBone.rotation.rotate(bone.position);
-			bone.rotation = bone.rotation * parentBone.rotation;
-			//TODO: scale
+			positions.resize(mesh.getVertices().size());
+			mesh.skinVertices(palette.data(), positions.data());
+			for (const V3& position : positions)
+				frameBounds[frame].add(position);
 		}
-	});
+	}
+}
+
+void SkelAnimation::Frame::convertToRootSpace(const Skeleton& skeleton)
+{
+	assert(skeleton.getNumBones() == bones.size());
+	for (uint index = 0; index < bones.size(); ++index)
+	{
+		int parentIndex = skeleton.getParent(index);
+		if (parentIndex < 0)
+			continue;
+
+		auto& bone = bones[index];
+		auto& parentBone = bones[parentIndex];
+		V4 scaledPosition = { parentBone.size.x * bone.position.x, parentBone.size.y * bone.position.y, parentBone.size.z * bone.position.z };
+		bone.position = parentBone.position + parentBone.rotation.rotate(scaledPosition);
+		bone.rotation = bone.rotation * parentBone.rotation;
+		bone.size = { parentBone.size.x * bone.size.x, parentBone.size.y * bone.size.y, parentBone.size.z * bone.size.z };
+	}
 }
 
 void Animations::convertToRootSpace(const Skeleton& skeleton)
@@ -2,15 +2,21 @@
 
 #include "Common.h"
 #include "Engine/Math/Math.h"
+#include "CompressedClip.h"
+#include <span>
 
 struct Skeleton;
 struct Animations;
+class Pose;
+class IqmFile;
+class Mesh;
 
 class SkelAnimation
 {
 public:
 
 	static void load(std::string_view filename, Animations& animations);
+	static void load(const IqmFile& file, Animations& animations);
 	
 	void convertToRootSpace(const Skeleton& skeleton);
 
@@ -27,15 +33,61 @@ public:
 		std::vector<Bone> bones;
 	};
 
+	// A box around the skinned meshes in model space, empty until something is added
+	struct Bounds
+	{
+		V4 min = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		V4 max = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+		void add(const V3& point);
+		Bounds merged(const Bounds& other) const;
+		V4 getCenter() const { return (min + max) * 0.5f; }
+		float getRadius() const { return (max - min).length() * 0.5f; }
+	};
+
 	uint getName() const { return name; }
 	float getFramerate() const { return framerate; }
-	uint getNumFrames() const { return frames.size(); }
-	const Frame& getFrame(uint frameIndex) const { return frames[frameIndex]; }
+	uint getNumFrames() const { return numFrames; }
+	// Length of one loop in ms
+	float getDuration() const { return numFrames * 1000.0f / framerate; }
+	// Only while the clip is uncompressed
+	const Frame& getFrame(uint frameIndex) const { assert(!compressed); return frames[frameIndex]; }
+	uint getNumBones() const { return numBones; }
+
+	// Packs the clip into a CompressedClip and frees the uncompressed frames, parent-relative like they are.
+	// convertToRootSpace and getFrame need those frames, so neither works on a compressed clip.
+	void compress(const CompressedClip::Settings& settings);
+	const CompressedClip* getCompressedClip() const { return compressed ? &compressedClip : nullptr; }
+	// Clip bytes one sample() reads, two whole frames while uncompressed
+	size_t getSampleSize() const;
+
+	// Blends the two frames around time (in ms, looping) into pose, which is only resized, so a pose reused
+	// across frames and clips with the same skeleton never allocates. A boneRemap limits compressed clips to the
+	// bones mapped to themselves like Pose::writeSkinningPalette, uncompressed frames are blended whole, their
+	// channels are contiguous and one pass over all of them costs less than picking bones.
+	void sample(float time, Pose& pose, const uint* boneRemap = nullptr) const;
+
+	// Per frame bounds of the skinned meshes, loaded from the file if it has them, or from computeBounds
+	bool hasBounds() const { return !frameBounds.empty(); }
+	// Around both frames at time (in ms, looping), so it holds whatever sample() blends between them
+	Bounds getBounds(float time) const;
+	// Skins the meshes with every frame of the clip for files without bounds. The clip is parent-relative,
+	// bindFrame in root space, like AnimationSystem poses them.
+	void computeBounds(std::span<const Mesh> meshes, const Skeleton& skeleton, const Frame& bindFrame);
 	
 protected:
 
+	// Frames again in Pose layout, frame after frame, which is what sample() reads
+	void buildChannels();
+
 	uint name = 0u;
 	std::vector<Frame> frames;
+	std::vector<float> channels;
+	CompressedClip compressedClip;
+	std::vector<Bounds> frameBounds;
+	bool compressed = false;
+	uint numFrames = 0u;
+	uint numBones = 0u;
 	float framerate = 1.0f;
 };
 
@@ -1,26 +1,43 @@
 #include "Skeleton.h"
-#include "Importers/Importer_IQM.h"
+#include "Importers/IqmFile.h"
 #include "Engine/Log.h"
 
 void Skeleton::load(std::string_view filename)
 {
-	std::ifstream f(filename.data(), std::ios_base::binary);
-	if (!f)
-		return;
+	load(IqmFile(filename));
+}
 
-	iqmheader header;
-	f.read(reinterpret_cast<char*>(&header), sizeof(header));
+void Skeleton::load(const IqmFile& file)
+{
+	auto joints = file.getJoints();
+	std::vector<int> jointParents(joints.size());
+	for (uint i = 0; i < joints.size(); ++i)
+		jointParents[i] = joints[i].parent;
+	setParents(std::move(jointParents));
+	logLine(x, Verbose, "Read a Skeleton");
+}
+
+void Skeleton::setParents(std::vector<int> parents_)
+{
+	parents = std::move(parents_);
 
-	if (header.num_joints > 0 && header.ofs_joints > 0)
+	depths.assign(parents.size(), 0u);
+	uint numLevels = 0u;
+	for (uint bone = 0; bone < parents.size(); ++bone)
 	{
-		f.seekg(header.ofs_joints);
-		bones.resize(header.num_joints);
-		for (uint i = 0; i < header.num_joints; ++i)
-		{
-			iqmjoint joint;
-			f.read(reinterpret_cast<char*>(&joint), sizeof(joint));
-			bones[i] = Bone{joint.parent >= 0 ? &bones[joint.parent] : nullptr};
-		}
+		assert(parents[bone] < (int)bone);
+		depths[bone] = parents[bone] >= 0 ? depths[parents[bone]] + 1u : 0u;
+		numLevels = std::max(numLevels, depths[bone] + 1u);
 	}
-	logLine(x, Verbose, "Read a Skeleton");
-}
\ No newline at end of file
+
+	// counting sort by depth, bones of a level stay in index order
+	levelStarts.assign(numLevels + 1u, 0u);
+	for (uint depth : depths)
+		++levelStarts[depth + 1u];
+	for (uint level = 0; level < numLevels; ++level)
+		levelStarts[level + 1u] += levelStarts[level];
+	levelBones.resize(parents.size());
+	std::vector<uint> next(levelStarts.begin(), levelStarts.end() - 1);
+	for (uint bone = 0; bone < parents.size(); ++bone)
+		levelBones[next[depths[bone]]++] = bone;
+}
@@ -1,38 +1,36 @@
 #pragma once
 
 #include "Common.h"
+#include <span>
 
+class IqmFile;
+
+// Bone hierarchy as one parent index per bone. Parents always come before their children, like IQM requires,
+// so a single forward pass over the bones sees every parent finished before its children. The bones are also
+// grouped by depth: none of the bones of one level depends on another of the same level, so a level can be
+// processed as one batch.
 struct Skeleton
 {
 	void load(std::string_view filename);
-	
-	struct Bone
-	{
-		Bone* parent = nullptr;
-	};
-	
-	std::vector<Bone> bones;
-	
-	template<typename Func>
-	void Visit(Func&& func) const
-	{
-		VisitImpl(func);
-	}
-	
-protected:
-	template<typename Func>
-	void VisitImpl(Func&& func, const Bone* parent = nullptr, uint parentIndex = (uint)-1) const
-	{
-		for (uint i = 0u; i < bones.size(); ++i)
-		{
-			auto& bone = bones[i];
-			if (bone.parent == parent)
-			{
-				func(bone, i, parentIndex);
-				VisitImpl(func, &bone, i);
-				if (!bone.parent)
-					return;
-			}
-		}
-	}
-};
\ No newline at end of file
+	void load(const IqmFile& file);
+
+	// -1 for roots, otherwise lower than the bone's own index
+	void setParents(std::vector<int> parents);
+
+	uint getNumBones() const { return (uint)parents.size(); }
+	int getParent(uint bone) const { return parents[bone]; }
+	// The level the bone is in, 0 for roots
+	uint getDepth(uint bone) const { return depths[bone]; }
+	const std::vector<int>& getParents() const { return parents; }
+
+	uint getNumLevels() const { return (uint)levelStarts.size() - 1u; }
+	// Bones of one depth, level 0 are the roots
+	std::span<const uint> getLevel(uint level) const { return { levelBones.data() + levelStarts[level], levelStarts[level + 1] - levelStarts[level] }; }
+
+private:
+
+	std::vector<int> parents;
+	std::vector<uint> depths;
+	std::vector<uint> levelBones;
+	std::vector<uint> levelStarts = { 0u };
+};
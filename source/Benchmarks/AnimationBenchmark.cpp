@@ -0,0 +1,235 @@
+#include "Common.h"
+#include "Animation/SkelAnimation.h"
+#include "Animation/Skeleton.h"
+#include "Animation/Pose.h"
+#include "Engine/WorkerPool.h"
+#include "Importers/IqmFile.h"
+#include <filesystem>
+
+// Headless animation benchmark, no window or Vulkan device involved. Every instance samples a random clip of the
+// model at a random time, converts the pose to root space and writes its skinning palette, the work
+// AnimationSystem::update does per evaluated instance, just without a scene around it.
+// Usage: AnimationBenchmark [--models models/cat.iqm,...] [--instances 1000,10000] [--threads 4] [--iterations 20] [--clips raw,compressed]
+// Runs every model with 1 up to --threads threads (zero, the default, means one per hardware thread), models are
+// all IQM files in models/ unless given. Prints one JSON document with instances per ms per thread count and the
+// clip bytes a sample reads.
+
+namespace
+{
+	struct Options
+	{
+		std::vector<std::string> models;
+		std::vector<uint> instanceCounts = { 1000, 10000 };
+		uint maxThreads = 0u;
+		uint numIterations = 20;
+		std::vector<std::string> clips = { "raw", "compressed" };
+	};
+
+	// The tolerances main.cpp compresses the cat with
+	const CompressedClip::Settings compressSettings = { 0.002f, 0.002f, 0.002f };
+
+	struct Model
+	{
+		std::string path;
+		Skeleton skeleton;
+		Animations animations;
+	};
+
+	struct Instance
+	{
+		const SkelAnimation* animation = nullptr;
+		float time = 0.0f;
+	};
+
+	struct ThreadResult
+	{
+		uint numThreads = 0u;
+		double meanMs = 0.0;
+		double minMs = 0.0;
+	};
+
+	struct Result
+	{
+		std::string model;
+		std::string clip;
+		uint numInstances = 0u;
+		uint numBones = 0u;
+		uint numClips = 0u;
+		size_t clipBytes = 0u;
+		double sampleBytes = 0.0;
+		std::vector<ThreadResult> threads;
+	};
+
+	std::vector<std::string> split(std::string_view str, char separator)
+	{
+		std::vector<std::string> parts;
+		for (auto part : std::views::split(str, separator))
+			parts.emplace_back(part.begin(), part.end());
+		return parts;
+	}
+
+	std::vector<std::string> findModels()
+	{
+		std::vector<std::string> models;
+		for (auto& entry : std::filesystem::directory_iterator("models"))
+		{
+			if (entry.path().extension() == ".iqm")
+				models.push_back(entry.path().generic_string());
+		}
+		// the cat first, it's the one main.cpp animates
+		std::sort(models.begin(), models.end(), [](const std::string& a, const std::string& b)
+		{
+			bool aIsCat = a.ends_with("cat.iqm");
+			bool bIsCat = b.ends_with("cat.iqm");
+			return aIsCat != bIsCat ? aIsCat : a < b;
+		});
+		return models;
+	}
+
+	// Loaded like main.cpp loads the cat: clips parent-relative, the bind frame in root space
+	std::optional<Model> loadModel(const std::string& path, bool compress)
+	{
+		IqmFile file(path);
+		if (!file.isValid() || file.getHeader().num_joints == 0u || file.getHeader().num_anims == 0u)
+			return std::nullopt;
+
+		Model model;
+		model.path = path;
+		model.skeleton.load(file);
+		SkelAnimation::load(file, model.animations);
+		model.animations.initialFrame.convertToRootSpace(model.skeleton);
+		if (compress)
+		{
+			for (auto& animation : model.animations.animations)
+				animation.compress(compressSettings);
+		}
+		return model;
+	}
+
+	Result run(const Model& model, const std::string& clip, uint numInstances, const Options& options)
+	{
+		const auto& animations = model.animations.animations;
+		uint numBones = model.skeleton.getNumBones();
+
+		Result result;
+		result.model = model.path;
+		result.clip = clip;
+		result.numInstances = numInstances;
+		result.numBones = numBones;
+		result.numClips = (uint)animations.size();
+		for (auto& animation : animations)
+			result.clipBytes += animation.getCompressedClip() ? animation.getCompressedClip()->getSize() : animation.getNumFrames() * Pose::getSize(numBones) * sizeof(float);
+
+		std::default_random_engine random_engine(1);
+		std::uniform_int_distribution<size_t> animationIndex(0, animations.size() - 1);
+		std::uniform_real_distribution unit(0.0f, 1.0f);
+		std::vector<Instance> instances(numInstances);
+		for (auto& instance : instances)
+		{
+			instance.animation = &animations[animationIndex(random_engine)];
+			instance.time = unit(random_engine) * instance.animation->getDuration();
+			result.sampleBytes += (double)instance.animation->getSampleSize() / numInstances;
+		}
+
+		// one palette per instance like AnimationSystem's palette arena, poses are thread scratch
+		size_t paletteFloats = numBones * Pose::paletteFloatsPerBone;
+		std::vector<float> palettes(numInstances * paletteFloats);
+		auto evaluate = [&](uint begin, uint end)
+		{
+			static thread_local Pose pose;
+			for (uint i = begin; i < end; ++i)
+			{
+				instances[i].animation->sample(instances[i].time, pose);
+				pose.convertToRootSpace(model.skeleton);
+				pose.writeSkinningPalette(model.animations.initialFrame, palettes.data() + i * paletteFloats);
+			}
+		};
+
+		uint maxThreads = options.maxThreads > 0u ? options.maxThreads : std::max(1u, std::thread::hardware_concurrency());
+		for (uint numThreads = 1; numThreads <= maxThreads; ++numThreads)
+		{
+			WorkerPool workers(numThreads);
+			workers.parallelFor(numInstances, 8u, evaluate); // warms up the caches and the thread local poses
+
+			ThreadResult threadResult;
+			threadResult.numThreads = numThreads;
+			threadResult.minMs = std::numeric_limits<double>::max();
+			for (uint iteration = 0; iteration < options.numIterations; ++iteration)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				workers.parallelFor(numInstances, 8u, evaluate);
+				std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+				threadResult.meanMs += time.count() / options.numIterations;
+				threadResult.minMs = std::min(threadResult.minMs, time.count());
+			}
+			result.threads.push_back(threadResult);
+		}
+		return result;
+	}
+
+	std::string toJson(const Result& result)
+	{
+		std::string threads;
+		double singleThreadMs = result.threads.front().meanMs;
+		for (size_t i = 0; i < result.threads.size(); ++i)
+		{
+			const ThreadResult& thread = result.threads[i];
+			threads += std::format("{}\n        {{\"threads\": {}, \"instancesPerMs\": {:.1f}, \"speedup\": {:.2f}, \"meanMs\": {:.4f}, \"minMs\": {:.4f}}}",
+				i > 0 ? "," : "", thread.numThreads, result.numInstances / thread.meanMs, singleThreadMs / thread.meanMs, thread.meanMs, thread.minMs);
+		}
+		return std::format(
+			"    {{\"model\": \"{}\", \"clip\": \"{}\", \"instances\": {}, \"bones\": {}, \"clips\": {}, \"clipBytes\": {}, \"clipBytesPerSample\": {:.0f}, \"threads\": [{}\n      ]}}",
+			result.model, result.clip, result.numInstances, result.numBones, result.numClips, result.clipBytes, result.sampleBytes, threads);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string_view arg = argv[i];
+		std::string_view value = argv[i + 1];
+		if (arg == "--models")
+			options.models = split(value, ',');
+		else if (arg == "--instances")
+		{
+			options.instanceCounts.clear();
+			for (auto& count : split(value, ','))
+				options.instanceCounts.push_back(std::max(1u, (uint)std::stoul(count)));
+		}
+		else if (arg == "--threads")
+			options.maxThreads = (uint)std::stoul(std::string(value));
+		else if (arg == "--iterations")
+			options.numIterations = std::max(1u, (uint)std::stoul(std::string(value)));
+		else if (arg == "--clips")
+			options.clips = split(value, ',');
+	}
+	if (options.models.empty())
+		options.models = findModels();
+
+	std::vector<std::string> entries;
+	for (auto& path : options.models)
+	{
+		for (auto& clip : options.clips)
+		{
+			auto model = loadModel(path, clip == "compressed");
+			if (!model)
+			{
+				std::println(stderr, "{}: no skeleton or animations, skipped", path);
+				break;
+			}
+			for (uint numInstances : options.instanceCounts)
+			{
+				std::println(stderr, "{}: {} clips, {} instances", path, clip, numInstances);
+				entries.push_back(toJson(run(*model, clip, numInstances, options)));
+			}
+		}
+	}
+
+	std::println("{{\n  \"iterations\": {},\n  \"results\": [", options.numIterations);
+	for (size_t i = 0; i < entries.size(); ++i)
+		std::println("{}{}", entries[i], i + 1 < entries.size() ? "," : "");
+	std::println("  ]\n}}");
+	return 0;
+}
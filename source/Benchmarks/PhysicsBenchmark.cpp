@@ -0,0 +1,229 @@
+#include "Common.h"
+#include "Physics/PhysicsSystem.h"
+#include "Physics/PhysicsComponent.h"
+#include "Physics/ColliderComponent.h"
+#include "Engine/Scene.h"
+#include "Animation/Mesh.h"
+
+// Headless PhysicsSystem benchmark, no window or Vulkan device involved.
+// Usage: PhysicsBenchmark [--scene arena|stacks|mixed|all] [--bodies 100,1000,10000] [--frames 300] [--dt 16] [--max-seconds 60]
+// Prints one JSON document with a result per scene and body count. A run stops early once it used up max-seconds,
+// counted from the start of building its scene, the frames actually stepped are reported, so large body counts
+// still give numbers in reasonable time.
+
+namespace
+{
+	const std::string_view sceneNames[] = { "arena", "stacks", "mixed" };
+
+	struct Options
+	{
+		std::vector<std::string> scenes = { sceneNames, sceneNames + std::size(sceneNames) };
+		std::vector<uint> bodyCounts = { 100, 1000, 10000 };
+		uint numFrames = 300;
+		float dt = 16.0f; // milliseconds, like the main loop
+		double maxSeconds = 60.0;
+	};
+
+	struct Result
+	{
+		std::string scene;
+		uint numBodies = 0u;
+		uint numRequestedFrames = 0u;
+		uint numFrames = 0u;
+		double totalMs = 0.0;
+		uint64 numPairTests = 0u;
+		uint64 numContacts = 0u;
+		std::vector<double> frameMs;
+	};
+
+	std::vector<std::string> split(std::string_view str, char separator)
+	{
+		std::vector<std::string> parts;
+		for (auto part : std::views::split(str, separator))
+			parts.emplace_back(part.begin(), part.end());
+		return parts;
+	}
+
+	// Same walls as the arena in main.cpp, pushed out so bigger body counts keep roughly the same density
+	float addArena(Scene& scene, uint numBodies)
+	{
+		float halfSize = std::max(16.0f, ceilf(sqrtf((float)numBodies)) * 0.8f);
+		auto arena = scene.addActor();
+		arena->addComponent<PhysicsComponent>()->setFlags(PhysicsComponent::Heavy);
+		arena->addComponent<PlaneColliderComponent>()->setEquation({ 0.0f, 0.0f, 1.0f, 0.0f });
+		arena->addComponent<PlaneColliderComponent>()->setEquation({ 1.0f, 0.0f, 0.0f, halfSize });
+		arena->addComponent<PlaneColliderComponent>()->setEquation({ 1.0f, 0.0f, 0.0f, -halfSize });
+		arena->addComponent<PlaneColliderComponent>()->setEquation({ 0.0f, 1.0f, 0.0f, halfSize });
+		arena->addComponent<PlaneColliderComponent>()->setEquation({ 0.0f, 1.0f, 0.0f, -halfSize });
+		arena->addComponent<PlaneColliderComponent>()->setEquation({ 0.0f, 0.0f, 1.0f, 16.0f });
+		return halfSize;
+	}
+
+	Actor* addBody(Scene& scene, const V4& position)
+	{
+		auto actor = scene.addActor();
+		actor->addComponent<PhysicsComponent>()->setMass(1.0f)->setFlags(PhysicsComponent::Dynamic | PhysicsComponent::Gravity)->setRestitution(0.0f);
+		actor->getTransformComponent().setTransform(Mtx::translate(position));
+		return actor;
+	}
+
+	void buildArena(Scene& scene, uint numBodies)
+	{
+		float halfSize = addArena(scene, numBodies);
+		std::default_random_engine random_engine(1);
+		std::uniform_real_distribution d(-halfSize + 1.0f, halfSize - 1.0f);
+		std::uniform_real_distribution height(1.0f, 8.0f);
+		for (uint i = 0; i < numBodies; ++i)
+			addBody(scene, { d(random_engine), d(random_engine), height(random_engine) })->addComponent<SphereColliderComponent>();
+	}
+
+	void buildStacks(Scene& scene, uint numBodies)
+	{
+		const uint stackHeight = 10;
+		float halfSize = addArena(scene, numBodies);
+		uint numStacks = (numBodies + stackHeight - 1) / stackHeight;
+		uint stacksPerRow = (uint)ceilf(sqrtf((float)numStacks));
+		float spacing = std::min(2.0f, (halfSize * 2.0f - 2.0f) / stacksPerRow);
+		for (uint i = 0; i < numBodies; ++i)
+		{
+			uint stack = i / stackHeight;
+			V4 position = { -halfSize + 1.0f + (stack % stacksPerRow) * spacing, -halfSize + 1.0f + (stack / stacksPerRow) * spacing, 0.5f + (i % stackHeight) * 1.001f };
+			addBody(scene, position)->addComponent<SphereColliderComponent>();
+		}
+	}
+
+	void buildMixed(Scene& scene, uint numBodies)
+	{
+		static const Mesh hullMesh = []
+		{
+			Mesh mesh;
+			mesh.generateSphere(0.5f);
+			return mesh;
+		}();
+
+		float halfSize = addArena(scene, numBodies);
+		std::default_random_engine random_engine(1);
+		std::uniform_real_distribution d(-halfSize + 1.0f, halfSize - 1.0f);
+		std::uniform_real_distribution height(1.0f, 8.0f);
+		for (uint i = 0; i < numBodies; ++i)
+		{
+			Actor* body = addBody(scene, { d(random_engine), d(random_engine), height(random_engine) });
+			switch (i % 4)
+			{
+			case 0: body->addComponent<SphereColliderComponent>(); break;
+			case 1: body->addComponent<BoxColliderComponent>(); break;
+			case 2: body->addComponent<CapsuleColliderComponent>()->setShape(0.4f, 0.3f); break;
+			case 3: body->addComponent<ConvexHullColliderComponent>()->setMesh(hullMesh, 16u); break;
+			}
+		}
+	}
+
+	Result run(const std::string& sceneName, uint numBodies, const Options& options)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(options.maxSeconds);
+		Scene scene;
+		if (sceneName == "arena")
+			buildArena(scene, numBodies);
+		else if (sceneName == "stacks")
+			buildStacks(scene, numBodies);
+		else
+			buildMixed(scene, numBodies);
+
+		Result result;
+		result.scene = sceneName;
+		result.numBodies = numBodies;
+		result.numRequestedFrames = options.numFrames;
+		result.frameMs.reserve(options.numFrames);
+
+		PhysicsSystem physics;
+		for (uint frame = 0; frame < options.numFrames; ++frame)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			physics.update(scene, options.dt);
+			std::chrono::duration<double, std::milli> frameTime = std::chrono::high_resolution_clock::now() - start;
+
+			result.frameMs.push_back(frameTime.count());
+			result.totalMs += frameTime.count();
+			result.numPairTests += physics.getStepStats().numPairTests;
+			result.numContacts += physics.getStepStats().numContacts;
+			++result.numFrames;
+			if (std::chrono::steady_clock::now() > deadline)
+				break;
+		}
+		return result;
+	}
+
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.0;
+		size_t index = std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5));
+		return sorted[index];
+	}
+
+	std::string toJson(const Result& result)
+	{
+		std::vector<double> sorted = result.frameMs;
+		std::sort(sorted.begin(), sorted.end());
+		double seconds = result.totalMs / 1000.0;
+		return std::format(
+			"    {{\"scene\": \"{}\", \"bodies\": {}, \"frames\": {}, \"requestedFrames\": {}, \"stepsPerSec\": {:.2f}, \"pairsTested\": {}, \"pairsTestedPerFrame\": {:.1f}, "
+			"\"contacts\": {}, \"contactsPerFrame\": {:.1f}, \"frameMs\": {{\"mean\": {:.4f}, \"p50\": {:.4f}, \"p90\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f}}}}}",
+			result.scene, result.numBodies, result.numFrames, result.numRequestedFrames, seconds > 0.0 ? result.numFrames / seconds : 0.0,
+			result.numPairTests, (double)result.numPairTests / result.numFrames, result.numContacts, (double)result.numContacts / result.numFrames,
+			result.totalMs / result.numFrames, percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99), sorted.empty() ? 0.0 : sorted.back());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string_view arg = argv[i];
+		std::string_view value = argv[i + 1];
+		if (arg == "--scene" && value != "all")
+		{
+			options.scenes = split(value, ',');
+			for (auto& scene : options.scenes)
+			{
+				if (std::find(std::begin(sceneNames), std::end(sceneNames), scene) == std::end(sceneNames))
+				{
+					std::string validScenes;
+					for (auto name : sceneNames)
+						validScenes += std::format("{}, ", name);
+					std::println(stderr, "Unknown scene '{}', valid scenes are {}all", scene, validScenes);
+					return 1;
+				}
+			}
+		}
+		else if (arg == "--bodies")
+		{
+			options.bodyCounts.clear();
+			for (auto& count : split(value, ','))
+				options.bodyCounts.push_back((uint)std::stoul(count));
+		}
+		else if (arg == "--frames")
+			options.numFrames = std::max(1u, (uint)std::stoul(std::string(value)));
+		else if (arg == "--dt")
+			options.dt = std::stof(std::string(value));
+		else if (arg == "--max-seconds")
+			options.maxSeconds = std::stod(std::string(value));
+	}
+
+	std::vector<std::string> entries;
+	for (auto& scene : options.scenes)
+	{
+		for (uint numBodies : options.bodyCounts)
+		{
+			std::println(stderr, "{}: {} bodies, {} frames", scene, numBodies, options.numFrames);
+			entries.push_back(toJson(run(scene, numBodies, options)));
+		}
+	}
+
+	std::println("{{\n  \"frameDtMs\": {},\n  \"results\": [", options.dt);
+	for (size_t i = 0; i < entries.size(); ++i)
+		std::println("{}{}", entries[i], i + 1 < entries.size() ? "," : "");
+	std::println("  ]\n}}");
+	return 0;
+}
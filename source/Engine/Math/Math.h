@@ -339,7 +339,7 @@ struct Mtx
 		float W = a * (e * i - f * h) + b * (f * g - d * i) + c * (d * h - e * g);
 
 		float w[3][3];
-		w[0][0] = e * i - f * g;
+		w[0][0] = e * i - f * h;
 		w[0][1] = f * g - d * i;
 		w[0][2] = d * h - e * g;
 
@@ -365,9 +365,9 @@ struct Mtx
 		}
 
 		V4 newTransform;
-		newTransform[0] = -(rs[0][0] * translation[0] + rs[0][1] * translation[1] + rs[0][2] * translation[2]);
-		newTransform[1] = -(rs[1][0] * translation[0] + rs[1][1] * translation[1] + rs[1][2] * translation[2]);
-		newTransform[2] = -(rs[2][0] * translation[0] + rs[2][1] * translation[1] + rs[2][2] * translation[2]);
+		newTransform[0] = -(translation[0] * rs[0][0] + translation[1] * rs[1][0] + translation[2] * rs[2][0]);
+		newTransform[1] = -(translation[0] * rs[0][1] + translation[1] * rs[1][1] + translation[2] * rs[2][1]);
+		newTransform[2] = -(translation[0] * rs[0][2] + translation[1] * rs[1][2] + translation[2] * rs[2][2]);
 		newTransform[3] = 1;
 		
 		Mtx inv = {rs[0],rs[1],rs[2], newTransform};
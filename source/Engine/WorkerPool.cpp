@@ -0,0 +1,80 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(uint numThreads)
+{
+	if (numThreads == 0u)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (uint i = 1; i < numThreads; ++i)
+		threads.emplace_back([this] { workerLoop(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void WorkerPool::parallelFor(uint count_, uint chunkSize_, const Job& job_)
+{
+	chunkSize_ = std::max(chunkSize_, 1u);
+	if (threads.empty() || count_ <= chunkSize_)
+	{
+		for (uint begin = 0; begin < count_; begin += chunkSize_)
+			job_(begin, std::min(begin + chunkSize_, count_));
+		return;
+	}
+
+	{
+		std::lock_guard lock(mutex);
+		job = &job_;
+		count = count_;
+		chunkSize = chunkSize_;
+		nextChunk.store(0u, std::memory_order_relaxed);
+		numBusy = (uint)threads.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	runChunks();
+
+	std::unique_lock lock(mutex);
+	done.wait(lock, [this] { return numBusy == 0u; });
+	job = nullptr;
+}
+
+void WorkerPool::workerLoop()
+{
+	uint64 seenGeneration = 0u;
+	while (true)
+	{
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seenGeneration; });
+			if (quit)
+				return;
+			seenGeneration = generation;
+		}
+
+		runChunks();
+
+		std::lock_guard lock(mutex);
+		if (--numBusy == 0u)
+			done.notify_one();
+	}
+}
+
+void WorkerPool::runChunks()
+{
+	while (true)
+	{
+		uint begin = nextChunk.fetch_add(1u, std::memory_order_relaxed) * chunkSize;
+		if (begin >= count)
+			return;
+		(*job)(begin, std::min(begin + chunkSize, count));
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Common.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+// A fixed set of threads that split index ranges between them. The calling thread works along,
+// so a pool of one thread runs everything inline.
+class WorkerPool
+{
+public:
+
+	using Job = std::function<void(uint begin, uint end)>;
+
+	// numThreads counts the calling thread, zero picks one per hardware thread
+	explicit WorkerPool(uint numThreads = 0u);
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	uint getNumThreads() const { return (uint)threads.size() + 1u; }
+
+	// Calls job for consecutive chunks of [0, count), at most chunkSize long, and returns once all of them ran
+	void parallelFor(uint count, uint chunkSize, const Job& job);
+
+private:
+
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const Job* job = nullptr;
+	uint count = 0u;
+	uint chunkSize = 1u;
+	std::atomic<uint> nextChunk = 0u;
+	uint numBusy = 0u;
+	uint64 generation = 0u;
+	bool quit = false;
+};
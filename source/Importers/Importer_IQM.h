@@ -51,6 +51,12 @@ struct iqmanim
     uint flags;
 };
 
+struct iqmbounds
+{
+    float bbmin[3], bbmax[3];
+    float xyradius, radius;
+};
+
 struct iqmmesh
 {
     uint name;
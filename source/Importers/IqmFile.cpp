@@ -0,0 +1,176 @@
+#include "IqmFile.h"
+#include "Engine/Log.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool IqmFile::open(std::string_view filename)
+{
+	close();
+	std::string path(filename);
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		logLine(x, Error, "Can't open {}", filename);
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		logLine(x, Error, "Can't map {}", filename);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = static_cast<const uchar*>(view);
+	size = (size_t)fileSize.QuadPart;
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	struct stat fileStat;
+	void* view = file >= 0 && fstat(file, &fileStat) == 0 && fileStat.st_size > 0 ? mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	if (file >= 0)
+		::close(file); // the mapping keeps the file alive
+	if (view == MAP_FAILED)
+	{
+		logLine(x, Error, "Can't map {}", filename);
+		return false;
+	}
+	data = static_cast<const uchar*>(view);
+	size = (size_t)fileStat.st_size;
+#endif
+
+	header = size >= sizeof(iqmheader) ? reinterpret_cast<const iqmheader*>(data) : nullptr;
+	if (!header || !validate())
+	{
+		logLine(x, Error, "{} isn't a valid IQM file", filename);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void IqmFile::close()
+{
+	if (data)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		munmap(const_cast<uchar*>(data), size);
+#endif
+	}
+	data = nullptr;
+	size = 0u;
+	header = nullptr;
+}
+
+std::string_view IqmFile::getText(uint offset) const
+{
+	if (!header || offset >= header->num_text)
+		return {};
+	const char* text = reinterpret_cast<const char*>(data + header->ofs_text + offset);
+	return { text, strnlen(text, header->num_text - offset) };
+}
+
+uint IqmFile::getFormatSize(IQM_Format format)
+{
+	switch (format)
+	{
+	case IQM_Format::IQM_BYTE:
+	case IQM_Format::IQM_UBYTE: return 1u;
+	case IQM_Format::IQM_SHORT:
+	case IQM_Format::IQM_USHORT:
+	case IQM_Format::IQM_HALF: return 2u;
+	case IQM_Format::IQM_INT:
+	case IQM_Format::IQM_UINT:
+	case IQM_Format::IQM_FLOAT: return 4u;
+	case IQM_Format::IQM_DOUBLE: return 8u;
+	}
+	return 0u;
+}
+
+bool IqmFile::isSectionValid(uint offset, uint64 sectionSize, uint alignment) const
+{
+	if (sectionSize == 0u)
+		return true;
+	return offset >= sizeof(iqmheader) && offset % alignment == 0u && offset + sectionSize <= header->filesize;
+}
+
+bool IqmFile::validate() const
+{
+	const iqmheader& h = *header;
+	if (memcmp(h.magic, "INTERQUAKEMODEL", 16) != 0 || h.version != 2u || h.filesize > size)
+		return false;
+
+	bool sectionsValid =
+		isSectionValid(h.ofs_text, h.num_text, 1u) &&
+		isSectionValid(h.ofs_meshes, (uint64)h.num_meshes * sizeof(iqmmesh), 4u) &&
+		isSectionValid(h.ofs_vertexarrays, (uint64)h.num_vertexarrays * sizeof(iqmvertexarray), 4u) &&
+		isSectionValid(h.ofs_triangles, (uint64)h.num_triangles * sizeof(iqmtriangle), 4u) &&
+		isSectionValid(h.ofs_joints, (uint64)h.num_joints * sizeof(iqmjoint), 4u) &&
+		isSectionValid(h.ofs_poses, (uint64)h.num_poses * sizeof(iqmpose), 4u) &&
+		isSectionValid(h.ofs_anims, (uint64)h.num_anims * sizeof(iqmanim), 4u) &&
+		isSectionValid(h.ofs_frames, (uint64)h.num_frames * h.num_framechannels * sizeof(ushort), 2u) &&
+		(h.ofs_bounds == 0u || isSectionValid(h.ofs_bounds, (uint64)h.num_frames * sizeof(iqmbounds), 4u));
+	if (!sectionsValid)
+		return false;
+
+	for (auto& vertexArray : getVertexArrays())
+	{
+		uint formatSize = getFormatSize(vertexArray.format);
+		if (formatSize == 0u || !isSectionValid(vertexArray.offset, (uint64)h.num_vertexes * vertexArray.size * formatSize, std::max(formatSize, 4u)))
+			return false;
+	}
+
+	for (auto& mesh : getMeshes())
+	{
+		if ((uint64)mesh.first_vertex + mesh.num_vertexes > h.num_vertexes || (uint64)mesh.first_triangle + mesh.num_triangles > h.num_triangles)
+			return false;
+	}
+
+	for (auto& triangle : getTriangles())
+	{
+		if (triangle.vertex[0] >= h.num_vertexes || triangle.vertex[1] >= h.num_vertexes || triangle.vertex[2] >= h.num_vertexes)
+			return false;
+	}
+
+	// parents have to come first, Skeleton converts to root space in one forward pass
+	auto joints = getJoints();
+	for (uint i = 0; i < joints.size(); ++i)
+	{
+		if (joints[i].parent >= (int)i)
+			return false;
+	}
+
+	uint numChannels = 0u;
+	for (auto& pose : getPoses())
+		numChannels += std::popcount(pose.channelmask & 0x3ffu);
+	if (h.num_frames > 0u && numChannels != h.num_framechannels)
+		return false;
+
+	for (auto& anim : getAnims())
+	{
+		if ((uint64)anim.first_frame + anim.num_frames > h.num_frames)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Common.h"
+#include "Importer_IQM.h"
+#include <span>
+
+// An IQM file mapped into memory once. The header and every section it points to are checked on open,
+// after that the sections are handed out as spans straight into the mapping, nothing is copied.
+// Skeleton, animation and mesh loading all decode from one IqmFile, so a model is read from disk once.
+class IqmFile
+{
+public:
+
+	IqmFile() = default;
+	explicit IqmFile(std::string_view filename) { open(filename); }
+	~IqmFile() { close(); }
+	IqmFile(const IqmFile&) = delete;
+	IqmFile& operator=(const IqmFile&) = delete;
+
+	bool open(std::string_view filename);
+	void close();
+	bool isValid() const { return header != nullptr; }
+
+	const iqmheader& getHeader() const { assert(header); return *header; }
+
+	// All empty while the file isn't valid
+	std::span<const iqmmesh> getMeshes() const { return getSection<iqmmesh>(&iqmheader::ofs_meshes, &iqmheader::num_meshes); }
+	std::span<const iqmvertexarray> getVertexArrays() const { return getSection<iqmvertexarray>(&iqmheader::ofs_vertexarrays, &iqmheader::num_vertexarrays); }
+	std::span<const iqmtriangle> getTriangles() const { return getSection<iqmtriangle>(&iqmheader::ofs_triangles, &iqmheader::num_triangles); }
+	std::span<const iqmjoint> getJoints() const { return getSection<iqmjoint>(&iqmheader::ofs_joints, &iqmheader::num_joints); }
+	std::span<const iqmpose> getPoses() const { return getSection<iqmpose>(&iqmheader::ofs_poses, &iqmheader::num_poses); }
+	std::span<const iqmanim> getAnims() const { return getSection<iqmanim>(&iqmheader::ofs_anims, &iqmheader::num_anims); }
+	// num_framechannels values per frame, one for every channel whose bit is set in its pose's mask
+	std::span<const ushort> getFrames() const { return getSection<ushort>(&iqmheader::ofs_frames, &iqmheader::num_frames, header ? header->num_framechannels : 0u); }
+	std::span<const ushort> getFrames(const iqmanim& anim) const { return getFrames().subspan(anim.first_frame * header->num_framechannels, anim.num_frames * header->num_framechannels); }
+	// A box around the skinned meshes for every frame, empty if the file doesn't have them, they're optional
+	std::span<const iqmbounds> getBounds() const { return header && header->ofs_bounds ? getSection<iqmbounds>(&iqmheader::ofs_bounds, &iqmheader::num_frames) : std::span<const iqmbounds>{}; }
+	std::span<const iqmbounds> getBounds(const iqmanim& anim) const { auto bounds = getBounds(); return bounds.empty() ? bounds : bounds.subspan(anim.first_frame, anim.num_frames); }
+
+	// num_vertexes * size components, T has to match the array's format
+	template<typename T>
+	std::span<const T> getVertexArray(const iqmvertexarray& vertexArray) const
+	{
+		assert(getFormatSize(vertexArray.format) == sizeof(T));
+		if (!header)
+			return {};
+		return { reinterpret_cast<const T*>(data + vertexArray.offset), header->num_vertexes * vertexArray.size };
+	}
+
+	std::string_view getText(uint offset) const;
+
+	static uint getFormatSize(IQM_Format format);
+
+private:
+
+	template<typename T>
+	std::span<const T> getSection(uint iqmheader::* offset, uint iqmheader::* count, uint elementsPerEntry = 1u) const
+	{
+		if (!header || header->*count == 0u)
+			return {};
+		return { reinterpret_cast<const T*>(data + header->*offset), header->*count * elementsPerEntry };
+	}
+
+	bool isSectionValid(uint offset, uint64 size, uint alignment) const;
+	bool validate() const;
+
+	const uchar* data = nullptr;
+	size_t size = 0u;
+	const iqmheader* header = nullptr;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -1,7 +1,13 @@
 #include "ColliderComponent.h"
+#include "PhysicsComponent.h"
+#include "MeshBVH.h"
+#include "ConvexHull.h"
+#include "GJK.h"
+#include "Heightfield.h"
 #include "Engine/Actor.h"
 #include "Engine/TransformComponent.h"
 #include "Engine/Log.h"
+#include <atomic>
 
 namespace std
 {
@@ -37,6 +43,23 @@ private:
 	std::unordered_map<std::pair<ColliderComponent::Type, ColliderComponent::Type>, CollisionMediator*> mediators;
 };
 
+namespace
+{
+	std::atomic<uint> nextColliderSerial = 1u;
+
+	// Normals go through the inverse transpose, the forward transform tilts them off a non-uniformly scaled surface
+	V4 transformNormal(const V4& normal, const Mtx& inverseTransform)
+	{
+		V4 n = normal.xyz();
+		return V4{ n.dot(inverseTransform.getRow(0).xyz()), n.dot(inverseTransform.getRow(1).xyz()), n.dot(inverseTransform.getRow(2).xyz()), 0.0f }.normalize();
+	}
+}
+
+ColliderComponent::ColliderComponent()
+	: serial(nextColliderSerial.fetch_add(1u, std::memory_order_relaxed))
+{
+}
+
 std::optional<Collision> ColliderComponent::intersects(ColliderComponent& other, std::optional<Context> context) const
 {
 	if (context)
@@ -49,6 +72,69 @@ void ColliderComponent::setLocalTransform(const Mtx& transform_)
 	transform = transform_;
 }
 
+TriangleMeshColliderComponent* TriangleMeshColliderComponent::setMesh(const Mesh& mesh)
+{
+	bvh = MeshBVH::get(mesh);
+	return this;
+}
+
+std::optional<RayIntersectResult> TriangleMeshColliderComponent::intersectRay(const V4& point, const V4& dir) const
+{
+	if (!bvh)
+		return {};
+
+	Mtx meshT = getTransform();
+	Mtx invMeshT = meshT.inversedTransform();
+	V4 point_Mesh = V4{ point.x, point.y, point.z, 1.0f } * invMeshT;
+	V4 dir_Mesh = dir.xyz() * invMeshT;
+
+	// the transform is affine so the ray parameter is the same in both spaces
+	auto hit = bvh->intersectRay(point_Mesh, dir_Mesh);
+	if (!hit)
+		return {};
+
+	hit->point = point + dir.xyz() * hit->t;
+	hit->normal = transformNormal(hit->normal, invMeshT);
+	return hit;
+}
+
+ConvexHullColliderComponent* ConvexHullColliderComponent::setMesh(const Mesh& mesh, uint maxVertices)
+{
+	ConvexHull hull = ConvexHull::build(mesh, maxVertices);
+	vertices = std::move(hull.vertices);
+	for (auto& vertex : vertices)
+		vertex.w = 1.0f;
+	return this;
+}
+
+std::optional<RayIntersectResult> HeightfieldColliderComponent::intersectRay(const V4& point, const V4& dir) const
+{
+	if (!heightfield)
+		return {};
+
+	Mtx heightfieldT = getTransform();
+	Mtx invHeightfieldT = heightfieldT.inversedTransform();
+	V4 point_Heightfield = V4{ point.x, point.y, point.z, 1.0f } * invHeightfieldT;
+	V4 dir_Heightfield = dir.xyz() * invHeightfieldT;
+
+	auto hit = heightfield->intersectRay(point_Heightfield, dir_Heightfield);
+	if (!hit)
+		return {};
+
+	hit->point = point + dir.xyz() * hit->t;
+	hit->normal = transformNormal(hit->normal, invHeightfieldT);
+	return hit;
+}
+
+void CapsuleColliderComponent::getWorldSegment(V4& a, V4& b, float& worldRadius) const
+{
+	Mtx t = getTransform();
+	a = V4{ 0.0f, 0.0f, -halfHeight, 1.0f } * t;
+	b = V4{ 0.0f, 0.0f, halfHeight, 1.0f } * t;
+	// capsules are expected to be uniformly scaled
+	worldRadius = radius * t.getScale().x;
+}
+
 const Mtx& ColliderComponent::getLocalTransform() const
 {
 	return transform;
@@ -89,6 +175,107 @@ class PlanePlaneCollisionMediator : public CollisionMediator
 	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override { return {}; }
 };
 
+class SphereTriangleMeshCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class SphereConvexHullCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class BoxConvexHullCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class PlaneConvexHullCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class ConvexHullConvexHullCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class SphereCapsuleCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class BoxCapsuleCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class PlaneCapsuleCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class BoxTriangleMeshCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class TriangleMeshConvexHullCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class TriangleMeshCapsuleCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class ConvexHullCapsuleCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class CapsuleCapsuleCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class SphereHeightfieldCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class BoxHeightfieldCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class ConvexHullHeightfieldCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+class CapsuleHeightfieldCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override;
+};
+
+// Pairs of static shapes that never need to collide, e.g. level geometry against level geometry. A dynamic body
+// would fall straight through them, so one showing up here is a bug.
+class NoCollisionMediator : public CollisionMediator
+{
+	virtual std::optional<Collision> intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const override
+	{
+		auto isDynamic = [](const ColliderComponent& collider)
+		{
+			const PhysicsComponent* physics = collider.getActor()->getComponent<PhysicsComponent>();
+			return physics && (physics->getFlags() & PhysicsComponent::Dynamic);
+		};
+		assert(!isDynamic(collider1) && !isDynamic(collider2));
+		return {};
+	}
+};
+
 GeneralCollisionMediator::GeneralCollisionMediator()
 {
 	mediators[{ColliderComponent::Type::Sphere, ColliderComponent::Type::Sphere}] = new SphereSphereCollisionMediator;
@@ -97,6 +284,28 @@ GeneralCollisionMediator::GeneralCollisionMediator()
 	mediators[{ColliderComponent::Type::Box, ColliderComponent::Type::Box}] = new BoxBoxCollisionMediator;
 	mediators[{ColliderComponent::Type::Box, ColliderComponent::Type::Plane}] = new BoxPlaneCollisionMediator;
 	mediators[{ColliderComponent::Type::Plane, ColliderComponent::Type::Plane}] = new PlanePlaneCollisionMediator;
+	mediators[{ColliderComponent::Type::Sphere, ColliderComponent::Type::TriangleMesh}] = new SphereTriangleMeshCollisionMediator;
+	mediators[{ColliderComponent::Type::Box, ColliderComponent::Type::TriangleMesh}] = new BoxTriangleMeshCollisionMediator;
+	mediators[{ColliderComponent::Type::Plane, ColliderComponent::Type::TriangleMesh}] = new NoCollisionMediator;
+	mediators[{ColliderComponent::Type::TriangleMesh, ColliderComponent::Type::TriangleMesh}] = new NoCollisionMediator;
+	mediators[{ColliderComponent::Type::Sphere, ColliderComponent::Type::ConvexHull}] = new SphereConvexHullCollisionMediator;
+	mediators[{ColliderComponent::Type::Box, ColliderComponent::Type::ConvexHull}] = new BoxConvexHullCollisionMediator;
+	mediators[{ColliderComponent::Type::Plane, ColliderComponent::Type::ConvexHull}] = new PlaneConvexHullCollisionMediator;
+	mediators[{ColliderComponent::Type::TriangleMesh, ColliderComponent::Type::ConvexHull}] = new TriangleMeshConvexHullCollisionMediator;
+	mediators[{ColliderComponent::Type::ConvexHull, ColliderComponent::Type::ConvexHull}] = new ConvexHullConvexHullCollisionMediator;
+	mediators[{ColliderComponent::Type::Sphere, ColliderComponent::Type::Capsule}] = new SphereCapsuleCollisionMediator;
+	mediators[{ColliderComponent::Type::Box, ColliderComponent::Type::Capsule}] = new BoxCapsuleCollisionMediator;
+	mediators[{ColliderComponent::Type::Plane, ColliderComponent::Type::Capsule}] = new PlaneCapsuleCollisionMediator;
+	mediators[{ColliderComponent::Type::TriangleMesh, ColliderComponent::Type::Capsule}] = new TriangleMeshCapsuleCollisionMediator;
+	mediators[{ColliderComponent::Type::ConvexHull, ColliderComponent::Type::Capsule}] = new ConvexHullCapsuleCollisionMediator;
+	mediators[{ColliderComponent::Type::Capsule, ColliderComponent::Type::Capsule}] = new CapsuleCapsuleCollisionMediator;
+	mediators[{ColliderComponent::Type::Sphere, ColliderComponent::Type::Heightfield}] = new SphereHeightfieldCollisionMediator;
+	mediators[{ColliderComponent::Type::Box, ColliderComponent::Type::Heightfield}] = new BoxHeightfieldCollisionMediator;
+	mediators[{ColliderComponent::Type::Plane, ColliderComponent::Type::Heightfield}] = new NoCollisionMediator;
+	mediators[{ColliderComponent::Type::TriangleMesh, ColliderComponent::Type::Heightfield}] = new NoCollisionMediator;
+	mediators[{ColliderComponent::Type::ConvexHull, ColliderComponent::Type::Heightfield}] = new ConvexHullHeightfieldCollisionMediator;
+	mediators[{ColliderComponent::Type::Capsule, ColliderComponent::Type::Heightfield}] = new CapsuleHeightfieldCollisionMediator;
+	mediators[{ColliderComponent::Type::Heightfield, ColliderComponent::Type::Heightfield}] = new NoCollisionMediator;
 }
 
 GeneralCollisionMediator::~GeneralCollisionMediator()
@@ -249,6 +458,388 @@ std::optional<Collision> BoxPlaneCollisionMediator::intersects(const ColliderCom
 	return {};
 }
 
+std::optional<Collision> SphereTriangleMeshCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	const MeshBVH* bvh = static_cast<const TriangleMeshColliderComponent&>(collider2).getBVH();
+	if (!bvh)
+		return {};
+
+	Mtx sphereT = collider1.getTransform();
+	Mtx meshT = collider2.getTransform();
+	Mtx invMeshT = meshT.inversedTransform();
+
+	// mesh colliders are expected to be uniformly scaled
+	float meshScale = meshT.getScale().x;
+	float r = 0.5f * V4(sphereT[0][0], sphereT[1][0], sphereT[2][0], 0.0f).length();
+	V4 sphereC_Mesh = sphereT.getPosition() * invMeshT;
+
+	auto hit = bvh->findClosestPoint(sphereC_Mesh, r / meshScale);
+	if (!hit)
+		return {};
+
+	V4 pos_World = hit->point * meshT;
+	V4 n = (hit->normal * meshT).xyz().normalize() * -1.0f;
+	return Collision{ pos_World, n };
+}
+
+namespace
+{
+	const V4 gjkOrigin = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const V4 gjkBoxCorners[8] =
+	{
+		{-0.5f, -0.5f, -0.5f, 1.0f}, {0.5f, -0.5f, -0.5f, 1.0f}, {-0.5f, 0.5f, -0.5f, 1.0f}, {0.5f, 0.5f, -0.5f, 1.0f},
+		{-0.5f, -0.5f, 0.5f, 1.0f}, {0.5f, -0.5f, 0.5f, 1.0f}, {-0.5f, 0.5f, 0.5f, 1.0f}, {0.5f, 0.5f, 0.5f, 1.0f}
+	};
+
+	GjkShape makeSphereShape(const ColliderComponent& sphere)
+	{
+		Mtx sphereT = sphere.getTransform();
+		float r = 0.5f * V4(sphereT[0][0], sphereT[1][0], sphereT[2][0], 0.0f).length();
+		return GjkShape{ &gjkOrigin, 1u, r, Mtx::translate(sphereT.getPosition()) };
+	}
+
+	GjkShape makeBoxShape(const ColliderComponent& box)
+	{
+		return GjkShape{ gjkBoxCorners, 8u, 0.0f, box.getTransform() };
+	}
+
+	GjkShape makeHullShape(const ConvexHullColliderComponent& hull)
+	{
+		return GjkShape{ hull.getVertices().data(), (uint)hull.getVertices().size(), 0.0f, hull.getTransform() };
+	}
+
+	// Warm started from the pair's separating axis of the last test when the caller keeps one
+	GjkResult gjkWithContext(const GjkShape& a, const GjkShape& b, std::optional<ColliderComponent::Context>& context)
+	{
+		V4* separatingAxis = context ? context->separatingAxis : nullptr;
+		GjkResult result = gjk(a, b, separatingAxis ? *separatingAxis : V4::zero(), 0.0f);
+		if (separatingAxis)
+			*separatingAxis = result.axis;
+		return result;
+	}
+
+	std::optional<Collision> intersectsConvexHull(const GjkShape& shape, const ConvexHullColliderComponent& hull, std::optional<ColliderComponent::Context>& context)
+	{
+		if (hull.getVertices().empty())
+			return {};
+
+		GjkResult result = gjkWithContext(shape, makeHullShape(hull), context);
+		if (!result.overlap)
+			return {};
+		return Collision{ result.pointA, result.normal };
+	}
+}
+
+std::optional<Collision> SphereConvexHullCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	return intersectsConvexHull(makeSphereShape(collider1), static_cast<const ConvexHullColliderComponent&>(collider2), context);
+}
+
+std::optional<Collision> BoxConvexHullCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	return intersectsConvexHull(makeBoxShape(collider1), static_cast<const ConvexHullColliderComponent&>(collider2), context);
+}
+
+std::optional<Collision> PlaneConvexHullCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	auto& hull = static_cast<const ConvexHullColliderComponent&>(collider2);
+	if (hull.getVertices().empty())
+		return {};
+
+	V4 planeEq = static_cast<const PlaneColliderComponent&>(collider1).getEquation();
+	V4 normal = planeEq.xyz();
+	float invLength = 1.0f / normal.length();
+	normal = normal * invLength;
+
+	// like the sphere test the plane is two-sided, the hull collides when its extents straddle it
+	GjkShape shape = makeHullShape(hull);
+	V4 maxVertex = shape.support(normal);
+	V4 minVertex = shape.support(normal * -1.0f);
+	float offset = planeEq.w * invLength;
+	float dMax = normal.dot(maxVertex.xyz()) + offset;
+	float dMin = normal.dot(minVertex.xyz()) + offset;
+	if (dMin >= 0.0f || dMax <= 0.0f)
+		return {};
+
+	if (dMin + dMax > 0.0f)
+		return Collision{ minVertex - normal * dMin, normal };
+	return Collision{ maxVertex - normal * dMax, normal * -1.0f };
+}
+
+std::optional<Collision> ConvexHullConvexHullCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	auto& hull1 = static_cast<const ConvexHullColliderComponent&>(collider1);
+	if (hull1.getVertices().empty())
+		return {};
+	return intersectsConvexHull(makeHullShape(hull1), static_cast<const ConvexHullColliderComponent&>(collider2), context);
+}
+
+namespace
+{
+	float closestParameterOnSegment(const V4& p, const V4& a, const V4& b)
+	{
+		V4 ab = b - a;
+		float length2 = ab.dot(ab);
+		if (length2 <= FLT_EPSILON)
+			return 0.0f;
+		return std::clamp((p - a).dot(ab) / length2, 0.0f, 1.0f);
+	}
+
+	std::optional<Collision> intersectSpheres(const V4& c1, float r1, const V4& c2, float r2)
+	{
+		V4 dist = c2 - c1;
+		float r = r1 + r2;
+		if (dist.length2() >= r * r)
+			return {};
+
+		V4 n = dist.normalize();
+		if (n.length2() == 0.0f)
+			n = { 0.0f, 0.0f, 1.0f };
+		return Collision{ c1 + n * r1, n };
+	}
+
+	GjkShape makeCapsuleShape(const CapsuleColliderComponent& capsule, V4* segment)
+	{
+		float r = 0.0f;
+		capsule.getWorldSegment(segment[0], segment[1], r);
+		return GjkShape{ segment, 2u, r, Mtx::identity() };
+	}
+}
+
+std::optional<Collision> SphereCapsuleCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	Mtx sphereT = collider1.getTransform();
+	float rs = 0.5f * V4(sphereT[0][0], sphereT[1][0], sphereT[2][0], 0.0f).length();
+	V4 sphereC = sphereT.getPosition();
+
+	V4 a, b;
+	float rc = 0.0f;
+	static_cast<const CapsuleColliderComponent&>(collider2).getWorldSegment(a, b, rc);
+	V4 closest = a + (b - a) * closestParameterOnSegment(sphereC, a, b);
+	return intersectSpheres(sphereC, rs, closest, rc);
+}
+
+std::optional<Collision> BoxCapsuleCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	// the box and the capsule segment are both convex hulls, GJK gives their exact closest points and EPA
+	// the push out direction when the segment goes through the box
+	V4 segment[2];
+	GjkResult result = gjkWithContext(makeBoxShape(collider1), makeCapsuleShape(static_cast<const CapsuleColliderComponent&>(collider2), segment), context);
+	if (!result.overlap)
+		return {};
+	return Collision{ result.pointA, result.normal };
+}
+
+std::optional<Collision> PlaneCapsuleCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	V4 planeEq = static_cast<const PlaneColliderComponent&>(collider1).getEquation();
+	V4 normal = planeEq.xyz();
+	float invLength = 1.0f / normal.length();
+	normal = normal * invLength;
+	float offset = planeEq.w * invLength;
+
+	V4 a, b;
+	float r = 0.0f;
+	static_cast<const CapsuleColliderComponent&>(collider2).getWorldSegment(a, b, r);
+	float da = normal.dot(a.xyz()) + offset;
+	float db = normal.dot(b.xyz()) + offset;
+
+	// two-sided like the sphere test
+	if (da * db < 0.0f)
+	{
+		float side = da + db >= 0.0f ? 1.0f : -1.0f;
+		const V4& deepest = da * side < db * side ? a : b;
+		float d = da * side < db * side ? da : db;
+		return Collision{ deepest - normal * d, normal * side };
+	}
+
+	const V4& closest = fabs(da) < fabs(db) ? a : b;
+	float d = fabs(da) < fabs(db) ? da : db;
+	if (fabs(d) < r)
+		return Collision{ closest - normal * d, d >= 0.0f ? normal : normal * -1.0f };
+
+	return {};
+}
+
+namespace
+{
+	// The normal points from the shape towards the mesh
+	std::optional<Collision> intersectsTriangleMesh(GjkShape shape, const ColliderComponent& meshCollider)
+	{
+		const MeshBVH* bvh = static_cast<const TriangleMeshColliderComponent&>(meshCollider).getBVH();
+		if (!bvh)
+			return {};
+
+		Mtx meshT = meshCollider.getTransform();
+		shape.transform = shape.transform * meshT.inversedTransform();
+		auto hit = bvh->findConvexContact(shape);
+		if (!hit)
+			return {};
+
+		V4 pos_World = hit->point * meshT;
+		V4 n = (hit->normal * meshT).xyz().normalize() * -1.0f;
+		return Collision{ pos_World, n };
+	}
+}
+
+std::optional<Collision> BoxTriangleMeshCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	return intersectsTriangleMesh(makeBoxShape(collider1), collider2);
+}
+
+std::optional<Collision> TriangleMeshConvexHullCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	auto& hull = static_cast<const ConvexHullColliderComponent&>(collider2);
+	if (hull.getVertices().empty())
+		return {};
+
+	auto collision = intersectsTriangleMesh(makeHullShape(hull), collider1);
+	if (collision)
+		collision->normal *= -1.0f;
+	return collision;
+}
+
+std::optional<Collision> TriangleMeshCapsuleCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	const MeshBVH* bvh = static_cast<const TriangleMeshColliderComponent&>(collider1).getBVH();
+	if (!bvh)
+		return {};
+
+	Mtx meshT = collider1.getTransform();
+	Mtx invMeshT = meshT.inversedTransform();
+	float meshScale = meshT.getScale().x;
+
+	V4 a, b;
+	float r = 0.0f;
+	static_cast<const CapsuleColliderComponent&>(collider2).getWorldSegment(a, b, r);
+
+	auto hit = bvh->findClosestPointToSegment(a * invMeshT, b * invMeshT, r / meshScale);
+	if (!hit)
+		return {};
+
+	V4 pos_World = hit->point * meshT;
+	V4 n = (hit->normal * meshT).xyz().normalize();
+	return Collision{ pos_World, n };
+}
+
+std::optional<Collision> ConvexHullCapsuleCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	auto& hull = static_cast<const ConvexHullColliderComponent&>(collider1);
+	if (hull.getVertices().empty())
+		return {};
+
+	V4 segment[2];
+	GjkResult result = gjkWithContext(makeHullShape(hull), makeCapsuleShape(static_cast<const CapsuleColliderComponent&>(collider2), segment), context);
+	if (!result.overlap)
+		return {};
+	return Collision{ result.pointA, result.normal };
+}
+
+std::optional<Collision> CapsuleCapsuleCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	V4 a1, b1, a2, b2;
+	float r1 = 0.0f, r2 = 0.0f;
+	static_cast<const CapsuleColliderComponent&>(collider1).getWorldSegment(a1, b1, r1);
+	static_cast<const CapsuleColliderComponent&>(collider2).getWorldSegment(a2, b2, r2);
+
+	V4 c1, c2;
+	closestPointsSegmentSegment(a1, b1, a2, b2, c1, c2);
+	return intersectSpheres(c1, r1, c2, r2);
+}
+
+std::optional<Collision> SphereHeightfieldCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	const Heightfield* heightfield = static_cast<const HeightfieldColliderComponent&>(collider2).getHeightfield();
+	if (!heightfield)
+		return {};
+
+	Mtx sphereT = collider1.getTransform();
+	Mtx heightfieldT = collider2.getTransform();
+	Mtx invHeightfieldT = heightfieldT.inversedTransform();
+
+	// heightfield colliders are expected to be uniformly scaled
+	float heightfieldScale = heightfieldT.getScale().x;
+	float r = 0.5f * V4(sphereT[0][0], sphereT[1][0], sphereT[2][0], 0.0f).length();
+	V4 sphereC_Heightfield = sphereT.getPosition() * invHeightfieldT;
+
+	auto hit = heightfield->findClosestPoint(sphereC_Heightfield, r / heightfieldScale);
+	if (!hit)
+		return {};
+
+	V4 pos_World = hit->point * heightfieldT;
+	V4 n = (hit->normal * heightfieldT).xyz().normalize() * -1.0f;
+	return Collision{ pos_World, n };
+}
+
+namespace
+{
+	std::optional<Collision> intersectsHeightfield(GjkShape shape, const ColliderComponent& heightfieldCollider)
+	{
+		const Heightfield* heightfield = static_cast<const HeightfieldColliderComponent&>(heightfieldCollider).getHeightfield();
+		if (!heightfield)
+			return {};
+
+		Mtx heightfieldT = heightfieldCollider.getTransform();
+		shape.transform = shape.transform * heightfieldT.inversedTransform();
+		auto hit = heightfield->findConvexContact(shape);
+		if (!hit)
+			return {};
+
+		V4 pos_World = hit->point * heightfieldT;
+		V4 n = (hit->normal * heightfieldT).xyz().normalize() * -1.0f;
+		return Collision{ pos_World, n };
+	}
+}
+
+std::optional<Collision> BoxHeightfieldCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	return intersectsHeightfield(makeBoxShape(collider1), collider2);
+}
+
+std::optional<Collision> ConvexHullHeightfieldCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	auto& hull = static_cast<const ConvexHullColliderComponent&>(collider1);
+	if (hull.getVertices().empty())
+		return {};
+	return intersectsHeightfield(makeHullShape(hull), collider2);
+}
+
+std::optional<Collision> CapsuleHeightfieldCollisionMediator::intersects(const ColliderComponent& collider1, const ColliderComponent& collider2, std::optional<ColliderComponent::Context> context) const
+{
+	const Heightfield* heightfield = static_cast<const HeightfieldColliderComponent&>(collider2).getHeightfield();
+	if (!heightfield)
+		return {};
+
+	Mtx heightfieldT = collider2.getTransform();
+	Mtx invHeightfieldT = heightfieldT.inversedTransform();
+	float heightfieldScale = heightfieldT.getScale().x;
+
+	V4 a, b;
+	float r = 0.0f;
+	static_cast<const CapsuleColliderComponent&>(collider1).getWorldSegment(a, b, r);
+	a = a * invHeightfieldT;
+	b = b * invHeightfieldT;
+	r /= heightfieldScale;
+
+	// spheres spaced at most a radius apart along the segment, between two of them the union falls short of the
+	// capsule's surface by at most 0.14 radius, close enough for terrain. Long thin capsules take many spheres.
+	int numSpheres = std::max((int)ceilf((b - a).length() / std::max(r, FLT_EPSILON)) + 1, 2);
+	std::optional<Heightfield::SphereHit> deepest;
+	for (int i = 0; i < numSpheres; ++i)
+	{
+		V4 center = a + (b - a) * (i / float(numSpheres - 1));
+		auto hit = heightfield->findClosestPoint(center, r);
+		if (hit && (!deepest || hit->distance < deepest->distance))
+			deepest = hit;
+	}
+	if (!deepest)
+		return {};
+
+	V4 pos_World = deepest->point * heightfieldT;
+	V4 n = (deepest->normal * heightfieldT).xyz().normalize() * -1.0f;
+	return Collision{ pos_World, n };
+}
+
 std::optional<RayIntersectResult> intersectRayAABB(const V4& point, const V4& dir, const AABB& aabb)
 {
 	float tmin = 0.0f;
@@ -5,6 +5,9 @@
 #include "Engine/Math/Math.h"
 
 class Actor;
+class Mesh;
+class MeshBVH;
+class Heightfield;
 
 struct Collision
 {
@@ -12,6 +15,19 @@ struct Collision
 	V4 normal;
 };
 
+struct AABB
+{
+	V4 min = V4::zero();
+	V4 max = V4::zero();
+};
+
+struct RayIntersectResult
+{
+	V4 point = V4::zero();
+	float t = 0.0f;
+	V4 normal = V4::zero();
+};
+
 class ColliderComponent : public Component
 {
 public:
@@ -21,6 +37,10 @@ public:
 		Sphere,
 		Box,
 		Plane,
+		TriangleMesh,
+		ConvexHull,
+		Capsule,
+		Heightfield,
 		_Size
 	};
 
@@ -30,8 +50,16 @@ public:
 	{
 		Mtx prevPosition;
 		const ColliderComponent* owner = nullptr;
+		// Separating axis of this pair from the last test, GJK starts from it and writes the new one back.
+		// Kept by the caller per pair of colliders, see PhysicsSystem.
+		V4* separatingAxis = nullptr;
 	};
 
+	ColliderComponent();
+
+	// Never reused, unlike the collider's address, so state kept per pair can't carry over to a new collider
+	uint getSerial() const { return serial; }
+
 	std::optional<Collision> intersects(ColliderComponent& other, std::optional<Context> context) const;
 	void setLocalTransform(const Mtx& transform);
 	const Mtx& getLocalTransform() const;
@@ -39,6 +67,7 @@ public:
 
 protected:
 	Mtx transform = Mtx::identity();
+	uint serial = 0u;
 };
 
 class SphereColliderComponent : public ColliderComponent
@@ -66,17 +95,63 @@ protected:
 	V4 equation = { 0.0f, 1.0f, 1.0f, 0.0f };	
 };
 
-struct AABB
+class TriangleMeshColliderComponent : public ColliderComponent
 {
-	V4 min = V4::zero();
-	V4 max = V4::zero();
+public:
+	virtual Type getType() const override { return Type::TriangleMesh; }
+
+	TriangleMeshColliderComponent* setMesh(const Mesh& mesh);
+	const MeshBVH* getBVH() const { return bvh.get(); }
+
+	std::optional<RayIntersectResult> intersectRay(const V4& point, const V4& dir) const;
+
+protected:
+	std::shared_ptr<const MeshBVH> bvh;
 };
 
-struct RayIntersectResult
+class ConvexHullColliderComponent : public ColliderComponent
 {
-	V4 point = V4::zero();
-	float t = 0.0f;
+public:
+	virtual Type getType() const override { return Type::ConvexHull; }
+
+	ConvexHullColliderComponent* setMesh(const Mesh& mesh, uint maxVertices = 32u);
+	const std::vector<V4>& getVertices() const { return vertices; }
+
+protected:
+	std::vector<V4> vertices;
 };
+
+class CapsuleColliderComponent : public ColliderComponent
+{
+public:
+	virtual Type getType() const override { return Type::Capsule; }
+
+	// The segment runs along the local z axis, both values are in local space
+	CapsuleColliderComponent* setShape(float radius_, float halfHeight_) { radius = radius_; halfHeight = halfHeight_; return this; }
+	float getRadius() const { return radius; }
+	float getHalfHeight() const { return halfHeight; }
+
+	void getWorldSegment(V4& a, V4& b, float& worldRadius) const;
+
+protected:
+	float radius = 0.5f;
+	float halfHeight = 0.5f;
+};
+
+class HeightfieldColliderComponent : public ColliderComponent
+{
+public:
+	virtual Type getType() const override { return Type::Heightfield; }
+
+	HeightfieldColliderComponent* setHeightfield(std::shared_ptr<const Heightfield> heightfield_) { heightfield = std::move(heightfield_); return this; }
+	const Heightfield* getHeightfield() const { return heightfield.get(); }
+
+	std::optional<RayIntersectResult> intersectRay(const V4& point, const V4& dir) const;
+
+protected:
+	std::shared_ptr<const Heightfield> heightfield;
+};
+
 std::optional<RayIntersectResult> intersectRayAABB(const V4& point, const V4& dir, const AABB& aabb);
 
 void testSphereBoxCollisions();
@@ -0,0 +1,81 @@
+#include "ContactEvents.h"
+#include "Engine/Log.h"
+
+void ContactEventStream::beginStep()
+{
+	uint needed = numStepContacts.load(std::memory_order_relaxed);
+	if (needed > stepContacts.size() || stepContacts.empty())
+		stepContacts.resize(std::max<size_t>({ needed, stepContacts.size() * 2, minCapacity }));
+	numStepContacts.store(0u, std::memory_order_relaxed);
+	numStepDropped.store(0u, std::memory_order_relaxed);
+}
+
+void ContactEventStream::addContact(PhysicsComponent* physics1, PhysicsComponent* physics2, const V4& point, const V4& normal, float impulse)
+{
+	uint index = numStepContacts.fetch_add(1u, std::memory_order_relaxed);
+	if (index >= stepContacts.size())
+	{
+		numStepDropped.fetch_add(1u, std::memory_order_relaxed);
+		return;
+	}
+
+	auto& contact = stepContacts[index];
+	contact.key = { std::min(physics1, physics2), std::max(physics1, physics2) };
+	contact.event = { ContactEvent::Type::Persist, physics1, physics2, point, normal, impulse };
+}
+
+void ContactEventStream::endStep(std::span<const PhysicsComponent* const> liveBodies)
+{
+	uint count = std::min(numStepContacts.load(std::memory_order_acquire), (uint)stepContacts.size());
+	if (uint dropped = numStepDropped.load(std::memory_order_relaxed))
+	{
+		numDropped += dropped;
+		logLine(x, Verbose, "Contact buffer full, dropped {} contacts, growing to {}", dropped, count + dropped);
+	}
+
+	// a pair can be reported more than once per step, e.g. once from each dynamic body, keep the first one
+	std::stable_sort(stepContacts.begin(), stepContacts.begin() + count, [](const Contact& a, const Contact& b) { return a.key < b.key; });
+	nextTouching.clear();
+	for (uint i = 0; i < count; ++i)
+	{
+		if (nextTouching.empty() || nextTouching.back().key != stepContacts[i].key)
+			nextTouching.push_back(stepContacts[i]);
+	}
+
+	// merge against the previous step: new pairs begin, shared pairs persist, missing pairs end
+	size_t prev = 0, next = 0;
+	while (prev < touching.size() || next < nextTouching.size())
+	{
+		if (next == nextTouching.size() || (prev < touching.size() && touching[prev].key < nextTouching[next].key))
+		{
+			const Contact& ended = touching[prev++];
+			if (std::binary_search(liveBodies.begin(), liveBodies.end(), ended.key.first) && std::binary_search(liveBodies.begin(), liveBodies.end(), ended.key.second))
+			{
+				events.push_back(ended.event);
+				events.back().type = ContactEvent::Type::End;
+			}
+		}
+		else if (prev == touching.size() || nextTouching[next].key < touching[prev].key)
+		{
+			events.push_back(nextTouching[next++].event);
+			events.back().type = ContactEvent::Type::Begin;
+		}
+		else
+		{
+			events.push_back(nextTouching[next++].event);
+			events.back().type = ContactEvent::Type::Persist;
+			++prev;
+		}
+	}
+	std::swap(touching, nextTouching);
+}
+
+void ContactEventStream::dispatch()
+{
+	if (!events.empty())
+	{
+		for (auto& listener : listeners)
+			listener(events);
+	}
+	events.clear();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include <atomic>
+#include <functional>
+#include <span>
+
+class PhysicsComponent;
+
+struct ContactEvent
+{
+	enum class Type : uchar
+	{
+		Begin,
+		Persist,
+		End
+	};
+
+	Type type = Type::Begin;
+	PhysicsComponent* physics1 = nullptr;
+	PhysicsComponent* physics2 = nullptr;
+	V4 point = V4::zero(); // End events keep the last contact seen
+	V4 normal = V4::zero();
+	float impulse = 0.0f;
+};
+
+// Contacts found during a physics step turned into begin/persist/end events.
+// The solver only appends raw contacts: a writer reserves its slot with a single atomic increment,
+// so physics workers never lock. The buffer is sized between steps from the previous step's count,
+// contacts that do not fit are dropped and counted, and the buffer grows for the next step.
+// Events pile up until dispatch() hands all of them to every listener in one call, once per frame.
+class ContactEventStream
+{
+public:
+
+	using Listener = std::function<void(std::span<const ContactEvent>)>;
+
+	void beginStep();
+	void addContact(PhysicsComponent* physics1, PhysicsComponent* physics2, const V4& point, const V4& normal, float impulse);
+	// liveBodies are the bodies of this step, sorted. Pairs with a body that is gone end without an event,
+	// so no event ever points to a destroyed body.
+	void endStep(std::span<const PhysicsComponent* const> liveBodies);
+
+	void addListener(Listener listener) { listeners.push_back(std::move(listener)); }
+	void dispatch();
+
+	std::span<const ContactEvent> getEvents() const { return events; }
+	uint getNumDroppedContacts() const { return numDropped; }
+
+private:
+
+	friend class PhysicsSnapshot;
+
+	static constexpr size_t minCapacity = 256u;
+
+	struct Contact
+	{
+		std::pair<const PhysicsComponent*, const PhysicsComponent*> key; // ordered, so both directions match
+		ContactEvent event;
+	};
+
+	std::vector<Contact> stepContacts;
+	std::atomic<uint> numStepContacts = 0u;
+	std::atomic<uint> numStepDropped = 0u;
+	uint numDropped = 0u;
+
+	std::vector<Contact> touching; // sorted by key, from the last finished step
+	std::vector<Contact> nextTouching;
+	std::vector<ContactEvent> events;
+	std::vector<Listener> listeners;
+};
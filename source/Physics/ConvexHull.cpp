@@ -0,0 +1,261 @@
+#include "ConvexHull.h"
+#include "Animation/Mesh.h"
+#include "Engine/Log.h"
+
+namespace
+{
+	struct HullFace
+	{
+		uint v[3];
+		V4 normal;
+		float offset = 0.0f;
+		std::vector<uint> outside;
+		uint farthest = 0u;
+		float farthestDistance = 0.0f;
+		bool alive = true;
+
+		float distance(const V4& p) const { return normal.dot(p) - offset; }
+	};
+
+	uint64 edgeKey(uint a, uint b)
+	{
+		return ((uint64)a << 32) | b;
+	}
+
+	float distanceToLine(const V4& p, const V4& a, const V4& b)
+	{
+		return (p - a).cross(b - a).length() / (b - a).length();
+	}
+
+	// Keeps only the distinct extreme points of a flat or degenerate point set
+	ConvexHull buildDegenerate(const std::vector<V4>& points, const uint* extremes, uint maxVertices)
+	{
+		ConvexHull hull;
+		for (int i = 0; i < 6 && hull.vertices.size() < maxVertices; ++i)
+		{
+			const V4& p = points[extremes[i]];
+			if (std::find(hull.vertices.begin(), hull.vertices.end(), p) == hull.vertices.end())
+				hull.vertices.push_back(p);
+		}
+		return hull;
+	}
+}
+
+ConvexHull ConvexHull::build(const Mesh& mesh, uint maxVertices)
+{
+	std::vector<V4> points;
+	points.reserve(mesh.getVertices().size());
+	for (auto& vertex : mesh.getVertices())
+		points.emplace_back(vertex.pos.x, vertex.pos.y, vertex.pos.z);
+	return build(points, maxVertices);
+}
+
+ConvexHull ConvexHull::build(const std::vector<V4>& points, uint maxVertices)
+{
+	assert(maxVertices >= 4);
+	if (points.empty())
+		return {};
+
+	// extreme points along the axes: min x, max x, min y, max y, min z, max z
+	uint extremes[6] = {};
+	for (uint i = 0; i < points.size(); ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (points[i][axis] < points[extremes[axis * 2]][axis])
+				extremes[axis * 2] = i;
+			if (points[i][axis] > points[extremes[axis * 2 + 1]][axis])
+				extremes[axis * 2 + 1] = i;
+		}
+	}
+
+	float extent = 0.0f;
+	uint i0 = extremes[0], i1 = extremes[1];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float axisExtent = points[extremes[axis * 2 + 1]][axis] - points[extremes[axis * 2]][axis];
+		if (axisExtent > extent)
+		{
+			extent = axisExtent;
+			i0 = extremes[axis * 2];
+			i1 = extremes[axis * 2 + 1];
+		}
+	}
+	const float eps = std::max(extent, 1.0f) * 1e-5f;
+	if (extent <= eps)
+		return buildDegenerate(points, extremes, maxVertices);
+
+	uint i2 = i0;
+	float bestDistance = 0.0f;
+	for (uint i = 0; i < points.size(); ++i)
+	{
+		float d = distanceToLine(points[i], points[i0], points[i1]);
+		if (d > bestDistance)
+		{
+			bestDistance = d;
+			i2 = i;
+		}
+	}
+	if (bestDistance <= eps)
+		return buildDegenerate(points, extremes, maxVertices);
+
+	V4 baseNormal = (points[i1] - points[i0]).cross(points[i2] - points[i0]).normalize();
+	uint i3 = i0;
+	bestDistance = 0.0f;
+	for (uint i = 0; i < points.size(); ++i)
+	{
+		float d = fabs(baseNormal.dot(points[i] - points[i0]));
+		if (d > bestDistance)
+		{
+			bestDistance = d;
+			i3 = i;
+		}
+	}
+	if (bestDistance <= eps)
+		return buildDegenerate(points, extremes, maxVertices);
+
+	const V4 interior = (points[i0] + points[i1] + points[i2] + points[i3]) / 4.0f;
+	std::vector<HullFace> faces;
+
+	auto addFace = [&](uint a, uint b, uint c)
+	{
+		HullFace face;
+		face.normal = (points[b] - points[a]).cross(points[c] - points[a]).normalize();
+		if (face.normal.dot(interior - points[a]) > 0.0f)
+		{
+			std::swap(b, c);
+			face.normal = face.normal * -1.0f;
+		}
+		face.v[0] = a;
+		face.v[1] = b;
+		face.v[2] = c;
+		face.offset = face.normal.dot(points[a]);
+		faces.push_back(std::move(face));
+	};
+
+	auto assignPoint = [&](uint point, uint firstFace)
+	{
+		uint bestFace = (uint)-1;
+		float bestFaceDistance = eps;
+		for (uint f = firstFace; f < faces.size(); ++f)
+		{
+			float d = faces[f].distance(points[point]);
+			if (faces[f].alive && d > bestFaceDistance)
+			{
+				bestFaceDistance = d;
+				bestFace = f;
+			}
+		}
+		if (bestFace == (uint)-1)
+			return;
+
+		auto& face = faces[bestFace];
+		face.outside.push_back(point);
+		if (bestFaceDistance > face.farthestDistance)
+		{
+			face.farthestDistance = bestFaceDistance;
+			face.farthest = point;
+		}
+	};
+
+	addFace(i0, i1, i2);
+	addFace(i0, i3, i1);
+	addFace(i1, i3, i2);
+	addFace(i2, i3, i0);
+	for (uint i = 0; i < points.size(); ++i)
+	{
+		if (i != i0 && i != i1 && i != i2 && i != i3)
+			assignPoint(i, 0);
+	}
+
+	uint numVertices = 4;
+	std::vector<uint> visible;
+	std::vector<std::pair<uint, uint>> horizon;
+	std::vector<uint> orphans;
+	std::unordered_set<uint64> visibleEdges;
+	while (numVertices < maxVertices)
+	{
+		uint expandedFace = (uint)-1;
+		float farthestDistance = 0.0f;
+		for (uint f = 0; f < faces.size(); ++f)
+		{
+			if (faces[f].alive && !faces[f].outside.empty() && faces[f].farthestDistance > farthestDistance)
+			{
+				farthestDistance = faces[f].farthestDistance;
+				expandedFace = f;
+			}
+		}
+		if (expandedFace == (uint)-1)
+			break;
+
+		uint apex = faces[expandedFace].farthest;
+		const V4& apexPoint = points[apex];
+
+		visible.clear();
+		visibleEdges.clear();
+		for (uint f = 0; f < faces.size(); ++f)
+		{
+			if (faces[f].alive && (f == expandedFace || faces[f].distance(apexPoint) > eps))
+			{
+				visible.push_back(f);
+				for (int e = 0; e < 3; ++e)
+					visibleEdges.insert(edgeKey(faces[f].v[e], faces[f].v[(e + 1) % 3]));
+			}
+		}
+
+		horizon.clear();
+		orphans.clear();
+		for (uint f : visible)
+		{
+			auto& face = faces[f];
+			face.alive = false;
+			for (int e = 0; e < 3; ++e)
+			{
+				uint a = face.v[e];
+				uint b = face.v[(e + 1) % 3];
+				if (!visibleEdges.contains(edgeKey(b, a)))
+					horizon.emplace_back(a, b);
+			}
+			for (uint point : face.outside)
+			{
+				if (point != apex)
+					orphans.push_back(point);
+			}
+			face.outside.clear();
+			face.outside.shrink_to_fit();
+		}
+
+		uint firstNewFace = (uint)faces.size();
+		for (auto [a, b] : horizon)
+			addFace(a, b, apex);
+		for (uint point : orphans)
+			assignPoint(point, firstNewFace);
+
+		std::unordered_set<uint> used;
+		for (auto& face : faces)
+		{
+			if (face.alive)
+				used.insert(face.v, face.v + 3);
+		}
+		numVertices = (uint)used.size();
+	}
+
+	ConvexHull hull;
+	std::unordered_map<uint, uint> remap;
+	for (auto& face : faces)
+	{
+		if (!face.alive)
+			continue;
+
+		for (uint v : face.v)
+		{
+			auto [it, inserted] = remap.try_emplace(v, (uint)hull.vertices.size());
+			if (inserted)
+				hull.vertices.push_back(points[v]);
+			hull.indices.push_back(it->second);
+		}
+	}
+
+	logLine(x, Verbose, "Built a convex hull: {} points -> {} vertices, {} faces", points.size(), hull.vertices.size(), hull.indices.size() / 3);
+	return hull;
+}
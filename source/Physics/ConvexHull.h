@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+
+class Mesh;
+
+struct ConvexHull
+{
+	// Quickhull that always expands the face with the farthest outside point first,
+	// so stopping at maxVertices keeps the vertices that matter most for the shape
+	static ConvexHull build(const std::vector<V4>& points, uint maxVertices = 32u);
+	static ConvexHull build(const Mesh& mesh, uint maxVertices = 32u);
+
+	std::vector<V4> vertices;
+	std::vector<uint> indices; // 3 per face, counter-clockwise seen from outside
+};
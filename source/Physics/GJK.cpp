@@ -0,0 +1,441 @@
+#include "GJK.h"
+
+namespace
+{
+	constexpr int maxGjkIterations = 64;
+	constexpr int maxEpaIterations = 64;
+	constexpr float gjkTolerance = 1e-6f;
+	constexpr float epaTolerance = 1e-4f;
+
+	struct SimplexVertex
+	{
+		V4 w; // a - b
+		V4 a;
+		V4 b;
+	};
+
+	struct Simplex
+	{
+		void keep(std::initializer_list<int> indices, std::initializer_list<float> newWeights)
+		{
+			SimplexVertex kept[4];
+			int n = 0;
+			for (int i : indices)
+				kept[n++] = vertices[i];
+			std::copy(kept, kept + n, vertices);
+			std::copy(newWeights.begin(), newWeights.end(), weights);
+			size = n;
+		}
+
+		V4 closestPoint() const
+		{
+			V4 v = V4::zero();
+			for (int i = 0; i < size; ++i)
+				v += vertices[i].w * weights[i];
+			return v;
+		}
+
+		SimplexVertex vertices[4];
+		float weights[4] = {};
+		int size = 0;
+	};
+
+	SimplexVertex support(const GjkShape& a, const GjkShape& b, const V4& dir)
+	{
+		SimplexVertex v;
+		v.a = a.support(dir);
+		v.b = b.support(dir * -1.0f);
+		v.w = v.a - v.b;
+		return v;
+	}
+
+	void solveSegment(Simplex& s)
+	{
+		const V4& a = s.vertices[0].w;
+		V4 ab = s.vertices[1].w - a;
+		float t = -a.dot(ab) / ab.dot(ab);
+		if (!(t > 0.0f))
+			s.keep({ 0 }, { 1.0f });
+		else if (t >= 1.0f)
+			s.keep({ 1 }, { 1.0f });
+		else
+			s.keep({ 0, 1 }, { 1.0f - t, t });
+	}
+
+	// Ericson, Real-Time Collision Detection, 5.1.5, with the origin as the query point
+	void solveTriangle(Simplex& s)
+	{
+		const V4& a = s.vertices[0].w;
+		const V4& b = s.vertices[1].w;
+		const V4& c = s.vertices[2].w;
+		V4 ab = b - a;
+		V4 ac = c - a;
+		float d1 = -ab.dot(a);
+		float d2 = -ac.dot(a);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			return s.keep({ 0 }, { 1.0f });
+
+		float d3 = -ab.dot(b);
+		float d4 = -ac.dot(b);
+		if (d3 >= 0.0f && d4 <= d3)
+			return s.keep({ 1 }, { 1.0f });
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		{
+			float t = d1 / (d1 - d3);
+			return s.keep({ 0, 1 }, { 1.0f - t, t });
+		}
+
+		float d5 = -ab.dot(c);
+		float d6 = -ac.dot(c);
+		if (d6 >= 0.0f && d5 <= d6)
+			return s.keep({ 2 }, { 1.0f });
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		{
+			float t = d2 / (d2 - d6);
+			return s.keep({ 0, 2 }, { 1.0f - t, t });
+		}
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		{
+			float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			return s.keep({ 1, 2 }, { 1.0f - t, t });
+		}
+
+		float denom = 1.0f / (va + vb + vc);
+		float v = vb * denom;
+		float w = vc * denom;
+		s.keep({ 0, 1, 2 }, { 1.0f - v - w, v, w });
+	}
+
+	// Returns true when the origin is inside the tetrahedron
+	bool solveTetrahedron(Simplex& s)
+	{
+		static constexpr int faces[4][4] = { {0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0} };
+
+		Simplex best;
+		float bestDistance2 = std::numeric_limits<float>::max();
+		bool outsideAny = false;
+		for (auto& face : faces)
+		{
+			const V4& a = s.vertices[face[0]].w;
+			V4 n = (s.vertices[face[1]].w - a).cross(s.vertices[face[2]].w - a);
+			float signOrigin = -n.dot(a);
+			float signOpposite = n.dot(s.vertices[face[3]].w - a);
+			if (signOrigin * signOpposite > 0.0f)
+				continue;
+
+			outsideAny = true;
+			Simplex faceSimplex;
+			faceSimplex.vertices[0] = s.vertices[face[0]];
+			faceSimplex.vertices[1] = s.vertices[face[1]];
+			faceSimplex.vertices[2] = s.vertices[face[2]];
+			faceSimplex.size = 3;
+			solveTriangle(faceSimplex);
+			float distance2 = faceSimplex.closestPoint().length2();
+			if (distance2 < bestDistance2)
+			{
+				bestDistance2 = distance2;
+				best = faceSimplex;
+			}
+		}
+
+		if (!outsideAny)
+			return true;
+
+		s = best;
+		return false;
+	}
+
+	bool solve(Simplex& s)
+	{
+		switch (s.size)
+		{
+		case 1: s.weights[0] = 1.0f; return false;
+		case 2: solveSegment(s); return false;
+		case 3: solveTriangle(s); return false;
+		case 4: return solveTetrahedron(s);
+		}
+		return false;
+	}
+
+	V4 barycentric(const V4& p, const V4& a, const V4& b, const V4& c)
+	{
+		V4 v0 = b - a;
+		V4 v1 = c - a;
+		V4 v2 = p - a;
+		float d00 = v0.dot(v0);
+		float d01 = v0.dot(v1);
+		float d11 = v1.dot(v1);
+		float d20 = v2.dot(v0);
+		float d21 = v2.dot(v1);
+		float denom = d00 * d11 - d01 * d01;
+		if (fabs(denom) < FLT_EPSILON)
+			return { 1.0f, 0.0f, 0.0f };
+		float v = (d11 * d20 - d01 * d21) / denom;
+		float w = (d00 * d21 - d01 * d20) / denom;
+		return { 1.0f - v - w, v, w };
+	}
+
+	// Grows a touching simplex into a tetrahedron, EPA needs a volume to start from
+	bool completeTetrahedron(const GjkShape& a, const GjkShape& b, std::vector<SimplexVertex>& vertices)
+	{
+		const float eps = 1e-5f;
+		static const V4 axes[6] = { {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f} };
+		if (vertices.size() == 1)
+		{
+			for (auto& axis : axes)
+			{
+				auto v = support(a, b, axis);
+				if ((v.w - vertices[0].w).length2() > eps)
+				{
+					vertices.push_back(v);
+					break;
+				}
+			}
+		}
+		if (vertices.size() == 2)
+		{
+			V4 d = (vertices[1].w - vertices[0].w).normalize();
+			V4 perp = d.getOrthogonal().normalize();
+			for (int i = 0; i < 6; ++i)
+			{
+				V4 dir = Quat(d, i * PI / 3.0f).rotate(perp);
+				auto v = support(a, b, dir);
+				if ((v.w - vertices[0].w).cross(d).length2() > eps)
+				{
+					vertices.push_back(v);
+					break;
+				}
+			}
+		}
+		if (vertices.size() == 3)
+		{
+			V4 n = (vertices[1].w - vertices[0].w).cross(vertices[2].w - vertices[0].w).normalize();
+			auto v = support(a, b, n);
+			if (fabs(n.dot(v.w - vertices[0].w)) <= eps)
+				v = support(a, b, n * -1.0f);
+			if (fabs(n.dot(v.w - vertices[0].w)) > eps)
+				vertices.push_back(v);
+		}
+		return vertices.size() == 4;
+	}
+
+	struct EpaFace
+	{
+		int v[3] = {};
+		V4 normal = V4::zero();
+		float distance = 0.0f;
+	};
+
+	bool epa(const GjkShape& a, const GjkShape& b, const Simplex& simplex, GjkResult& result)
+	{
+		std::vector<SimplexVertex> vertices(simplex.vertices, simplex.vertices + simplex.size);
+		if (!completeTetrahedron(a, b, vertices))
+			return false;
+
+		const V4 interior = (vertices[0].w + vertices[1].w + vertices[2].w + vertices[3].w) / 4.0f;
+		std::vector<EpaFace> faces;
+		auto addFace = [&](int i0, int i1, int i2)
+		{
+			EpaFace face{ { i0, i1, i2 }, V4::zero(), 0.0f };
+			const V4& p0 = vertices[i0].w;
+			face.normal = (vertices[i1].w - p0).cross(vertices[i2].w - p0).normalize();
+			if (face.normal.dot(interior - p0) > 0.0f)
+			{
+				std::swap(face.v[1], face.v[2]);
+				face.normal = face.normal * -1.0f;
+			}
+			face.distance = face.normal.length2() > 0.0f ? face.normal.dot(p0) : std::numeric_limits<float>::max();
+			faces.push_back(face);
+		};
+		addFace(0, 1, 2);
+		addFace(0, 3, 1);
+		addFace(0, 2, 3);
+		addFace(1, 3, 2);
+
+		auto findClosest = [&faces]()
+		{
+			int closest = 0;
+			for (int i = 1; i < (int)faces.size(); ++i)
+			{
+				if (faces[i].distance < faces[closest].distance)
+					closest = i;
+			}
+			return closest;
+		};
+
+		std::vector<std::pair<int, int>> edges;
+		for (int iteration = 0; iteration < maxEpaIterations; ++iteration)
+		{
+			EpaFace face = faces[findClosest()];
+			auto w = support(a, b, face.normal);
+			if (w.w.dot(face.normal) - face.distance < epaTolerance)
+				break;
+
+			int newVertex = (int)vertices.size();
+			vertices.push_back(w);
+
+			// remove every face that sees the new vertex and stitch the horizon to it
+			edges.clear();
+			for (int i = 0; i < (int)faces.size();)
+			{
+				if (faces[i].normal.dot(w.w - vertices[faces[i].v[0]].w) > 0.0f)
+				{
+					for (int e = 0; e < 3; ++e)
+					{
+						std::pair<int, int> edge = { faces[i].v[e], faces[i].v[(e + 1) % 3] };
+						auto reverse = std::find(edges.begin(), edges.end(), std::pair<int, int>{ edge.second, edge.first });
+						if (reverse != edges.end())
+							edges.erase(reverse);
+						else
+							edges.push_back(edge);
+					}
+					faces[i] = faces.back();
+					faces.pop_back();
+				}
+				else
+				{
+					++i;
+				}
+			}
+			for (auto [i0, i1] : edges)
+				addFace(i0, i1, newVertex);
+
+			if (faces.empty())
+				return false;
+		}
+
+		// the faces changed since the last pick when the iterations ran out
+		const EpaFace& face = faces[findClosest()];
+		V4 bary = barycentric(face.normal * face.distance, vertices[face.v[0]].w, vertices[face.v[1]].w, vertices[face.v[2]].w);
+		result.pointA = V4::zero();
+		result.pointB = V4::zero();
+		for (int i = 0; i < 3; ++i)
+		{
+			result.pointA += vertices[face.v[i]].a * bary[i];
+			result.pointB += vertices[face.v[i]].b * bary[i];
+		}
+		result.normal = face.normal;
+		result.distance = -face.distance;
+		return true;
+	}
+}
+
+V4 GjkShape::support(const V4& dir) const
+{
+	V4 d = dir.xyz();
+	V4 dirLocal{ transform.rows[0].xyz().dot(d), transform.rows[1].xyz().dot(d), transform.rows[2].xyz().dot(d) };
+	uint best = 0;
+	float bestDot = points[0].xyz().dot(dirLocal);
+	for (uint i = 1; i < numPoints; ++i)
+	{
+		float dot = points[i].xyz().dot(dirLocal);
+		if (dot > bestDot)
+		{
+			bestDot = dot;
+			best = i;
+		}
+	}
+	return points[best] * transform;
+}
+
+GjkResult gjk(const GjkShape& a, const GjkShape& b, const V4& initialAxis, float maxDistance, bool computePenetration)
+{
+	GjkResult result;
+	const float margin = a.radius + b.radius;
+
+	V4 v = initialAxis.xyz();
+	if (v.length2() < gjkTolerance)
+		v = (a.points[0] * a.transform - b.points[0] * b.transform).xyz();
+	if (v.length2() < gjkTolerance)
+		v = { 1.0f, 0.0f, 0.0f };
+
+	Simplex simplex;
+	simplex.vertices[0] = support(a, b, v * -1.0f);
+	simplex.weights[0] = 1.0f;
+	simplex.size = 1;
+	v = simplex.vertices[0].w;
+
+	bool coresOverlap = false;
+	for (int iteration = 0; iteration < maxGjkIterations; ++iteration)
+	{
+		float v2 = v.length2();
+		if (v2 < gjkTolerance * gjkTolerance)
+		{
+			coresOverlap = true;
+			break;
+		}
+
+		SimplexVertex w = support(a, b, v * -1.0f);
+		float vw = v.dot(w.w);
+
+		// v.w / |v| is a lower bound of the distance between the cores
+		if (vw > 0.0f && vw * vw > v2 * (maxDistance + margin) * (maxDistance + margin))
+		{
+			result.overlap = false;
+			result.distance = vw / sqrtf(v2) - margin;
+			result.axis = v;
+			return result;
+		}
+
+		if (v2 - vw <= gjkTolerance * v2)
+			break;
+
+		bool duplicate = false;
+		for (int i = 0; i < simplex.size; ++i)
+			duplicate |= simplex.vertices[i].w == w.w;
+		if (duplicate)
+			break;
+
+		simplex.vertices[simplex.size++] = w;
+		if (solve(simplex))
+		{
+			coresOverlap = true;
+			break;
+		}
+		v = simplex.closestPoint();
+	}
+
+	if (!coresOverlap)
+	{
+		float d = v.length();
+		V4 pA = V4::zero();
+		V4 pB = V4::zero();
+		for (int i = 0; i < simplex.size; ++i)
+		{
+			pA += simplex.vertices[i].a * simplex.weights[i];
+			pB += simplex.vertices[i].b * simplex.weights[i];
+		}
+		result.normal = v * (-1.0f / d);
+		result.distance = d - margin;
+		result.overlap = result.distance < 0.0f;
+		result.pointA = pA + result.normal * a.radius;
+		result.pointB = pB - result.normal * b.radius;
+		result.axis = v;
+		return result;
+	}
+
+	result.overlap = true;
+	result.distance = -margin;
+	if (!computePenetration || !epa(a, b, simplex, result))
+	{
+		// touching cores, or the caller only wants to know about the overlap
+		V4 centerA = a.points[0] * a.transform;
+		V4 centerB = b.points[0] * b.transform;
+		result.normal = (centerB - centerA).xyz().normalize();
+		result.pointA = result.pointB = centerA;
+		result.axis = result.normal * -1.0f;
+		return result;
+	}
+
+	result.distance -= margin;
+	result.pointA += result.normal * a.radius;
+	result.pointB -= result.normal * b.radius;
+	result.axis = result.normal * -1.0f;
+	return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+
+// Convex shape for GJK/EPA: the convex hull of a local point cloud, transformed and inflated by a radius.
+// A sphere is a single point with a radius, a box is its eight corners.
+struct GjkShape
+{
+	V4 support(const V4& dir) const;
+
+	const V4* points = nullptr; // w = 1
+	uint numPoints = 0u;
+	float radius = 0.0f;
+	Mtx transform = Mtx::identity();
+};
+
+struct GjkResult
+{
+	bool overlap = false;
+	float distance = 0.0f; // negative penetration depth when overlapping
+	V4 pointA = V4::zero();
+	V4 pointB = V4::zero();
+	V4 normal = V4::zero(); // from A towards B
+	V4 axis = V4::zero(); // feed back as initialAxis next frame
+};
+
+// GJK distance, followed by EPA when the shapes overlap and computePenetration is set.
+// Gives up as soon as the shapes are proven to be farther apart than maxDistance.
+GjkResult gjk(const GjkShape& a, const GjkShape& b, const V4& initialAxis, float maxDistance = std::numeric_limits<float>::max(), bool computePenetration = true);
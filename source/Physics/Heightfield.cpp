@@ -0,0 +1,347 @@
+#include "Heightfield.h"
+#include "MeshBVH.h"
+#include "GJK.h"
+#include "Engine/Log.h"
+
+namespace
+{
+	constexpr int maxStackDepth = 64;
+
+	struct TileRef
+	{
+		int level = 0;
+		uint x = 0u;
+		uint y = 0u;
+		float t = 0.0f;
+	};
+}
+
+Heightfield::Heightfield(uint numSamplesX_, uint numSamplesY_, std::vector<ushort> heights_, float cellSize_, float heightScale_, float heightOffset_)
+	: numSamplesX(numSamplesX_)
+	, numSamplesY(numSamplesY_)
+	, cellSize(cellSize_)
+	, heightScale(heightScale_)
+	, heightOffset(heightOffset_)
+	, heights(std::move(heights_))
+{
+	assert(numSamplesX >= 2 && numSamplesY >= 2);
+	assert(heights.size() == (size_t)numSamplesX * numSamplesY);
+	assert(cellSize > 0.0f);
+
+	// level 0 tiles cover 2x2 cells, so 3x3 samples
+	MipLevel level0;
+	level0.sizeX = numSamplesX / 2;
+	level0.sizeY = numSamplesY / 2;
+	level0.ranges.resize((size_t)level0.sizeX * level0.sizeY);
+	for (uint ty = 0; ty < level0.sizeY; ++ty)
+	{
+		for (uint tx = 0; tx < level0.sizeX; ++tx)
+		{
+			MinMax range = { getSample(tx * 2, ty * 2), getSample(tx * 2, ty * 2) };
+			for (uint y = ty * 2; y <= std::min(ty * 2 + 2, numSamplesY - 1); ++y)
+			{
+				for (uint x = tx * 2; x <= std::min(tx * 2 + 2, numSamplesX - 1); ++x)
+				{
+					range.min = std::min(range.min, getSample(x, y));
+					range.max = std::max(range.max, getSample(x, y));
+				}
+			}
+			level0.ranges[ty * level0.sizeX + tx] = range;
+		}
+	}
+	mips.push_back(std::move(level0));
+
+	while (mips.back().sizeX > 1 || mips.back().sizeY > 1)
+	{
+		const MipLevel& below = mips.back();
+		MipLevel level;
+		level.sizeX = (below.sizeX + 1) / 2;
+		level.sizeY = (below.sizeY + 1) / 2;
+		level.ranges.resize((size_t)level.sizeX * level.sizeY);
+		for (uint ty = 0; ty < level.sizeY; ++ty)
+		{
+			for (uint tx = 0; tx < level.sizeX; ++tx)
+			{
+				MinMax range = below.ranges[ty * 2 * below.sizeX + tx * 2];
+				for (uint y = ty * 2; y < std::min(ty * 2 + 2, below.sizeY); ++y)
+				{
+					for (uint x = tx * 2; x < std::min(tx * 2 + 2, below.sizeX); ++x)
+					{
+						range.min = std::min(range.min, below.ranges[y * below.sizeX + x].min);
+						range.max = std::max(range.max, below.ranges[y * below.sizeX + x].max);
+					}
+				}
+				level.ranges[ty * level.sizeX + tx] = range;
+			}
+		}
+		mips.push_back(std::move(level));
+	}
+
+	logLine(x, Verbose, "Built a heightfield: {}x{} samples, {} mip levels, {} KB", numSamplesX, numSamplesY, mips.size(), getMemorySize() / 1024);
+}
+
+Heightfield::MinMax Heightfield::getCellRange(uint cellX, uint cellY) const
+{
+	ushort h00 = getSample(cellX, cellY);
+	ushort h10 = getSample(cellX + 1, cellY);
+	ushort h01 = getSample(cellX, cellY + 1);
+	ushort h11 = getSample(cellX + 1, cellY + 1);
+	return { std::min(std::min(h00, h10), std::min(h01, h11)), std::max(std::max(h00, h10), std::max(h01, h11)) };
+}
+
+void Heightfield::getCellTriangles(uint cellX, uint cellY, V4 (&triangles)[2][3]) const
+{
+	float x0 = cellX * cellSize;
+	float y0 = cellY * cellSize;
+	V4 p00 = { x0, y0, toHeight(getSample(cellX, cellY)), 0.0f };
+	V4 p10 = { x0 + cellSize, y0, toHeight(getSample(cellX + 1, cellY)), 0.0f };
+	V4 p01 = { x0, y0 + cellSize, toHeight(getSample(cellX, cellY + 1)), 0.0f };
+	V4 p11 = { x0 + cellSize, y0 + cellSize, toHeight(getSample(cellX + 1, cellY + 1)), 0.0f };
+	// both wound counter-clockwise seen from above
+	triangles[0][0] = p00;
+	triangles[0][1] = p10;
+	triangles[0][2] = p11;
+	triangles[1][0] = p00;
+	triangles[1][1] = p11;
+	triangles[1][2] = p01;
+}
+
+AABB Heightfield::getTileBounds(uint level, uint tileX, uint tileY) const
+{
+	uint tileCells = 2u << level;
+	const MinMax& range = mips[level].ranges[tileY * mips[level].sizeX + tileX];
+	AABB aabb;
+	aabb.min = { tileX * tileCells * cellSize, tileY * tileCells * cellSize, toHeight(range.min), 0.0f };
+	aabb.max = { std::min((tileX + 1) * tileCells, numSamplesX - 1) * cellSize, std::min((tileY + 1) * tileCells, numSamplesY - 1) * cellSize, toHeight(range.max), 0.0f };
+	return aabb;
+}
+
+AABB Heightfield::getBounds() const
+{
+	const MinMax& range = mips.back().ranges[0];
+	AABB aabb;
+	aabb.min = { 0.0f, 0.0f, toHeight(range.min), 0.0f };
+	aabb.max = { (numSamplesX - 1) * cellSize, (numSamplesY - 1) * cellSize, toHeight(range.max), 0.0f };
+	return aabb;
+}
+
+size_t Heightfield::getMemorySize() const
+{
+	size_t size = heights.size() * sizeof(ushort);
+	for (auto& level : mips)
+		size += level.ranges.size() * sizeof(MinMax);
+	return size;
+}
+
+std::optional<float> Heightfield::getHeight(float x, float y, V4* normal) const
+{
+	float fx = x / cellSize;
+	float fy = y / cellSize;
+	if (fx < 0.0f || fy < 0.0f || fx > numSamplesX - 1 || fy > numSamplesY - 1)
+		return {};
+
+	uint cellX = std::min((uint)fx, numSamplesX - 2);
+	uint cellY = std::min((uint)fy, numSamplesY - 2);
+	float u = fx - cellX;
+	float v = fy - cellY;
+	float h00 = toHeight(getSample(cellX, cellY));
+	float h10 = toHeight(getSample(cellX + 1, cellY));
+	float h01 = toHeight(getSample(cellX, cellY + 1));
+	float h11 = toHeight(getSample(cellX + 1, cellY + 1));
+	if (u >= v)
+	{
+		if (normal)
+			*normal = V4{ (h00 - h10) * cellSize, (h10 - h11) * cellSize, cellSize * cellSize, 0.0f }.normalize();
+		return h00 + u * (h10 - h00) + v * (h11 - h10);
+	}
+
+	if (normal)
+		*normal = V4{ (h01 - h11) * cellSize, (h00 - h01) * cellSize, cellSize * cellSize, 0.0f }.normalize();
+	return h00 + u * (h11 - h01) + v * (h01 - h00);
+}
+
+std::optional<Heightfield::SphereHit> Heightfield::findClosestPoint(const V4& center, float radius) const
+{
+	V4 p = center.xyz();
+
+	// the ground is solid, a center below the surface is pushed straight up
+	V4 normal;
+	if (auto height = getHeight(p.x, p.y, &normal); height && p.z < *height)
+		return SphereHit{ { p.x, p.y, *height, 1.0f }, normal, p.z - *height };
+
+	float best2 = radius * radius;
+	std::optional<SphereHit> result;
+	AABB bounds = { V4{ p.x - radius, p.y - radius, p.z - radius, 0.0f }, V4{ p.x + radius, p.y + radius, p.z + radius, 0.0f } };
+	forEachCell(bounds, [&](uint cellX, uint cellY)
+	{
+		V4 triangles[2][3];
+		getCellTriangles(cellX, cellY, triangles);
+		for (auto& triangle : triangles)
+		{
+			V4 closest = closestPointOnTriangle(p, triangle[0], triangle[1], triangle[2]);
+			float d2 = (closest - p).length2();
+			if (d2 < best2)
+			{
+				best2 = d2;
+				V4 n = (p - closest).normalize();
+				if (n.length2() == 0.0f)
+					n = (triangle[1] - triangle[0]).cross(triangle[2] - triangle[0]).normalize();
+				result = SphereHit{ closest, n, sqrtf(d2) };
+			}
+		}
+	});
+
+	if (result)
+		result->point.w = 1.0f;
+	return result;
+}
+
+template<typename Visit>
+void Heightfield::forEachCell(const AABB& bounds, Visit&& visit) const
+{
+	float minX = bounds.min.x / cellSize;
+	float minY = bounds.min.y / cellSize;
+	float maxX = bounds.max.x / cellSize;
+	float maxY = bounds.max.y / cellSize;
+	if (maxX < 0.0f || maxY < 0.0f || minX > numSamplesX - 1 || minY > numSamplesY - 1)
+		return;
+
+	uint firstCellX = (uint)std::max(minX, 0.0f);
+	uint firstCellY = (uint)std::max(minY, 0.0f);
+	uint lastCellX = std::min((uint)maxX, numSamplesX - 2);
+	uint lastCellY = std::min((uint)maxY, numSamplesY - 2);
+	auto outsideRange = [&](const MinMax& range)
+	{
+		return toHeight(range.max) < bounds.min.z || toHeight(range.min) > bounds.max.z;
+	};
+
+	const MipLevel& level0 = mips[0];
+	for (uint tileY = firstCellY / 2; tileY <= lastCellY / 2; ++tileY)
+	{
+		for (uint tileX = firstCellX / 2; tileX <= lastCellX / 2; ++tileX)
+		{
+			if (tileX < level0.sizeX && tileY < level0.sizeY && outsideRange(level0.ranges[tileY * level0.sizeX + tileX]))
+				continue;
+
+			for (uint cellY = std::max(tileY * 2, firstCellY); cellY <= std::min(tileY * 2 + 1, lastCellY); ++cellY)
+			{
+				for (uint cellX = std::max(tileX * 2, firstCellX); cellX <= std::min(tileX * 2 + 1, lastCellX); ++cellX)
+				{
+					if (!outsideRange(getCellRange(cellX, cellY)))
+						visit(cellX, cellY);
+				}
+			}
+		}
+	}
+}
+
+std::optional<Heightfield::SphereHit> Heightfield::findConvexContact(const GjkShape& shape) const
+{
+	static const V4 axes[3] = { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } };
+	AABB bounds;
+	for (int i = 0; i < 3; ++i)
+	{
+		bounds.min[i] = shape.support(axes[i] * -1.0f)[i] - shape.radius;
+		bounds.max[i] = shape.support(axes[i])[i] + shape.radius;
+	}
+
+	// The ground is one-sided: a triangle the shape overlaps pushes it out along the triangle's normal, by how far
+	// the shape reaches below the triangle's plane. The deepest overlap wins.
+	std::optional<SphereHit> result;
+	forEachCell(bounds, [&](uint cellX, uint cellY)
+	{
+		V4 triangles[2][3];
+		getCellTriangles(cellX, cellY, triangles);
+		for (auto& triangle : triangles)
+		{
+			for (auto& corner : triangle)
+				corner.w = 1.0f;
+			if (!gjk(GjkShape{ triangle, 3u, 0.0f, Mtx::identity() }, shape, V4::zero(), 0.0f, false).overlap)
+				continue;
+
+			V4 n = (triangle[1] - triangle[0]).cross(triangle[2] - triangle[0]).normalize();
+			V4 deepest = shape.support(n * -1.0f) - n * shape.radius;
+			float depth = n.dot(triangle[0] - deepest);
+			if (!result || -depth < result->distance)
+				result = SphereHit{ deepest + n * depth, n, -depth };
+		}
+	});
+	if (result)
+		return result;
+
+	// the ground is solid, a shape sunk below the surface is pushed straight up
+	V4 lowest = shape.support(axes[2] * -1.0f);
+	V4 normal;
+	if (auto height = getHeight(lowest.x, lowest.y, &normal); height && bounds.max.z < *height)
+		return SphereHit{ { lowest.x, lowest.y, *height, 1.0f }, normal, bounds.min.z - *height };
+	return {};
+}
+
+std::optional<RayIntersectResult> Heightfield::intersectRay(const V4& point, const V4& dir, float maxT, bool anyHit) const
+{
+	V4 p = point.xyz();
+	V4 d = dir.xyz();
+	V4 invDir;
+	for (int i = 0; i < 3; ++i)
+		invDir[i] = fabs(d[i]) > FLT_EPSILON ? 1.0f / d[i] : std::numeric_limits<float>::max();
+	invDir.w = 0.0f;
+
+	int topLevel = (int)mips.size() - 1;
+	auto rootT = intersectRaySlabs(p, invDir, getTileBounds(topLevel, 0, 0), maxT);
+	if (!rootT)
+		return {};
+
+	float bestT = maxT;
+	std::optional<RayIntersectResult> result;
+	TileRef stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = { topLevel, 0u, 0u, *rootT };
+	while (stackSize > 0)
+	{
+		TileRef tile = stack[--stackSize];
+		if (tile.t >= bestT)
+			continue;
+
+		if (tile.level == 0)
+		{
+			for (uint cellY = tile.y * 2; cellY < std::min(tile.y * 2 + 2, numSamplesY - 1); ++cellY)
+			{
+				for (uint cellX = tile.x * 2; cellX < std::min(tile.x * 2 + 2, numSamplesX - 1); ++cellX)
+				{
+					V4 triangles[2][3];
+					getCellTriangles(cellX, cellY, triangles);
+					for (auto& triangle : triangles)
+					{
+						auto t = intersectRayTriangle(p, d, triangle[0], triangle[1], triangle[2]);
+						if (t && *t >= 0.0f && *t < bestT)
+						{
+							bestT = *t;
+							result = RayIntersectResult{ point + dir * bestT, bestT, (triangle[1] - triangle[0]).cross(triangle[2] - triangle[0]).normalize() };
+							if (anyHit)
+								return result;
+						}
+					}
+				}
+			}
+			continue;
+		}
+
+		// push the children farthest first so the nearest one is visited next and shrinks bestT early
+		const MipLevel& below = mips[tile.level - 1];
+		TileRef children[4];
+		int numChildren = 0;
+		for (uint y = tile.y * 2; y < std::min(tile.y * 2 + 2, below.sizeY); ++y)
+		{
+			for (uint x = tile.x * 2; x < std::min(tile.x * 2 + 2, below.sizeX); ++x)
+			{
+				if (auto t = intersectRaySlabs(p, invDir, getTileBounds(tile.level - 1, x, y), bestT))
+					children[numChildren++] = { tile.level - 1, x, y, *t };
+			}
+		}
+		std::sort(children, children + numChildren, [](const TileRef& a, const TileRef& b) { return a.t > b.t; });
+		assert(stackSize + numChildren <= maxStackDepth);
+		for (int i = 0; i < numChildren; ++i)
+			stack[stackSize++] = children[i];
+	}
+	return result;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include "ColliderComponent.h"
+
+struct GjkShape;
+
+// Terrain over a regular grid of 16-bit height samples.
+// Sample (x, y) sits at (x * cellSize, y * cellSize, heightOffset + height * heightScale) in heightfield space,
+// every cell is split into two triangles along its (x, y) - (x + 1, y + 1) diagonal.
+// Min/max mips start at tiles of 2x2 cells and halve up to a single tile, queries use them to skip whole regions
+// so nothing ever touches more than the cells under the query.
+class Heightfield
+{
+public:
+
+	struct MinMax
+	{
+		ushort min = 0;
+		ushort max = 0;
+	};
+
+	struct SphereHit
+	{
+		V4 point;
+		V4 normal; // up from the surface, also when the center is below it
+		float distance = 0.0f; // negative when the center is below the surface
+	};
+
+	Heightfield(uint numSamplesX, uint numSamplesY, std::vector<ushort> heights, float cellSize = 1.0f, float heightScale = 1.0f / 256.0f, float heightOffset = 0.0f);
+
+	// All queries are in heightfield space
+	std::optional<float> getHeight(float x, float y, V4* normal = nullptr) const;
+	std::optional<SphereHit> findClosestPoint(const V4& center, float radius) const;
+	// Deepest contact of a convex shape given in heightfield space, distance is the negative penetration depth
+	std::optional<SphereHit> findConvexContact(const GjkShape& shape) const;
+	std::optional<RayIntersectResult> intersectRay(const V4& point, const V4& dir, float maxT = std::numeric_limits<float>::max(), bool anyHit = false) const;
+
+	AABB getBounds() const;
+	uint getNumSamplesX() const { return numSamplesX; }
+	uint getNumSamplesY() const { return numSamplesY; }
+	size_t getMemorySize() const;
+
+private:
+
+	struct MipLevel
+	{
+		uint sizeX = 0u;
+		uint sizeY = 0u;
+		std::vector<MinMax> ranges;
+	};
+
+	ushort getSample(uint x, uint y) const { return heights[y * numSamplesX + x]; }
+	float toHeight(uint height) const { return heightOffset + height * heightScale; }
+	MinMax getCellRange(uint cellX, uint cellY) const;
+	void getCellTriangles(uint cellX, uint cellY, V4 (&triangles)[2][3]) const;
+	AABB getTileBounds(uint level, uint tileX, uint tileY) const;
+	// Calls visit(cellX, cellY) for the cells under bounds whose heights overlap its z range, skipping level 0 tiles that don't
+	template<typename Visit>
+	void forEachCell(const AABB& bounds, Visit&& visit) const;
+
+	uint numSamplesX = 0u;
+	uint numSamplesY = 0u;
+	float cellSize = 1.0f;
+	float heightScale = 1.0f;
+	float heightOffset = 0.0f;
+	std::vector<ushort> heights;
+	std::vector<MipLevel> mips;
+};
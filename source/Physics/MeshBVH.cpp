@@ -0,0 +1,642 @@
+#include "MeshBVH.h"
+#include "Animation/Mesh.h"
+#include "Engine/Log.h"
+
+namespace
+{
+	uint64 hashBytes(uint64 hash, const void* data, size_t size)
+	{
+		auto bytes = reinterpret_cast<const uchar*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64 hashMesh(const Mesh& mesh)
+	{
+		uint64 hash = 14695981039346656037ull;
+		for (auto& vertex : mesh.getVertices())
+			hash = hashBytes(hash, &vertex.pos, sizeof(vertex.pos));
+		return hashBytes(hash, mesh.getIndices().data(), mesh.getIndices().size() * sizeof(uint32_t));
+	}
+
+	V4 toV4(const V3& v)
+	{
+		return { v.x, v.y, v.z, 0.0f };
+	}
+
+	V4 min(const V4& a, const V4& b)
+	{
+		return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z), 0.0f };
+	}
+
+	V4 max(const V4& a, const V4& b)
+	{
+		return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z), 0.0f };
+	}
+
+	float distance2(const V4& p, const AABB& aabb)
+	{
+		V4 d = clamp(p, aabb.min, aabb.max) - p;
+		return d.xyz().length2();
+	}
+
+	float distance2(const AABB& a, const AABB& b)
+	{
+		V4 d = max(max(a.min - b.max, b.min - a.max), V4::zero());
+		return d.xyz().length2();
+	}
+
+	constexpr int maxStackDepth = 64;
+}
+
+// Slab test limited to [0, maxT], returns the entry distance
+std::optional<float> intersectRaySlabs(const V4& point, const V4& invDir, const AABB& aabb, float maxT)
+{
+	float tmin = 0.0f;
+	float tmax = maxT;
+	for (int i = 0; i < 3; i++)
+	{
+		float t1 = (aabb.min[i] - point[i]) * invDir[i];
+		float t2 = (aabb.max[i] - point[i]) * invDir[i];
+		if (t1 > t2)
+			std::swap(t1, t2);
+		tmin = std::max(tmin, t1);
+		tmax = std::min(tmax, t2);
+		if (tmin > tmax)
+			return {};
+	}
+	return tmin;
+}
+
+// Ericson, Real-Time Collision Detection, 5.1.5
+V4 closestPointOnTriangle(const V4& p, const V4& a, const V4& b, const V4& c)
+{
+	V4 ab = b - a;
+	V4 ac = c - a;
+	V4 ap = p - a;
+	float d1 = ab.dot(ap);
+	float d2 = ac.dot(ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+
+	V4 bp = p - b;
+	float d3 = ab.dot(bp);
+	float d4 = ac.dot(bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+
+	V4 cp = p - c;
+	float d5 = ab.dot(cp);
+	float d6 = ac.dot(cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Moller-Trumbore, double sided
+std::optional<float> intersectRayTriangle(const V4& point, const V4& dir, const V4& a, const V4& b, const V4& c)
+{
+	V4 ab = b - a;
+	V4 ac = c - a;
+	V4 pvec = dir.cross(ac);
+	float det = ab.dot(pvec);
+	if (fabs(det) < FLT_EPSILON)
+		return {};
+
+	float invDet = 1.0f / det;
+	V4 tvec = point - a;
+	float u = tvec.dot(pvec) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return {};
+
+	V4 qvec = tvec.cross(ab);
+	float v = dir.dot(qvec) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return {};
+
+	return ac.dot(qvec) * invDet;
+}
+
+// Ericson, Real-Time Collision Detection, 5.1.9
+void closestPointsSegmentSegment(const V4& p1, const V4& q1, const V4& p2, const V4& q2, V4& c1, V4& c2)
+{
+	V4 d1 = q1 - p1;
+	V4 d2 = q2 - p2;
+	V4 r = p1 - p2;
+	float a = d1.dot(d1);
+	float e = d2.dot(d2);
+	float f = d2.dot(r);
+	float s = 0.0f;
+	float t = 0.0f;
+	if (a <= FLT_EPSILON && e <= FLT_EPSILON)
+	{
+	}
+	else if (a <= FLT_EPSILON)
+	{
+		t = std::clamp(f / e, 0.0f, 1.0f);
+	}
+	else
+	{
+		float c = d1.dot(r);
+		if (e <= FLT_EPSILON)
+		{
+			s = std::clamp(-c / a, 0.0f, 1.0f);
+		}
+		else
+		{
+			float b = d1.dot(d2);
+			float denom = a * e - b * b;
+			s = denom != 0.0f ? std::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+			t = (b * s + f) / e;
+			if (t < 0.0f)
+			{
+				t = 0.0f;
+				s = std::clamp(-c / a, 0.0f, 1.0f);
+			}
+			else if (t > 1.0f)
+			{
+				t = 1.0f;
+				s = std::clamp((b - c) / a, 0.0f, 1.0f);
+			}
+		}
+	}
+	c1 = p1 + d1 * s;
+	c2 = p2 + d2 * t;
+}
+
+void closestPointsSegmentTriangle(const V4& p, const V4& q, const V4& a, const V4& b, const V4& c, V4& onSegment, V4& onTriangle)
+{
+	// a segment through the triangle touches it where it crosses
+	auto t = intersectRayTriangle(p, q - p, a, b, c);
+	if (t && *t >= 0.0f && *t <= 1.0f)
+	{
+		onSegment = onTriangle = p + (q - p) * *t;
+		return;
+	}
+
+	// otherwise one end of the closest pair is an end of the segment or lies on an edge of the triangle
+	onSegment = p;
+	onTriangle = closestPointOnTriangle(p, a, b, c);
+	float best2 = (onTriangle - onSegment).length2();
+	auto consider = [&](const V4& pointOnSegment, const V4& pointOnTriangle)
+	{
+		float d2 = (pointOnTriangle - pointOnSegment).length2();
+		if (d2 < best2)
+		{
+			best2 = d2;
+			onSegment = pointOnSegment;
+			onTriangle = pointOnTriangle;
+		}
+	};
+	consider(q, closestPointOnTriangle(q, a, b, c));
+	const V4* corners[3] = { &a, &b, &c };
+	for (int i = 0; i < 3; ++i)
+	{
+		V4 pointOnSegment, pointOnEdge;
+		closestPointsSegmentSegment(p, q, *corners[i], *corners[(i + 1) % 3], pointOnSegment, pointOnEdge);
+		consider(pointOnSegment, pointOnEdge);
+	}
+}
+
+std::shared_ptr<const MeshBVH> MeshBVH::get(const Mesh& mesh)
+{
+	// keyed by the mesh itself, two meshes never share a BVH by hash. The hash only tells whether a mesh
+	// changed since its BVH was built.
+	struct CacheEntry
+	{
+		std::weak_ptr<const MeshBVH> bvh;
+		uint64 hash = 0u;
+		size_t numVertices = 0;
+		size_t numIndices = 0;
+	};
+	static std::mutex mutex;
+	static std::unordered_map<const Mesh*, CacheEntry> cache;
+
+	uint64 hash = hashMesh(mesh);
+	std::lock_guard guard(mutex);
+	std::erase_if(cache, [](const auto& item) { return item.second.bvh.expired(); });
+	auto& entry = cache[&mesh];
+	if (auto bvh = entry.bvh.lock())
+	{
+		if (entry.hash == hash && entry.numVertices == mesh.getVertices().size() && entry.numIndices == mesh.getIndices().size())
+			return bvh;
+	}
+
+	auto bvh = std::make_shared<const MeshBVH>(mesh);
+	entry = { bvh, hash, mesh.getVertices().size(), mesh.getIndices().size() };
+	return bvh;
+}
+
+MeshBVH::MeshBVH(const Mesh& mesh)
+{
+	auto& vertices = mesh.getVertices();
+	auto& indices = mesh.getIndices();
+	uint numTriangles = (uint)indices.size() / 3u;
+	assert(numTriangles <= Node::firstTriangleMask);
+	if (numTriangles == 0)
+		return;
+
+	positions.reserve(vertices.size());
+	for (auto& vertex : vertices)
+		positions.push_back(vertex.pos);
+
+	std::vector<BuildTriangle> buildTriangles(numTriangles);
+	std::vector<uint> order(numTriangles);
+	bounds = { toV4(positions[indices[0]]), toV4(positions[indices[0]]) };
+	for (uint i = 0; i < numTriangles; ++i)
+	{
+		V4 a = toV4(positions[indices[i * 3]]);
+		V4 b = toV4(positions[indices[i * 3 + 1]]);
+		V4 c = toV4(positions[indices[i * 3 + 2]]);
+		auto& triangle = buildTriangles[i];
+		triangle.bounds = { min(min(a, b), c), max(max(a, b), c) };
+		triangle.centroid = (a + b + c) / 3.0f;
+		bounds = { min(bounds.min, triangle.bounds.min), max(bounds.max, triangle.bounds.max) };
+		order[i] = i;
+	}
+
+	V4 extent = bounds.max - bounds.min;
+	for (int i = 0; i < 3; ++i)
+	{
+		quantizeScale[i] = extent[i] > 0.0f ? 65535.0f / extent[i] : 0.0f;
+		dequantizeScale[i] = extent[i] / 65535.0f;
+	}
+
+	nodes.reserve(2 * numTriangles / maxTrianglesPerLeaf + 1);
+	build(order, buildTriangles, 0, numTriangles);
+
+	triangles.reserve(numTriangles * 3);
+	for (uint triangle : order)
+	{
+		triangles.push_back(indices[triangle * 3]);
+		triangles.push_back(indices[triangle * 3 + 1]);
+		triangles.push_back(indices[triangle * 3 + 2]);
+	}
+
+	logLine(x, Verbose, "Built a mesh BVH: {} triangles, {} nodes", numTriangles, nodes.size());
+}
+
+uint MeshBVH::build(std::vector<uint>& order, const std::vector<BuildTriangle>& buildTriangles, uint begin, uint end)
+{
+	uint nodeIndex = (uint)nodes.size();
+	nodes.emplace_back();
+
+	AABB nodeBounds = buildTriangles[order[begin]].bounds;
+	AABB centroidBounds = { buildTriangles[order[begin]].centroid, buildTriangles[order[begin]].centroid };
+	for (uint i = begin; i < end; ++i)
+	{
+		auto& triangle = buildTriangles[order[i]];
+		nodeBounds = { min(nodeBounds.min, triangle.bounds.min), max(nodeBounds.max, triangle.bounds.max) };
+		centroidBounds = { min(centroidBounds.min, triangle.centroid), max(centroidBounds.max, triangle.centroid) };
+	}
+	quantize(nodes[nodeIndex], nodeBounds);
+
+	uint count = end - begin;
+	if (count <= maxTrianglesPerLeaf)
+	{
+		nodes[nodeIndex].data = Node::leafBit | (count << Node::countShift) | begin;
+		return nodeIndex;
+	}
+
+	V4 centroidExtent = centroidBounds.max - centroidBounds.min;
+	int axis = 0;
+	if (centroidExtent.y > centroidExtent[axis])
+		axis = 1;
+	if (centroidExtent.z > centroidExtent[axis])
+		axis = 2;
+
+	uint middle = begin + count / 2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&buildTriangles, axis](uint a, uint b)
+	{
+		return buildTriangles[a].centroid[axis] < buildTriangles[b].centroid[axis];
+	});
+
+	build(order, buildTriangles, begin, middle);
+	uint secondChild = build(order, buildTriangles, middle, end);
+	nodes[nodeIndex].data = secondChild;
+	return nodeIndex;
+}
+
+void MeshBVH::quantize(Node& node, const AABB& aabb) const
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		float qmin = floorf((aabb.min[i] - bounds.min[i]) * quantizeScale[i]);
+		float qmax = ceilf((aabb.max[i] - bounds.min[i]) * quantizeScale[i]);
+		node.min[i] = (ushort)std::clamp(qmin, 0.0f, 65535.0f);
+		node.max[i] = (ushort)std::clamp(qmax, 0.0f, 65535.0f);
+	}
+}
+
+AABB MeshBVH::dequantize(const Node& node) const
+{
+	AABB aabb;
+	for (int i = 0; i < 3; ++i)
+	{
+		aabb.min[i] = bounds.min[i] + node.min[i] * dequantizeScale[i];
+		aabb.max[i] = bounds.min[i] + node.max[i] * dequantizeScale[i];
+	}
+	return aabb;
+}
+
+void MeshBVH::getTriangle(uint triangle, V4& a, V4& b, V4& c) const
+{
+	a = toV4(positions[triangles[triangle * 3]]);
+	b = toV4(positions[triangles[triangle * 3 + 1]]);
+	c = toV4(positions[triangles[triangle * 3 + 2]]);
+}
+
+bool MeshBVH::overlapsSphere(const V4& center, float radius) const
+{
+	if (nodes.empty())
+		return false;
+
+	V4 p = center.xyz();
+	float radius2 = radius * radius;
+	uint stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		if (distance2(p, dequantize(node)) > radius2)
+			continue;
+
+		if (node.isLeaf())
+		{
+			for (uint i = node.getFirstTriangle(); i < node.getFirstTriangle() + node.getNumTriangles(); ++i)
+			{
+				V4 a, b, c;
+				getTriangle(i, a, b, c);
+				if ((closestPointOnTriangle(p, a, b, c) - p).length2() <= radius2)
+					return true;
+			}
+			continue;
+		}
+
+		uint first = (uint)(&node - nodes.data()) + 1;
+		assert(stackSize + 2 <= maxStackDepth);
+		stack[stackSize++] = node.getSecondChild();
+		stack[stackSize++] = first;
+	}
+	return false;
+}
+
+std::optional<MeshBVH::SphereHit> MeshBVH::findClosestPoint(const V4& center, float radius) const
+{
+	if (nodes.empty())
+		return {};
+
+	V4 p = center.xyz();
+	float best2 = radius * radius;
+	std::optional<SphereHit> result;
+	uint stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		uint nodeIndex = stack[--stackSize];
+		const Node& node = nodes[nodeIndex];
+		if (node.isLeaf())
+		{
+			for (uint i = node.getFirstTriangle(); i < node.getFirstTriangle() + node.getNumTriangles(); ++i)
+			{
+				V4 a, b, c;
+				getTriangle(i, a, b, c);
+				V4 closest = closestPointOnTriangle(p, a, b, c);
+				float d2 = (closest - p).length2();
+				if (d2 < best2)
+				{
+					best2 = d2;
+					V4 normal = (p - closest).normalize();
+					if (normal.length2() == 0.0f)
+						normal = (b - a).cross(c - a).normalize();
+					result = SphereHit{ closest, normal, sqrtf(d2), i };
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first, the shrinking radius culls the other one most of the time
+		uint first = nodeIndex + 1;
+		uint second = node.getSecondChild();
+		float d2First = distance2(p, dequantize(nodes[first]));
+		float d2Second = distance2(p, dequantize(nodes[second]));
+		if (d2First > d2Second)
+		{
+			std::swap(first, second);
+			std::swap(d2First, d2Second);
+		}
+		assert(stackSize + 2 <= maxStackDepth);
+		if (d2Second < best2)
+			stack[stackSize++] = second;
+		if (d2First < best2)
+			stack[stackSize++] = first;
+	}
+
+	if (result)
+		result->point.w = 1.0f;
+	return result;
+}
+
+std::optional<MeshBVH::SegmentHit> MeshBVH::findClosestPointToSegment(const V4& a, const V4& b, float radius) const
+{
+	if (nodes.empty())
+		return {};
+
+	V4 p = a.xyz();
+	V4 q = b.xyz();
+	AABB segmentBounds = { min(p, q), max(p, q) };
+	V4 midpoint = (p + q) * 0.5f;
+	float best2 = radius * radius;
+	std::optional<SegmentHit> result;
+	uint stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		uint nodeIndex = stack[--stackSize];
+		const Node& node = nodes[nodeIndex];
+		if (node.isLeaf())
+		{
+			for (uint i = node.getFirstTriangle(); i < node.getFirstTriangle() + node.getNumTriangles(); ++i)
+			{
+				V4 ta, tb, tc;
+				getTriangle(i, ta, tb, tc);
+				V4 onSegment, onTriangle;
+				closestPointsSegmentTriangle(p, q, ta, tb, tc, onSegment, onTriangle);
+				float d2 = (onSegment - onTriangle).length2();
+				if (d2 < best2)
+				{
+					best2 = d2;
+					V4 normal = (onSegment - onTriangle).normalize();
+					if (normal.length2() == 0.0f)
+					{
+						// the segment crosses the triangle, push out towards the side of the end closer to it
+						normal = (tb - ta).cross(tc - ta).normalize();
+						float dp = normal.dot(p - ta);
+						float dq = normal.dot(q - ta);
+						if (fabs(dp) < fabs(dq) ? dp > 0.0f : dq > 0.0f)
+							normal = normal * -1.0f;
+					}
+					result = SegmentHit{ onTriangle, normal, onSegment, sqrtf(d2), i };
+				}
+			}
+			continue;
+		}
+
+		// the distance between the segment's bounds and a node's bounds never exceeds the one to the segment
+		uint first = nodeIndex + 1;
+		uint second = node.getSecondChild();
+		AABB firstBounds = dequantize(nodes[first]);
+		AABB secondBounds = dequantize(nodes[second]);
+		float d2First = distance2(segmentBounds, firstBounds);
+		float d2Second = distance2(segmentBounds, secondBounds);
+		if (d2First > d2Second || (d2First == d2Second && distance2(midpoint, firstBounds) > distance2(midpoint, secondBounds)))
+		{
+			std::swap(first, second);
+			std::swap(d2First, d2Second);
+		}
+		assert(stackSize + 2 <= maxStackDepth);
+		if (d2Second < best2)
+			stack[stackSize++] = second;
+		if (d2First < best2)
+			stack[stackSize++] = first;
+	}
+
+	if (result)
+	{
+		result->point.w = 1.0f;
+		result->segmentPoint.w = 1.0f;
+	}
+	return result;
+}
+
+std::optional<MeshBVH::SphereHit> MeshBVH::findConvexContact(const GjkShape& shape) const
+{
+	if (nodes.empty())
+		return {};
+
+	static const V4 axes[3] = { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } };
+	AABB shapeBounds;
+	for (int i = 0; i < 3; ++i)
+	{
+		shapeBounds.min[i] = shape.support(axes[i] * -1.0f)[i] - shape.radius;
+		shapeBounds.max[i] = shape.support(axes[i])[i] + shape.radius;
+	}
+
+	// two-sided like the sphere and segment queries, every triangle the shape overlaps pushes it out along EPA's normal
+	std::optional<SphereHit> result;
+	uint stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		if (distance2(shapeBounds, dequantize(node)) > 0.0f)
+			continue;
+
+		if (node.isLeaf())
+		{
+			for (uint i = node.getFirstTriangle(); i < node.getFirstTriangle() + node.getNumTriangles(); ++i)
+			{
+				V4 triangle[3];
+				getTriangle(i, triangle[0], triangle[1], triangle[2]);
+				for (auto& corner : triangle)
+					corner.w = 1.0f;
+				GjkResult hit = gjk(GjkShape{ triangle, 3u, 0.0f, Mtx::identity() }, shape, V4::zero(), 0.0f);
+				if (hit.overlap && (!result || hit.distance < result->distance))
+					result = SphereHit{ hit.pointA, hit.normal, hit.distance, i };
+			}
+			continue;
+		}
+
+		uint first = (uint)(&node - nodes.data()) + 1;
+		assert(stackSize + 2 <= maxStackDepth);
+		stack[stackSize++] = node.getSecondChild();
+		stack[stackSize++] = first;
+	}
+
+	if (result)
+		result->point.w = 1.0f;
+	return result;
+}
+
+std::optional<RayIntersectResult> MeshBVH::intersectRay(const V4& point, const V4& dir, float maxT, bool anyHit) const
+{
+	if (nodes.empty())
+		return {};
+
+	V4 p = point.xyz();
+	V4 d = dir.xyz();
+	V4 invDir;
+	for (int i = 0; i < 3; ++i)
+		invDir[i] = fabs(d[i]) > FLT_EPSILON ? 1.0f / d[i] : std::numeric_limits<float>::max();
+	invDir.w = 0.0f;
+
+	float bestT = maxT;
+	std::optional<RayIntersectResult> result;
+	uint stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		uint nodeIndex = stack[--stackSize];
+		const Node& node = nodes[nodeIndex];
+		if (nodeIndex == 0 && !intersectRaySlabs(p, invDir, dequantize(node), bestT))
+			continue;
+
+		if (node.isLeaf())
+		{
+			for (uint i = node.getFirstTriangle(); i < node.getFirstTriangle() + node.getNumTriangles(); ++i)
+			{
+				V4 a, b, c;
+				getTriangle(i, a, b, c);
+				auto t = intersectRayTriangle(p, d, a, b, c);
+				if (t && *t >= 0.0f && *t < bestT)
+				{
+					bestT = *t;
+					result = RayIntersectResult{ point + dir * bestT, bestT, (b - a).cross(c - a).normalize() };
+					if (anyHit)
+						return result;
+				}
+			}
+			continue;
+		}
+
+		// descend into the child the ray enters first so that closer hits shrink bestT early
+		uint first = nodeIndex + 1;
+		uint second = node.getSecondChild();
+		auto tFirst = intersectRaySlabs(p, invDir, dequantize(nodes[first]), bestT);
+		auto tSecond = intersectRaySlabs(p, invDir, dequantize(nodes[second]), bestT);
+		if (tFirst && tSecond && *tSecond < *tFirst)
+		{
+			std::swap(first, second);
+			std::swap(tFirst, tSecond);
+		}
+		assert(stackSize + 2 <= maxStackDepth);
+		if (tSecond)
+			stack[stackSize++] = second;
+		if (tFirst)
+			stack[stackSize++] = first;
+	}
+	return result;
+}
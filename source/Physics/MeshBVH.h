@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include "ColliderComponent.h"
+#include "GJK.h"
+
+class Mesh;
+
+// Static bounding volume hierarchy over the triangles of a Mesh.
+// Nodes are 16 bytes, their bounds are quantized to 16 bits relative to the root bounds
+// and they are stored in depth-first order: the first child of an inner node is the next node,
+// the inner node keeps only the index of its second child.
+class MeshBVH
+{
+public:
+
+	static constexpr uint maxTrianglesPerLeaf = 4u;
+
+	struct Node
+	{
+		static constexpr uint leafBit = 1u << 31;
+		static constexpr uint countShift = 24u;
+		static constexpr uint firstTriangleMask = (1u << countShift) - 1u;
+
+		bool isLeaf() const { return data & leafBit; }
+		uint getFirstTriangle() const { return data & firstTriangleMask; }
+		uint getNumTriangles() const { return (data & ~leafBit) >> countShift; }
+		uint getSecondChild() const { return data; }
+
+		ushort min[3];
+		ushort max[3];
+		uint data = 0u;
+	};
+	static_assert(sizeof(Node) == 16);
+
+	struct SphereHit
+	{
+		V4 point;
+		V4 normal; // from the surface towards the sphere center
+		float distance = 0.0f;
+		uint triangle = 0u;
+	};
+
+	struct SegmentHit
+	{
+		V4 point;
+		V4 normal; // from the surface towards the segment
+		V4 segmentPoint;
+		float distance = 0.0f;
+		uint triangle = 0u;
+	};
+
+	// Returns the BVH of the given mesh, building it only if the mesh has no BVH alive yet or changed since
+	static std::shared_ptr<const MeshBVH> get(const Mesh& mesh);
+
+	explicit MeshBVH(const Mesh& mesh);
+
+	// All queries are in mesh space
+	bool overlapsSphere(const V4& center, float radius) const;
+	std::optional<SphereHit> findClosestPoint(const V4& center, float radius) const;
+	// Closest point to the segment from a to b within radius of it, for capsules
+	std::optional<SegmentHit> findClosestPointToSegment(const V4& a, const V4& b, float radius) const;
+	// Deepest overlap of a convex shape given in mesh space with any triangle, distance is the negative penetration depth
+	std::optional<SphereHit> findConvexContact(const GjkShape& shape) const;
+	std::optional<RayIntersectResult> intersectRay(const V4& point, const V4& dir, float maxT = std::numeric_limits<float>::max(), bool anyHit = false) const;
+
+	const AABB& getBounds() const { return bounds; }
+	uint getNumNodes() const { return (uint)nodes.size(); }
+	uint getNumTriangles() const { return (uint)triangles.size() / 3u; }
+
+private:
+
+	struct BuildTriangle
+	{
+		AABB bounds;
+		V4 centroid;
+	};
+
+	uint build(std::vector<uint>& order, const std::vector<BuildTriangle>& buildTriangles, uint begin, uint end);
+	void quantize(Node& node, const AABB& aabb) const;
+	AABB dequantize(const Node& node) const;
+	void getTriangle(uint triangle, V4& a, V4& b, V4& c) const;
+
+	std::vector<Node> nodes;
+	std::vector<V3> positions;
+	std::vector<uint> triangles; // 3 indices per triangle, in leaf order
+	AABB bounds;
+	V4 quantizeScale = V4::zero();
+	V4 dequantizeScale = V4::zero();
+};
+
+// Slab test limited to [0, maxT], returns the entry distance
+std::optional<float> intersectRaySlabs(const V4& point, const V4& invDir, const AABB& aabb, float maxT);
+V4 closestPointOnTriangle(const V4& p, const V4& a, const V4& b, const V4& c);
+// Double sided, returns the ray parameter of the hit
+std::optional<float> intersectRayTriangle(const V4& point, const V4& dir, const V4& a, const V4& b, const V4& c);
+void closestPointsSegmentSegment(const V4& p1, const V4& q1, const V4& p2, const V4& q2, V4& c1, V4& c2);
+void closestPointsSegmentTriangle(const V4& p, const V4& q, const V4& a, const V4& b, const V4& c, V4& onSegment, V4& onTriangle);
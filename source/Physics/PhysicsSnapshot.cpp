@@ -0,0 +1,350 @@
+#include "PhysicsSnapshot.h"
+#include "PhysicsSystem.h"
+#include "PhysicsComponent.h"
+#include "ColliderComponent.h"
+#include "Engine/Scene.h"
+#include "Engine/Log.h"
+
+namespace
+{
+	constexpr uint snapshotMagic = 0x53594850u; // "PHYS"
+	constexpr uint snapshotVersion = 2u;
+
+	uint64 hashBytes(uint64 hash, const void* data, size_t size)
+	{
+		auto bytes = reinterpret_cast<const uchar*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template<typename T>
+	void writePod(std::vector<uchar>& out, const T* data, size_t count)
+	{
+		auto bytes = reinterpret_cast<const uchar*>(data);
+		out.insert(out.end(), bytes, bytes + sizeof(T) * count);
+	}
+
+	template<typename T>
+	bool readPod(std::span<const uchar>& in, T* data, size_t count)
+	{
+		size_t size = sizeof(T) * count;
+		if (in.size() < size)
+			return false;
+		memcpy(data, in.data(), size);
+		in = in.subspan(size);
+		return true;
+	}
+
+	struct SerializedTouch
+	{
+		uint body1 = 0u;
+		uint body2 = 0u;
+		float impulse = 0.0f;
+		uint padding = 0u;
+		V4 point;
+		V4 normal;
+	};
+
+	uint findBody(std::span<PhysicsComponent* const> bodies, const PhysicsComponent* physics)
+	{
+		return (uint)(std::find(bodies.begin(), bodies.end(), physics) - bodies.begin());
+	}
+}
+
+std::vector<PhysicsComponent*> PhysicsSnapshot::gatherBodies(Scene& scene)
+{
+	// same traversal as PhysicsSystem::update, so indices follow the solver's order
+	std::vector<PhysicsComponent*> bodies;
+	scene.forAllActors([&bodies](Actor* actor)
+	{
+		if (auto component = actor->getComponent<PhysicsComponent>())
+			bodies.push_back(component);
+	});
+	return bodies;
+}
+
+void PhysicsSnapshot::save(std::span<PhysicsComponent* const> bodies, const PhysicsSystem& physics)
+{
+	bodyStates.resize(bodies.size());
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		PhysicsComponent* body = bodies[i];
+		BodyState& state = bodyStates[i];
+		state.transform = body->getActor()->getTransformComponent().getTransform();
+		state.inertia = body->getInertia();
+		state.velocity = body->getVelocity();
+		state.angularVelocity = body->getAngularVelocity();
+		state.mass = body->getMass();
+		state.restitution = body->getRestitution();
+		state.flags = body->getFlags();
+
+		auto lastFrame = physics.lastFrameTransforms.find(body);
+		state.hasLastFrameTransform = lastFrame != physics.lastFrameTransforms.end();
+		state.lastFrameTransform = state.hasLastFrameTransform ? lastFrame->second : Mtx::identity();
+
+		auto lod = physics.lodStates.find(body);
+		state.hasLodState = lod != physics.lodStates.end();
+		state.lodSteppedTransform = state.hasLodState ? lod->second.steppedTransform : Mtx::identity();
+		state.lodPendingDt = state.hasLodState ? lod->second.pendingDt : 0.0f;
+		state.lodBand = state.hasLodState ? (uint)lod->second.band : 0u;
+		state.lodGliding = state.hasLodState && lod->second.gliding;
+	}
+
+	touching.clear();
+	for (auto& contact : physics.contactEvents.touching)
+		touching.push_back(contact.event);
+
+	separatingAxes.assign(physics.separatingAxes.begin(), physics.separatingAxes.end());
+	frameIndex = physics.frameIndex;
+}
+
+void PhysicsSnapshot::restore(std::span<PhysicsComponent* const> bodies, PhysicsSystem& physics) const
+{
+	assert(bodies.size() == bodyStates.size());
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		PhysicsComponent* body = bodies[i];
+		const BodyState& state = bodyStates[i];
+		body->getActor()->getTransformComponent().setTransform(state.transform);
+		body->setInertia(state.inertia)
+			->setVelocity(state.velocity)
+			->setAngularVelocity(state.angularVelocity)
+			->setMass(state.mass)
+			->setRestitution(state.restitution)
+			->setFlags(state.flags);
+
+		if (state.hasLastFrameTransform)
+			physics.lastFrameTransforms[body] = state.lastFrameTransform;
+		else
+			physics.lastFrameTransforms.erase(body);
+
+		if (state.hasLodState)
+			physics.lodStates[body] = { state.lodSteppedTransform, state.lodPendingDt, (PhysicsSystem::LodBand)state.lodBand, state.lodGliding != 0u };
+		else
+			physics.lodStates.erase(body);
+	}
+
+	auto& stream = physics.contactEvents;
+	stream.touching.clear();
+	for (auto& event : touching)
+		stream.touching.push_back({ { std::min(event.physics1, event.physics2), std::max(event.physics1, event.physics2) }, event });
+
+	physics.separatingAxes.clear();
+	physics.separatingAxes.insert(separatingAxes.begin(), separatingAxes.end());
+	physics.nextSeparatingAxes.clear();
+	physics.frameIndex = frameIndex;
+}
+
+uint64 PhysicsSnapshot::hash() const
+{
+	uint64 hash = hashBytes(14695981039346656037ull, bodyStates.data(), bodyStates.size() * sizeof(BodyState));
+	return hashBytes(hash, &frameIndex, sizeof(frameIndex));
+}
+
+void PhysicsSnapshot::write(std::span<PhysicsComponent* const> bodies, std::vector<uchar>& out) const
+{
+	uint header[5] = { snapshotMagic, snapshotVersion, (uint)bodyStates.size(), (uint)touching.size(), frameIndex };
+	writePod(out, header, 5);
+	writePod(out, bodyStates.data(), bodyStates.size());
+	for (auto& event : touching)
+	{
+		SerializedTouch touch = { findBody(bodies, event.physics1), findBody(bodies, event.physics2), event.impulse, 0u, event.point, event.normal };
+		writePod(out, &touch, 1);
+	}
+}
+
+bool PhysicsSnapshot::read(std::span<PhysicsComponent* const> bodies, std::span<const uchar> in)
+{
+	uint header[5] = {};
+	if (!readPod(in, header, 5) || header[0] != snapshotMagic || header[1] != snapshotVersion || header[2] != bodies.size())
+	{
+		logLine(x, Error, "Physics snapshot doesn't match the scene");
+		return false;
+	}
+
+	frameIndex = header[4];
+	separatingAxes.clear();
+	bodyStates.resize(header[2]);
+	if (!readPod(in, bodyStates.data(), bodyStates.size()))
+		return false;
+
+	touching.clear();
+	for (uint i = 0; i < header[3]; ++i)
+	{
+		SerializedTouch touch;
+		if (!readPod(in, &touch, 1) || touch.body1 >= bodies.size() || touch.body2 >= bodies.size())
+			return false;
+		touching.push_back({ ContactEvent::Type::Persist, bodies[touch.body1], bodies[touch.body2], touch.point, touch.normal, touch.impulse });
+	}
+	return true;
+}
+
+void PhysicsDeltaSnapshot::build(const PhysicsSnapshot& baseline, const PhysicsSnapshot& current)
+{
+	assert(baseline.bodyStates.size() == current.bodyStates.size());
+	numBodies = (uint)current.bodyStates.size();
+	changedMask.assign((numBodies + 63) / 64, 0ull);
+	changedStates.clear();
+	for (uint i = 0; i < numBodies; ++i)
+	{
+		if (memcmp(&baseline.bodyStates[i], &current.bodyStates[i], sizeof(PhysicsSnapshot::BodyState)) != 0)
+		{
+			changedMask[i / 64] |= 1ull << (i % 64);
+			changedStates.push_back(current.bodyStates[i]);
+		}
+	}
+	touching = current.touching;
+	separatingAxes = current.separatingAxes;
+	frameIndex = current.frameIndex;
+}
+
+void PhysicsDeltaSnapshot::apply(const PhysicsSnapshot& baseline, PhysicsSnapshot& out) const
+{
+	assert(baseline.bodyStates.size() == numBodies);
+	out.bodyStates = baseline.bodyStates;
+	uint changed = 0u;
+	for (uint word = 0; word < changedMask.size(); ++word)
+	{
+		for (uint64 bits = changedMask[word]; bits; bits &= bits - 1)
+			out.bodyStates[word * 64 + std::countr_zero(bits)] = changedStates[changed++];
+	}
+	out.touching = touching;
+	out.separatingAxes = separatingAxes;
+	out.frameIndex = frameIndex;
+}
+
+void PhysicsReplay::beginRecording(Scene& scene, PhysicsSystem& physics)
+{
+	bodies = PhysicsSnapshot::gatherBodies(scene);
+	initialState.save(bodies, physics);
+	frames.clear();
+	inputs.clear();
+}
+
+void PhysicsReplay::recordFrame(const PhysicsSystem& physics, float dt, std::span<const uchar> input)
+{
+	scratch.save(bodies, physics);
+	frames.push_back({ dt, (uint)inputs.size(), (uint)input.size(), scratch.hash() });
+	inputs.insert(inputs.end(), input.begin(), input.end());
+}
+
+std::optional<uint> PhysicsReplay::replay(Scene& scene, PhysicsSystem& physics, const ApplyInput& applyInput) const
+{
+	initialState.restore(bodies, physics);
+	for (uint i = 0; i < frames.size(); ++i)
+	{
+		const Frame& frame = frames[i];
+		applyInput(std::span<const uchar>(inputs).subspan(frame.inputOffset, frame.inputSize));
+		physics.update(scene, frame.dt);
+		scratch.save(bodies, physics);
+		if (scratch.hash() != frame.hash)
+		{
+			logLine(x, Warning, "Physics replay diverged at frame {} of {}", i, frames.size());
+			return i;
+		}
+	}
+	return {};
+}
+
+void testPhysicsReplay()
+{
+	Scene scene;
+	PhysicsSystem physics;
+
+	Actor* arena = scene.addActor();
+	arena->addComponent<PhysicsComponent>()->setFlags(PhysicsComponent::Heavy);
+	arena->addComponent<PlaneColliderComponent>()->setEquation({ 0.0f, 0.0f, 1.0f, 0.0f });
+	arena->addComponent<PlaneColliderComponent>()->setEquation({ 1.0f, 0.0f, 0.0f, 4.0f });
+	arena->addComponent<PlaneColliderComponent>()->setEquation({ 1.0f, 0.0f, 0.0f, -4.0f });
+
+	const int numBalls = 4;
+	for (int i = 0; i < numBalls; ++i)
+	{
+		Actor* ball = scene.addActor();
+		ball->getTransformComponent().setTransform(Mtx::translate({ -3.0f + i * 2.0f, 0.0f, 1.0f + i }));
+		ball->addComponent<PhysicsComponent>()->setFlags(PhysicsComponent::Dynamic | PhysicsComponent::Gravity)->setRestitution(0.8f);
+		ball->addComponent<SphereColliderComponent>();
+	}
+
+	// static props behind the balls, so most of the scene doesn't change between snapshots
+	const int numProps = 16;
+	for (int i = 0; i < numProps; ++i)
+	{
+		Actor* prop = scene.addActor();
+		prop->getTransformComponent().setTransform(Mtx::translate({ -7.5f + i, 4.0f, 0.5f }));
+		prop->addComponent<PhysicsComponent>()->setFlags(PhysicsComponent::Heavy);
+		prop->addComponent<BoxColliderComponent>();
+	}
+
+	auto bodies = PhysicsSnapshot::gatherBodies(scene);
+	auto applyInput = [&bodies](std::span<const uchar> input)
+	{
+		V4 push;
+		if (input.size() == sizeof(push))
+		{
+			memcpy(&push, input.data(), sizeof(push));
+			bodies[1]->setVelocity(bodies[1]->getVelocity() + push);
+		}
+	};
+
+	const float dt = 16.0f;
+	// the first update gives every body its last frame transform, after that only the balls change
+	physics.update(scene, dt);
+
+	PhysicsReplay replay;
+	replay.beginRecording(scene, physics);
+	PhysicsSnapshot baseline;
+	baseline.save(bodies, physics);
+
+	for (int frame = 0; frame < 240; ++frame)
+	{
+		V4 push = { 0.002f, 0.0f, 0.001f, 0.0f };
+		auto input = frame % 40 == 0 ? std::span<const uchar>(reinterpret_cast<const uchar*>(&push), sizeof(push)) : std::span<const uchar>();
+		applyInput(input);
+		physics.update(scene, dt);
+		replay.recordFrame(physics, dt, input);
+	}
+
+	PhysicsSnapshot current;
+	current.save(bodies, physics);
+	PhysicsDeltaSnapshot delta;
+	delta.build(baseline, current);
+	PhysicsSnapshot rebuilt;
+	delta.apply(baseline, rebuilt);
+
+	std::vector<uchar> bytes;
+	current.write(bodies, bytes);
+	PhysicsSnapshot loaded;
+	bool readOk = loaded.read(bodies, bytes);
+
+	auto diverged = replay.replay(scene, physics, applyInput);
+	PhysicsSnapshot replayed;
+	replayed.save(bodies, physics);
+	auto sameStates = [](const PhysicsSnapshot& a, const PhysicsSnapshot& b)
+	{
+		auto& statesA = a.getBodyStates();
+		auto& statesB = b.getBodyStates();
+		return statesA.size() == statesB.size() && memcmp(statesA.data(), statesB.data(), statesA.size() * sizeof(PhysicsSnapshot::BodyState)) == 0;
+	};
+
+	logLine(x, Verbose, "Physics replay: {} frames, {}, full snapshot {} bytes, delta {} bytes ({} of {} bodies changed)",
+		replay.getNumFrames(), diverged ? "diverged" : "matched", current.getSize(), delta.getSize(), delta.getNumChanged(), bodies.size());
+
+	// asserts are gone in release builds, failures are logged as errors as well
+	auto check = [](bool passed, const char* what)
+	{
+		if (!passed)
+			logLine(x, Error, "Physics replay test failed: {}", what);
+		assert(passed);
+	};
+	check(!diverged, "the replay diverged");
+	check(sameStates(replayed, current), "the replayed state differs from the recorded one");
+	check(delta.getNumChanged() == numBalls, "the delta snapshot holds other bodies than the balls");
+	check(delta.getSize() < current.getSize(), "the delta snapshot isn't smaller than the full one");
+	check(sameStates(rebuilt, current), "the state rebuilt from the delta differs");
+	check(readOk && sameStates(loaded, current), "the state read back differs");
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+#include "ContactEvents.h"
+#include <bit>
+#include <functional>
+#include <span>
+
+class Scene;
+class PhysicsComponent;
+class PhysicsSystem;
+
+// Complete physics state of a scene: every PhysicsComponent, its actor's transform and the solver's
+// per-body history, packed into flat arrays of plain structs. The solver keeps its history by body, so saving and
+// restoring looks every body up once, hashing and building deltas are straight passes over the array.
+// Bodies are identified by their index in gatherBodies(), which is stable as long as the scene's actors don't change.
+class PhysicsSnapshot
+{
+public:
+
+	struct BodyState
+	{
+		Mtx transform;
+		Mtx lastFrameTransform;
+		Mtx inertia;
+		Mtx lodSteppedTransform;
+		V4 velocity;
+		V4 angularVelocity;
+		float mass = 0.0f;
+		float restitution = 0.0f;
+		uint flags = 0u;
+		uint hasLastFrameTransform = 0u;
+		float lodPendingDt = 0.0f;
+		uint lodBand = 0u;
+		uint lodGliding = 0u;
+		uint hasLodState = 0u;
+	};
+	static_assert(sizeof(BodyState) == sizeof(Mtx) * 4 + sizeof(V4) * 2 + 32, "BodyState is hashed and compared bytewise, it must not have padding");
+
+	static std::vector<PhysicsComponent*> gatherBodies(Scene& scene);
+
+	void save(std::span<PhysicsComponent* const> bodies, const PhysicsSystem& physics);
+	void restore(std::span<PhysicsComponent* const> bodies, PhysicsSystem& physics) const;
+
+	// Covers the body states and the frame index, the touching pairs refer to bodies by pointer
+	uint64 hash() const;
+	size_t getSize() const { return bodyStates.size() * sizeof(BodyState) + touching.size() * sizeof(ContactEvent) + separatingAxes.size() * sizeof(SeparatingAxis); }
+
+	// Binary form for saving to disk or sending, touching pairs are stored as body indices.
+	// The GJK warm start axes are keyed by collider serials that only mean something in this process, so they
+	// aren't written and a snapshot read back starts its pair tests cold
+	void write(std::span<PhysicsComponent* const> bodies, std::vector<uchar>& out) const;
+	bool read(std::span<PhysicsComponent* const> bodies, std::span<const uchar> in);
+
+	const std::vector<BodyState>& getBodyStates() const { return bodyStates; }
+
+private:
+
+	friend class PhysicsDeltaSnapshot;
+
+	using SeparatingAxis = std::pair<uint64, V4>;
+
+	std::vector<BodyState> bodyStates;
+	std::vector<ContactEvent> touching; // pairs in contact at the end of the step, for begin/end events after a restore
+	std::vector<SeparatingAxis> separatingAxes; // GJK warm starts, a replay has to test the pairs from the same axes
+	uint frameIndex = 0u; // picks the frames reduced rate bodies step in
+};
+
+// Bodies that changed since a baseline snapshot, one bit per body plus the changed states.
+// Resting and static bodies cost a bit each, which is what makes rollback buffers and network updates small.
+class PhysicsDeltaSnapshot
+{
+public:
+
+	void build(const PhysicsSnapshot& baseline, const PhysicsSnapshot& current);
+	void apply(const PhysicsSnapshot& baseline, PhysicsSnapshot& out) const;
+
+	size_t getSize() const { return changedMask.size() * sizeof(uint64) + changedStates.size() * sizeof(PhysicsSnapshot::BodyState) + touching.size() * sizeof(ContactEvent) + separatingAxes.size() * sizeof(PhysicsSnapshot::SeparatingAxis); }
+	uint getNumChanged() const { return (uint)changedStates.size(); }
+
+private:
+
+	uint numBodies = 0u;
+	std::vector<uint64> changedMask;
+	std::vector<PhysicsSnapshot::BodyState> changedStates;
+	std::vector<ContactEvent> touching; // always complete, there are few of them
+	std::vector<PhysicsSnapshot::SeparatingAxis> separatingAxes;
+	uint frameIndex = 0u;
+};
+
+// Records the input and the resulting state hash of every frame, then re-simulates the whole log
+// from the initial snapshot and reports the first frame that diverged.
+class PhysicsReplay
+{
+public:
+
+	using ApplyInput = std::function<void(std::span<const uchar> input)>;
+
+	void beginRecording(Scene& scene, PhysicsSystem& physics);
+	// Call after the physics update of the frame the input was applied in
+	void recordFrame(const PhysicsSystem& physics, float dt, std::span<const uchar> input);
+
+	// Returns the index of the first frame whose state hash differs, nothing when the replay matched
+	std::optional<uint> replay(Scene& scene, PhysicsSystem& physics, const ApplyInput& applyInput) const;
+
+	uint getNumFrames() const { return (uint)frames.size(); }
+
+private:
+
+	struct Frame
+	{
+		float dt = 0.0f;
+		uint inputOffset = 0u;
+		uint inputSize = 0u;
+		uint64 hash = 0u;
+	};
+
+	std::vector<PhysicsComponent*> bodies;
+	PhysicsSnapshot initialState;
+	std::vector<Frame> frames;
+	std::vector<uchar> inputs;
+	mutable PhysicsSnapshot scratch;
+};
+
+void testPhysicsReplay();
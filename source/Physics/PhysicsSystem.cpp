@@ -2,6 +2,14 @@
 #include "PhysicsComponent.h"
 #include "ColliderComponent.h"
 #include "Engine/TransformComponent.h"
+#include "Console/GlobalVar.h"
+
+GlobalVar<int> gPhysicsLod("physicsLod", 1);
+GlobalVar<float> gPhysicsLodFullRateDistance("physicsLodFullRateDistance", 8.0f);
+GlobalVar<float> gPhysicsLodHalfRateDistance("physicsLodHalfRateDistance", 16.0f);
+GlobalVar<float> gPhysicsLodQuarterRateDistance("physicsLodQuarterRateDistance", 32.0f);
+GlobalVar<int> gStatPhysicsLodSkippedSteps("statPhysicsLodSkippedSteps", 0);
+GlobalVar<int> gStatPhysicsLodPairTestsSaved("statPhysicsLodPairTestsSaved", 0);
 
 struct PhysicsEntity
 {
@@ -9,6 +17,18 @@ struct PhysicsEntity
 	std::vector<ColliderComponent*> colliders;
 };
 
+PhysicsSystem::LodBand PhysicsSystem::getLodBand(const V4& position) const
+{
+	float distance = (position - *lodCenter).xyz().length();
+	if (distance < gPhysicsLodFullRateDistance.get())
+		return LodBand::FullRate;
+	if (distance < gPhysicsLodHalfRateDistance.get())
+		return LodBand::HalfRate;
+	if (distance < gPhysicsLodQuarterRateDistance.get())
+		return LodBand::QuarterRate;
+	return LodBand::Kinematic;
+}
+
 void PhysicsSystem::update(Scene& scene, float dt)
 {
 	std::vector<PhysicsEntity> entities;
@@ -24,6 +44,10 @@ void PhysicsSystem::update(Scene& scene, float dt)
 		}
 	});
 
+	lodStats = {};
+	stepStats = {};
+	bool useLod = lodCenter && gPhysicsLod.get();
+	contactEvents.beginStep();
 	for (auto& entity1 : entities)
 	{
 		auto physics = entity1.physics;
@@ -31,22 +55,71 @@ void PhysicsSystem::update(Scene& scene, float dt)
 			continue;
 		
 		TransformComponent& tComp1 = physics->getActor()->getTransformComponent();
+		float stepDt = dt;
+		if (useLod)
+		{
+			// carried over into the next map so the states of removed bodies are dropped, a new body that
+			// reuses the address of a removed one must not inherit its gliding state
+			auto& lod = nextLodStates[physics];
+			auto lodIt = lodStates.find(physics);
+			if (lodIt != lodStates.end())
+				lod = lodIt->second;
+			LodBand band = getLodBand(tComp1.getTransform().getPosition());
+			++lodStats.numBodies[(int)band];
+
+			// bodies with a reduced rate step every 2nd or 4th frame, staggered so the work is spread evenly.
+			// In between they glide along their velocity and the next step starts again from the last simulated
+			// transform with all the skipped time, kinematic bodies only ever glide and never test for collisions
+			uint interval = 1u << (uint)band;
+			uint entityIndex = (uint)(&entity1 - entities.data());
+			bool stepNow = band == LodBand::FullRate || band < lod.band || (band != LodBand::Kinematic && (frameIndex + entityIndex) % interval == 0);
+			lod.band = band;
+			if (!stepNow)
+			{
+				if (band == LodBand::Kinematic)
+				{
+					// there is no step to go back to, a body that glided into this band stays where it got
+					lod.gliding = false;
+					lod.pendingDt = 0.0f;
+				}
+				else
+				{
+					if (!lod.gliding)
+					{
+						lod.steppedTransform = tComp1.getTransform();
+						lod.gliding = true;
+					}
+					lod.pendingDt += dt;
+				}
+				tComp1.setTransform(tComp1.getTransform() * Mtx::translate(physics->getVelocity() * dt));
+				++lodStats.numSkippedSteps;
+				lodStats.numPairTestsSaved += entities.size() - 1;
+				continue;
+			}
+
+			if (lod.gliding)
+				tComp1.setTransform(lod.steppedTransform);
+			stepDt = lod.pendingDt + dt;
+			lod.pendingDt = 0.0f;
+			lod.gliding = false;
+		}
+
 		V4 velocity = physics->getVelocity();
 		if (physics->getFlags() & PhysicsComponent::Gravity)
 		{
 			V4 acceleration = V4{ 0.0f, 0.0f,-0.0000025f };
-			velocity += acceleration * dt;
+			velocity += acceleration * stepDt;
 		}
 		physics->setVelocity(velocity);
 		Mtx entity1_OriginalTransform = tComp1.getTransform();
 		auto transform = entity1_OriginalTransform;
 		auto angularVelocity = physics->getAngularVelocity();
-		transform = transform * Mtx::translate(velocity * dt);
+		transform = transform * Mtx::translate(velocity * stepDt);
 		if (angularVelocity.w != 0.0f)
 		{
 			V4 pos = transform.getPosition();
 			transform = transform * Mtx::translate(pos * -1.0f);
-			transform = transform * Mtx::rotate(angularVelocity.xyz(), angularVelocity.w * dt);
+			transform = transform * Mtx::rotate(angularVelocity.xyz(), angularVelocity.w * stepDt);
 			transform = transform * Mtx::translate(pos);
 		}
 		tComp1.setTransform(transform);
@@ -56,22 +129,27 @@ void PhysicsSystem::update(Scene& scene, float dt)
 			if (&entity1 == &entity2)
 				continue;
 
-			auto&& collided = [&entity1_OriginalTransform](PhysicsEntity& a, PhysicsEntity& b) -> std::optional<V4>
+			auto&& collided = [this, &entity1_OriginalTransform](PhysicsEntity& a, PhysicsEntity& b) -> std::optional<Collision>
 			{
 				for (auto collider1 : a.colliders)
 					for (auto collider2 : b.colliders)
 					{
-						if (auto collision = collider1->intersects(*collider2, 
-							ColliderComponent::Context{ entity1_OriginalTransform }))
-						{
-							return collision->normal;
-						}
+						++stepStats.numPairTests;
+						uint64 pairKey = (uint64)collider1->getSerial() << 32 | collider2->getSerial();
+						auto axisIt = separatingAxes.empty() ? separatingAxes.end() : separatingAxes.find(pairKey);
+						V4 separatingAxis = axisIt != separatingAxes.end() ? axisIt->second : V4::zero();
+						auto collision = collider1->intersects(*collider2, 
+							ColliderComponent::Context{ entity1_OriginalTransform, nullptr, &separatingAxis });
+						if (separatingAxis.length2() > 0.0f)
+							nextSeparatingAxes[pairKey] = separatingAxis;
+						if (collision)
+							return collision;
 					}
 
 				return {};
 			};
 
-			if (auto nOpt = collided(entity1, entity2))
+			if (auto collision = collided(entity1, entity2))
 			{
 				auto physics1 = entity1.physics;
 				auto physics2 = entity2.physics;
@@ -88,7 +166,7 @@ void PhysicsSystem::update(Scene& scene, float dt)
 						auto lastFrameE2 = lastFrameTransforms.find(entity2.physics);
 						if (lastFrameE1 != lastFrameTransforms.end() && lastFrameE2 != lastFrameTransforms.end())
 						{
-							v2 = (tComp2.getTransform().getPosition() - lastFrameE2->second.getPosition()) / dt;
+							v2 = (tComp2.getTransform().getPosition() - lastFrameE2->second.getPosition()) / stepDt;
 							tComp1.setTransform(lastFrameE1->second);
 							tComp2.setTransform(lastFrameE2->second);
 						}
@@ -101,7 +179,7 @@ void PhysicsSystem::update(Scene& scene, float dt)
 				float invM2 = physics2->getFlags() & PhysicsComponent::Heavy ? 0.0f : 1.0f / physics2->getMass();
 				assert(invM1 + invM2 != 0.0f);
 
-				V4 n = nOpt.value();				
+				V4 n = collision->normal;
 
 				float j = (v1 - v2).dot(n) * (e + 1) / (n.dot(n) * (invM1 + invM2));
 
@@ -113,9 +191,27 @@ void PhysicsSystem::update(Scene& scene, float dt)
 
 				if (physics2->getFlags() & PhysicsComponent::Dynamic)
 					physics2->setVelocity(newV2);
+
+				contactEvents.addContact(physics1, physics2, collision->point, n, j);
+				++stepStats.numContacts;
 			}
 		}
 	}
+	std::vector<const PhysicsComponent*> liveBodies;
+	liveBodies.reserve(entities.size());
+	for (auto& entity : entities)
+		liveBodies.push_back(entity.physics);
+	std::sort(liveBodies.begin(), liveBodies.end());
+	contactEvents.endStep(liveBodies);
+	std::swap(separatingAxes, nextSeparatingAxes);
+	nextSeparatingAxes.clear();
+	std::swap(lodStates, nextLodStates);
+	nextLodStates.clear();
+	++frameIndex;
+	gStatPhysicsLodSkippedSteps.set((int)lodStats.numSkippedSteps);
+	gStatPhysicsLodPairTestsSaved.set((int)lodStats.numPairTestsSaved);
+
+	lastFrameTransforms.clear();
 	for (auto& entity : entities)
 		lastFrameTransforms[entity.physics] = entity.physics->getActor()->getTransformComponent().getTransform();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Engine/Scene.h"
+#include "ContactEvents.h"
 
 class PhysicsComponent;
 
@@ -10,6 +11,61 @@ public:
 
 	void update(Scene& scene, float dt);
 
+	// Bodies farther from this point are stepped less often, see the physicsLod* vars
+	void setLodCenter(std::optional<V4> center) { lodCenter = center; }
+
+	enum class LodBand : uchar
+	{
+		FullRate,
+		HalfRate,
+		QuarterRate,
+		Kinematic
+	};
+
+	struct LodStats
+	{
+		uint numBodies[4] = {}; // per LodBand
+		uint numSkippedSteps = 0u;
+		uint64 numPairTestsSaved = 0u;
+	};
+	const LodStats& getLodStats() const { return lodStats; }
+
+	// Counters of the last update
+	struct StepStats
+	{
+		uint64 numPairTests = 0u; // collider pairs
+		uint numContacts = 0u;
+	};
+	const StepStats& getStepStats() const { return stepStats; }
+
+	// Hands the contact events gathered since the last call to the listeners, call once per frame
+	void dispatchContactEvents() { contactEvents.dispatch(); }
+	ContactEventStream& getContactEvents() { return contactEvents; }
+
 protected:
+	friend class PhysicsSnapshot;
+
+	struct LodState
+	{
+		Mtx steppedTransform = Mtx::identity();
+		float pendingDt = 0.0f;
+		LodBand band = LodBand::FullRate;
+		bool gliding = false;
+	};
+
+	LodBand getLodBand(const V4& position) const;
+
+	ContactEventStream contactEvents;
 	std::unordered_map<PhysicsComponent*, Mtx> lastFrameTransforms;
+	// Only the dynamic bodies stepped with LOD in the last update are kept, like the separating axes below
+	std::unordered_map<PhysicsComponent*, LodState> lodStates;
+	std::unordered_map<PhysicsComponent*, LodState> nextLodStates;
+	// Separating axes GJK found in the last update, keyed by both collider serials. Only the pairs tested
+	// again are kept, so the pairs of removed colliders are gone after one update.
+	std::unordered_map<uint64, V4> separatingAxes;
+	std::unordered_map<uint64, V4> nextSeparatingAxes;
+	std::optional<V4> lodCenter;
+	LodStats lodStats;
+	StepStats stepStats;
+	uint frameIndex = 0u;
 };
@@ -1,38 +1,114 @@
 ﻿#include "Rendering/VisualComponent.h"
 #include "Engine/Log.h"
 
-void VisualComponent::playAnimation(const SkelAnimation* animation_, const SkelAnimation::Frame* initialFrame_)
+void VisualComponent::AnimationSource::advance(float dt)
+{
+    if (!blendTree)
+    {
+        time += dt;
+        return;
+    }
+
+    float duration = blendTree->getDuration(parameters);
+    if (duration > 0.0f)
+        time = fmodf(time + dt / duration, 1.0f);
+}
+
+std::optional<SkelAnimation::Bounds> VisualComponent::AnimationSource::getBounds() const
+{
+    if (blendTree)
+        return blendTree->getBounds(time);
+    if (animation && animation->hasBounds())
+        return animation->getBounds(time);
+    return std::nullopt;
+}
+
+std::optional<SkelAnimation::Bounds> VisualComponent::getAnimationBounds() const
+{
+    if (isPlayingBakedAnimation())
+        return model->getBakedAnimation()->getBounds(bakedAnimationTime);
+    if (!current.isSet())
+        return std::nullopt;
+
+    auto bounds = current.getBounds();
+    if (bounds && isFading())
+    {
+        auto previousBounds = previous.getBounds();
+        bounds = previousBounds ? bounds->merged(*previousBounds) : std::optional<SkelAnimation::Bounds>{};
+    }
+    return bounds;
+}
+
+void VisualComponent::play(AnimationSource source, const SkelAnimation::Frame* initialFrame_, float fadeMs)
+{
+    // a fade during a fade drops the older source and blends out of the newer one
+    if (fadeMs > 0.0f && current.isSet() && current.getNumBones() == source.getNumBones())
+    {
+        previous = std::move(current);
+        fadeTime = 0.0f;
+        fadeDuration = fadeMs;
+    }
+    else
+    {
+        previous = {};
+    }
+    current = std::move(source);
+    initialFrame = initialFrame_;
+    isAnimationPlaying = true;
+    playsBakedAnimation = false;
+}
+
+void VisualComponent::playAnimation(const SkelAnimation* animation_, const SkelAnimation::Frame* initialFrame_, float fadeMs)
 {
     if (animation_)
     {
-        animation = animation_;
-        initialFrame = initialFrame_;
-        assert(animation->getFramerate() > 0.0f);
-        time = 0.0f;
-        isAnimationPlaying = true;
+        assert(animation_->getFramerate() > 0.0f);
+        AnimationSource source;
+        source.animation = animation_;
+        play(std::move(source), initialFrame_, fadeMs);
     }
 }
 
-void VisualComponent::stopAnimation()
+void VisualComponent::playBlendTree(const BlendTree* blendTree_, const SkelAnimation::Frame* initialFrame_, float fadeMs)
 {
-    isAnimationPlaying = false;
+    if (blendTree_)
+    {
+        AnimationSource source;
+        source.blendTree = blendTree_;
+        source.parameters = blendTree_->getDefaultParameters();
+        play(std::move(source), initialFrame_, fadeMs);
+    }
+}
+
+void VisualComponent::playBakedAnimation(float startTime)
+{
+    assert(model && model->getBakedAnimation());
+    current = {};
+    previous = {};
+    playsBakedAnimation = true;
+    bakedAnimationTime = startTime;
+    isAnimationPlaying = true;
 }
 
-const SkelAnimation::Frame* VisualComponent::getAnimationFrame() const
+void VisualComponent::stopAnimation()
 {
-    if (!animation)
-        return nullptr;
-    
-    float framerate = animation->getFramerate();
-    uint numFrames = animation->getNumFrames();
-    int frameIndex = (int)((time / 1000) * framerate);
-    frameIndex = frameIndex % numFrames;
-    return &animation->getFrame(frameIndex);
+    isAnimationPlaying = false;
 }
+
 void VisualComponent::tick(float dt)
 {
-    if (animation && isAnimationPlaying)
+    if (isPlayingBakedAnimation() && isAnimationPlaying)
+        bakedAnimationTime = fmodf(bakedAnimationTime + dt * animationSpeed, model->getBakedAnimation()->getDuration());
+
+    if (current.isSet() && isAnimationPlaying)
     {
-        time += dt * animationSpeed;
+        current.advance(dt * animationSpeed);
+        if (isFading())
+        {
+            previous.advance(dt * animationSpeed);
+            fadeTime += dt;
+            if (fadeTime >= fadeDuration)
+                previous = {};
+        }
     }
 }
\ No newline at end of file
@@ -11,6 +11,8 @@
 #include <glm/gtx/hash.hpp>
 
 #include "Animation/SkelAnimation.h"
+#include "Animation/Pose.h"
+#include "Animation/BlendTree.h"
 #include "Engine/Actor.h"
 
 class Material
@@ -50,11 +52,30 @@ public:
 	const Material* getMaterial() const { return material; }
 	VisualComponent* setMaterial(const Material* material_) { material = material_; return this; }
 	
-	void playAnimation(const SkelAnimation* animation, const SkelAnimation::Frame* initialFrame);
+	// With a fade time, whatever played before keeps playing and is blended out over that many ms
+	void playAnimation(const SkelAnimation* animation, const SkelAnimation::Frame* initialFrame, float fadeMs = 0.0f);
+	// Parameters start at the tree's defaults
+	void playBlendTree(const BlendTree* blendTree, const SkelAnimation::Frame* initialFrame, float fadeMs = 0.0f);
+	VisualComponent* setBlendParameter(uint parameter, float value) { current.parameters[parameter] = value; return this; }
+	float getBlendParameter(uint parameter) const { return current.parameters[parameter]; }
+	// Plays the clip baked on the model's mesh, see Model::setBakedAnimation. The vertex shader poses it, so there's
+	// no skeleton or pose and AnimationSystem skips the visual. startTime in ms keeps a crowd out of step.
+	void playBakedAnimation(float startTime = 0.0f);
+	bool isPlayingBakedAnimation() const { return playsBakedAnimation && model && model->getBakedAnimation(); }
+	float getBakedAnimationTime() const { return bakedAnimationTime; }
 	void stopAnimation();
 	void setAnimationSpeed(float speed) { animationSpeed = speed; }
-	const SkelAnimation::Frame* getAnimationFrame() const;
+	// Bones used to bring the sampled pose to model space, without one the clip has to be in root space already
+	VisualComponent* setSkeleton(const Skeleton* skeleton_) { skeleton = skeleton_; return this; }
+	const Skeleton* getSkeleton() const { return skeleton; }
+	// Interpolated between the clip's frames, filled by AnimationSystem::update
+	const Pose* getAnimationPose() const { return current.isSet() && pose.getNumBones() > 0 ? &pose : nullptr; }
 	const SkelAnimation::Frame* getInitialAnimationFrame() const { return initialFrame; }
+	// Bind pose to animation pose matrices, see Pose::writeSkinningPalette. Empty until AnimationSystem::update posed it.
+	std::span<const float> getSkinningPalette() const { return getAnimationPose() ? palette : std::span<const float>{}; }
+	// Model space bounds of the skinned mesh at the current time, none if nothing plays or the clips have no bounds.
+	// While fading both sources' bounds are merged.
+	std::optional<SkelAnimation::Bounds> getAnimationBounds() const;
 	
 	void setLocalTransform(const Mtx& transform) { this->transform = transform; }
 	const Mtx& getLocalTransform() const { return transform; }
@@ -63,13 +84,39 @@ public:
 	virtual void tick(float dt) override;
 
 private:
+	friend class AnimationSystem;
+
+	// A clip or a blend tree and how far into it the visual is
+	struct AnimationSource
+	{
+		const SkelAnimation* animation = nullptr;
+		const BlendTree* blendTree = nullptr;
+		std::vector<float> parameters;
+		// ms into the clip, for a blend tree the phase of its synced loop from 0 to 1
+		float time = 0.0f;
+
+		bool isSet() const { return animation || blendTree; }
+		uint getNumBones() const { return animation ? animation->getNumBones() : blendTree->getNumBones(); }
+		void advance(float dt);
+		std::optional<SkelAnimation::Bounds> getBounds() const;
+	};
+
+	void play(AnimationSource source, const SkelAnimation::Frame* initialFrame, float fadeMs);
+	bool isFading() const { return previous.isSet(); }
+
 	const Model* model = nullptr;
 	const Material* material = nullptr;
 	const Skeleton* skeleton = nullptr;
-	const SkelAnimation* animation = nullptr;
+	AnimationSource current;
+	AnimationSource previous;
+	float fadeTime = 0.0f;
+	float fadeDuration = 0.0f;
 	const SkelAnimation::Frame* initialFrame = nullptr;
-	float time = 0.0f;
+	Pose pose;
+	std::span<const float> palette;
 	bool isAnimationPlaying = false;
+	bool playsBakedAnimation = false;
+	float bakedAnimationTime = 0.0f;
 	float animationSpeed = 1.0f;
 	Mtx transform = Mtx::identity();
 };
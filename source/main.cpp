@@ -10,9 +10,15 @@
 #include "Physics/PhysicsSystem.h"
 #include "Physics/PhysicsComponent.h"
 #include "Physics/ColliderComponent.h"
+#include "Physics/PhysicsSnapshot.h"
 #include "Animation/Skeleton.h"
 #include "Animation/SkelAnimation.h"
 #include "Animation/Mesh.h"
+#include "Animation/AnimationSystem.h"
+#include "Animation/BlendTree.h"
+#include "Animation/BakedAnimation.h"
+#include "Animation/Meshlets.h"
+#include "Importers/IqmFile.h"
 #include "Engine/Scene.h"
 #include "Engine/Log.h"
 #include "Engine/Test/TestObject.h"
@@ -24,6 +30,7 @@ const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 GlobalVar<float> gTestVar("testVar", 1.0f);
+GlobalVar<int> gStatCatContacts("statCatContacts", 0);
 std::string testConsoleFunc(std::vector<std::string> args)
 {
 	if (args.size() != 2)
@@ -47,6 +54,8 @@ public:
 		
 		testTestObject();
 		testSphereBoxCollisions();
+		testPhysicsReplay();
+		testMeshletCulling();
 		
 		initWindow();
 		renderer.init(window);
@@ -71,13 +80,26 @@ public:
 		floorActor->getComponent<VisualComponent>()->setMaterial(&floorMaterial);
 
 		//cat
-		std::string meshPath = "models/cat.iqm";
+		IqmFile catFile("models/cat.iqm");
 		Skeleton skeleton;
-		skeleton.load(meshPath);
+		skeleton.load(catFile);
 		Animations animations;
-		SkelAnimation::load(meshPath, animations);
-		animations.convertToRootSpace(skeleton);
-		auto meshes = Mesh::loadiqm(meshPath);
+		SkelAnimation::load(catFile, animations);
+		SkelAnimation::Frame restFrame = animations.initialFrame; // still parent-relative like the clips, the cat standing still
+		animations.initialFrame.convertToRootSpace(skeleton); // clips stay parent-relative, AnimationSystem converts the sampled poses
+		for (auto& animation : animations.animations)
+			animation.compress({ 0.002f, 0.002f, 0.002f });
+		BlendTree catBlendTree;
+		catSpeedParameter = catBlendTree.addParameter("speed");
+		catBlendTree.addBlend1D(catSpeedParameter, { catBlendTree.addFrame(&restFrame), catBlendTree.addClip(&animations.animations[0]) }, { 0.0f, 1.0f });
+		auto meshes = Mesh::loadiqm(catFile);
+		WorkerPool loadWorkers;
+		Mesh::generateLods(meshes, {}, loadWorkers);
+		for (auto& animation : animations.animations)
+		{
+			if (!animation.hasBounds())
+				animation.computeBounds(meshes, skeleton, animations.initialFrame);
+		}
 		Texture catTexture;
 		catTexture.load(&renderer, "textures/cat.png");
 		Material catMaterial;
@@ -91,12 +113,24 @@ public:
 		Material catColliderMaterial;
 		catColliderMaterial.setColor(1.0f, 0.95f, 0.5f);
 		catActor = scene.addActor();
-		catActor->addComponent<VisualComponent>()->setModel(&catModel)->setMaterial(&catMaterial)->playAnimation(&animations.animations[0], &animations.initialFrame);
-		Mtx colliderT = Mtx::scale({4.0f, 4.0f, 4.0f}) * Mtx::translate({1.5f, 0.0f, 1.5f});
+		catActor->addComponent<VisualComponent>()->setModel(&catModel)->setMaterial(&catMaterial)->setSkeleton(&skeleton)->playBlendTree(&catBlendTree, &animations.initialFrame);
+		Mtx colliderT = Mtx::rotate({0.0f, PI / 2, 0.0f}) * Mtx::translate({1.5f, 0.0f, 1.5f});
 		//catActor->addComponent<VisualComponent>()->setModel(&catColliderModel)->setMaterial(&catColliderMaterial)->setLocalTransform(colliderT);
 		catActor->getTransformComponent().setTransform(Mtx::scale(V4{0.25f, 0.25f, 0.25f}));
 		catActor->addComponent<PhysicsComponent>()->setFlags(PhysicsComponent::Heavy);
-		catActor->addComponent<SphereColliderComponent>()->setLocalTransform(colliderT);
+		catActor->addComponent<CapsuleColliderComponent>()->setShape(1.5f, 1.5f)->setLocalTransform(colliderT);
+		// gameplay reacts to contacts in one pass over the frame's events, here by counting what bumps into the cat
+		physics.getContactEvents().addListener([this](std::span<const ContactEvent> events)
+		{
+			int numBegun = 0;
+			for (auto& event : events)
+			{
+				if (event.type == ContactEvent::Type::Begin && (event.physics1->getActor() == catActor || event.physics2->getActor() == catActor))
+					++numBegun;
+			}
+			if (numBegun > 0)
+				gStatCatContacts.set(gStatCatContacts.get() + numBegun);
+		});
 		
 		std::default_random_engine random_engine(1);
 		
@@ -104,6 +138,7 @@ public:
 		const int numBalls = 12;
 		Mesh ballMesh;
 		ballMesh.generateSphere(0.5f);
+		Mesh::generateLods({ &ballMesh, 1u }, {}, loadWorkers);
 		Model ballModel;
 		ballModel.setMesh(&renderer, &ballMesh);
 		Material ballMaterial;
@@ -117,6 +152,19 @@ public:
 			std::uniform_real_distribution d(-10.0f, 10.0f);
 			ballActor->getTransformComponent().setTransform(Mtx::translate({d(random_engine), d(random_engine), 4.0f}));
 		}
+
+		// a crowd of cats in the back, walking off a baked clip so the animation system doesn't pose them at all
+		const int numCrowdCats = 24;
+		BakedAnimation catWalkBaked;
+		catWalkBaked.bake(meshes[0], animations.animations[0], skeleton, animations.initialFrame, 30.0f, loadWorkers);
+		catModel.setBakedAnimation(&catWalkBaked);
+		std::uniform_real_distribution crowdStartTime(0.0f, catWalkBaked.getDuration());
+		for (int i = 0; i < numCrowdCats; i++)
+		{
+			auto crowdActor = scene.addActor();
+			crowdActor->addComponent<VisualComponent>()->setModel(&catModel)->setMaterial(&catMaterial)->playBakedAnimation(crowdStartTime(random_engine));
+			crowdActor->getTransformComponent().setTransform(Mtx::scale(V4{0.25f, 0.25f, 0.25f}) * Mtx::translate({(i % 8 - 3.5f) * 3.0f, 10.0f + i / 8 * 2.0f, 0.0f}));
+		}
 		
 		mainLoop();
 
@@ -227,7 +275,12 @@ private:
 					catTransform = catTransform * Mtx::translate(catTransform.getForward() * frameTime * catSpeed);
 					catActor->getTransformComponent().setTransform(catTransform);
 				}
-				catActor->getComponent<VisualComponent>()->setAnimationSpeed(inputMotion.length());
+				// eases into and out of the walk instead of popping between standing and walking
+				const float catSpeedBlendTime = 250.0f;
+				auto catVisual = catActor->getComponent<VisualComponent>();
+				float animationSpeed = catVisual->getBlendParameter(catSpeedParameter);
+				animationSpeed += std::clamp(inputMotion.length() - animationSpeed, -frameTime / catSpeedBlendTime, frameTime / catSpeedBlendTime);
+				catVisual->setBlendParameter(catSpeedParameter, animationSpeed);
 				
 				cameraAngles += V2{-playerInputMouseDelta.x, playerInputMouseDelta.y} * 0.001f;
 				cameraAngles.y = std::clamp(cameraAngles.y, 0.0f, 0.9f*PI/2);
@@ -239,8 +292,15 @@ private:
 				renderer.cameraPos = glm::vec3(cameraPosition.x, cameraPosition.y, cameraPosition.z);
 			}
 			
+			if (catActor)
+				physics.setLodCenter(catActor->getTransformComponent().getTransform().getPosition());
 			physics.update(scene, frameTime);
+			physics.dispatchContactEvents();
 			scene.tick(frameTime);
+			V4 viewPosition{ renderer.cameraPos.x, renderer.cameraPos.y, renderer.cameraPos.z };
+			V4 viewTarget{ renderer.cameraLookAt.x, renderer.cameraLookAt.y, renderer.cameraLookAt.z };
+			animationSystem.setLodView(AnimationSystem::LodView{ viewPosition, viewTarget - viewPosition, PI / 4.0f, (float)WIDTH / HEIGHT });
+			animationSystem.update(scene);
 			renderer.drawFrame(scene, framebufferResized, true);
 			playerInputMouseDelta = V2{0.0f, 0.0f};
 		}
@@ -251,6 +311,7 @@ private:
 	GLFWwindow* window = nullptr;
 	Renderer renderer;
 	PhysicsSystem physics;
+	AnimationSystem animationSystem;
 	Console console;
 
 	Scene scene;
@@ -262,6 +323,7 @@ private:
 	V2 playerInputMouseDelta = V2{0.0f, 0.0f};
 	
 	Actor* catActor = nullptr;
+	uint catSpeedParameter = 0u;
 	V2 cameraAngles = V2{0.0f, 0.0f};
 	float cameraRadius = 5.0f;
  }; 
@@ -0,0 +1,226 @@
+#include "VertexFormat.h"
+#include "Animation/Mesh.h"
+#include "Engine/Log.h"
+#include <bit>
+
+constexpr float normalTangentSteps = 1023.0f;
+constexpr float twoPi = 6.28318530718f;
+
+namespace
+{
+	// An orthonormal basis around a unit normal (Duff et al. 2017), the tangent's angle is measured from b1 to b2.
+	// The shaders build the same one.
+	void getBasis(const V3& normal, V3& b1, V3& b2)
+	{
+		float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (sign + normal.z);
+		float b = normal.x * normal.y * a;
+		b1 = { 1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x };
+		b2 = { b, sign + normal.y * normal.y * a, -normal.y };
+	}
+
+	float getAngle(const V3& a, const V3& b)
+	{
+		return acosf(std::clamp(a.dot(b), -1.0f, 1.0f));
+	}
+}
+
+void VertexFormat::compile(const Mesh& mesh)
+{
+	const std::vector<Mesh::Vertex>& vertices = mesh.getVertices();
+	numVertices = (uint)vertices.size();
+	streams = positionBit | surfaceBit;
+	if (std::any_of(vertices.begin(), vertices.end(), [](const Mesh::Vertex& vertex) { return vertex.weights.x > 0.0f; }))
+		streams |= skinBit;
+
+	VkDeviceSize size = 0u;
+	stats = {};
+	for (uint stream = 0; stream < NumStreams; ++stream)
+	{
+		streamOffsets[stream] = size;
+		if (hasStream((Stream)stream))
+		{
+			size += (VkDeviceSize)getStride((Stream)stream) * numVertices;
+			stats.bytesPerVertex += getStride((Stream)stream);
+		}
+	}
+	data.assign(size, 0u);
+
+	auto* positions = reinterpret_cast<V3*>(data.data() + streamOffsets[Position]);
+	auto* surfaces = reinterpret_cast<SurfaceVertex*>(data.data() + streamOffsets[Surface]);
+	auto* skins = hasStream(Skin) ? reinterpret_cast<SkinVertex*>(data.data() + streamOffsets[Skin]) : nullptr;
+	for (uint i = 0; i < numVertices; ++i)
+	{
+		const Mesh::Vertex& vertex = vertices[i];
+		positions[i] = vertex.pos;
+
+		SurfaceVertex& surface = surfaces[i];
+		V3 normal = V3(vertex.normal).normalize();
+		V3 tangent = V3(vertex.tangent - normal * normal.dot(vertex.tangent)).normalize();
+		surface.normalTangent = encodeNormalTangent(normal, tangent);
+		V3 decodedNormal, decodedTangent;
+		decodeNormalTangent(surface.normalTangent, decodedNormal, decodedTangent);
+		if (normal.length2() > 0.0f)
+			stats.maxNormalError = std::max(stats.maxNormalError, getAngle(normal, decodedNormal));
+		if (tangent.length2() > 0.0f)
+			stats.maxTangentError = std::max(stats.maxTangentError, getAngle(tangent, decodedTangent));
+		for (uint axis = 0; axis < 2u; ++axis)
+		{
+			surface.texCoord[axis] = encodeHalf(vertex.tex[axis]);
+			stats.maxTexCoordError = std::max(stats.maxTexCoordError, fabsf(decodeHalf(surface.texCoord[axis]) - vertex.tex[axis]));
+		}
+
+		if (!skins)
+			continue;
+		// rounded, then whatever that lost or gained goes to the largest weight so they still sum up the same
+		SkinVertex& skin = skins[i];
+		int weightSum = 0;
+		uint largest = 0u;
+		for (uint j = 0; j < 4u; ++j)
+		{
+			float weight = std::clamp((&vertex.weights.x)[j], 0.0f, 1.0f);
+			assert(weight == 0.0f || vertex.boneIndices[j] <= 0xffu);
+			skin.boneIndices[j] = weight > 0.0f ? (uchar)vertex.boneIndices[j] : 0u;
+			skin.weights[j] = (uchar)lroundf(weight * 255.0f);
+			weightSum += skin.weights[j];
+			if (skin.weights[j] > skin.weights[largest])
+				largest = j;
+		}
+		float sum = vertex.weights.x + vertex.weights.y + vertex.weights.z + vertex.weights.w;
+		skin.weights[largest] = (uchar)std::clamp(skin.weights[largest] + (int)lroundf(std::min(sum, 1.0f) * 255.0f) - weightSum, 0, 255);
+		for (uint j = 0; j < 4u; ++j)
+			stats.maxWeightError = std::max(stats.maxWeightError, fabsf(skin.weights[j] / 255.0f - (&vertex.weights.x)[j]));
+	}
+
+	logLine(x, Verbose, "Compiled {} vertices to {} bytes each from {}, max error normal {} tangent {} texture coordinates {} weights {}",
+		numVertices, stats.bytesPerVertex, sizeof(Mesh::Vertex), stats.maxNormalError, stats.maxTangentError, stats.maxTexCoordError, stats.maxWeightError);
+}
+
+uint VertexFormat::getStride(Stream stream)
+{
+	switch (stream)
+	{
+	case Position: return sizeof(V3);
+	case Surface: return sizeof(SurfaceVertex);
+	case Skin: return sizeof(SkinVertex);
+	default: return 0u;
+	}
+}
+
+std::vector<VkVertexInputBindingDescription> VertexFormat::getBindingDescriptions(uint streams)
+{
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+	for (uint stream = 0; stream < NumStreams; ++stream)
+	{
+		if ((streams & 1u << stream) == 0u)
+			continue;
+		auto& descr = bindingDescriptions.emplace_back();
+		descr.binding = stream;
+		descr.stride = getStride((Stream)stream);
+		descr.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	}
+	return bindingDescriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription> VertexFormat::getAttributeDescriptions(uint streams)
+{
+	struct Attribute
+	{
+		Stream stream;
+		uint32_t location;
+		VkFormat format;
+		uint32_t offset;
+	};
+	const Attribute attributes[] =
+	{
+		{ Position, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+		{ Surface, 2, VK_FORMAT_R16G16_SFLOAT, offsetof(SurfaceVertex, texCoord) },
+		{ Surface, 3, VK_FORMAT_A2B10G10R10_UNORM_PACK32, offsetof(SurfaceVertex, normalTangent) },
+		{ Skin, 5, VK_FORMAT_R8G8B8A8_UINT, offsetof(SkinVertex, boneIndices) },
+		{ Skin, 6, VK_FORMAT_R8G8B8A8_UNORM, offsetof(SkinVertex, weights) },
+	};
+
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+	for (const Attribute& attribute : attributes)
+	{
+		if ((streams & 1u << attribute.stream) == 0u)
+			continue;
+		auto& descr = attributeDescriptions.emplace_back();
+		descr.binding = attribute.stream;
+		descr.location = attribute.location;
+		descr.format = attribute.format;
+		descr.offset = attribute.offset;
+	}
+	return attributeDescriptions;
+}
+
+uint32_t VertexFormat::encodeNormalTangent(const V3& normal, const V3& tangent)
+{
+	// onto the octahedron, the lower half folded over the upper one's diagonals
+	float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	float u = sum > 0.0f ? normal.x / sum : 0.0f;
+	float v = sum > 0.0f ? normal.y / sum : 0.0f;
+	if (normal.z < 0.0f)
+	{
+		float foldedU = (1.0f - fabsf(v)) * copysignf(1.0f, u);
+		v = (1.0f - fabsf(u)) * copysignf(1.0f, v);
+		u = foldedU;
+	}
+	uint32_t encoded = (uint32_t)lroundf((u * 0.5f + 0.5f) * normalTangentSteps) | (uint32_t)lroundf((v * 0.5f + 0.5f) * normalTangentSteps) << 10;
+
+	// the angle around the normal the shaders will decode, not the exact one
+	V3 decodedNormal, unusedTangent;
+	decodeNormalTangent(encoded, decodedNormal, unusedTangent);
+	V3 b1, b2;
+	getBasis(decodedNormal, b1, b2);
+	float angle = atan2f(tangent.dot(b2), tangent.dot(b1));
+	if (angle < 0.0f)
+		angle += twoPi;
+	return encoded | std::min((uint32_t)lroundf(angle / twoPi * normalTangentSteps), 1023u) << 20;
+}
+
+void VertexFormat::decodeNormalTangent(uint32_t encoded, V3& normal, V3& tangent)
+{
+	float u = (encoded & 0x3ffu) / normalTangentSteps * 2.0f - 1.0f;
+	float v = (encoded >> 10 & 0x3ffu) / normalTangentSteps * 2.0f - 1.0f;
+	normal = { u, v, 1.0f - fabsf(u) - fabsf(v) };
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x -= copysignf(fold, normal.x);
+	normal.y -= copysignf(fold, normal.y);
+	normal = normal.normalize();
+
+	V3 b1, b2;
+	getBasis(normal, b1, b2);
+	float angle = (encoded >> 20 & 0x3ffu) / normalTangentSteps * twoPi;
+	tangent = b1 * cosf(angle) + b2 * sinf(angle);
+}
+
+uint16_t VertexFormat::encodeHalf(float value)
+{
+	uint32_t bits = std::bit_cast<uint32_t>(value);
+	uint32_t sign = bits >> 16 & 0x8000u;
+	uint32_t magnitude = bits & 0x7fffffffu;
+	// too large for a half, infinite or NaN
+	if (magnitude >= 0x47800000u)
+		return (uint16_t)(sign | (magnitude > 0x7f800000u ? 0x7e00u : 0x7c00u));
+	// below the smallest normal half, in steps of 2^-24
+	if (magnitude < 0x38800000u)
+		return (uint16_t)(sign | (uint32_t)lrintf(std::bit_cast<float>(magnitude) * 16777216.0f));
+	// exponent rebiased from 127 to 15, the mantissa rounded from 23 to 10 bits to the nearest even
+	uint32_t rebiased = magnitude - 0x38000000u;
+	return (uint16_t)(sign | (rebiased + 0xfffu + (rebiased >> 13 & 1u)) >> 13);
+}
+
+float VertexFormat::decodeHalf(uint16_t half)
+{
+	uint32_t exponent = half >> 10 & 0x1fu;
+	uint32_t mantissa = half & 0x3ffu;
+	float magnitude;
+	if (exponent == 0u)
+		magnitude = mantissa / 16777216.0f;
+	else if (exponent == 0x1fu)
+		magnitude = mantissa != 0u ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+	else
+		magnitude = ldexpf((float)(mantissa | 0x400u), (int)exponent - 25);
+	return (half & 0x8000u) != 0u ? -magnitude : magnitude;
+}
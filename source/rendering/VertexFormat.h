@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Common.h"
+#include "Engine/Math/Math.h"
+
+#include <vulkan/vulkan.h>
+
+class Mesh;
+
+// Compiles a mesh's vertices into the packed streams the vertex shaders read, 20 bytes per vertex or 28 skinned
+// instead of the 88 of a Mesh::Vertex. A pipeline only binds the streams it reads, the shadow pass of a static mesh
+// just the positions. The vertex color isn't uploaded, the shaders take the material's.
+// Every stream is bound at the binding of its number, the shader locations stay the ones Mesh::Vertex had:
+// 0 position, 2 texture coordinates, 3 normal and tangent, 5 bone indices, 6 bone weights.
+class VertexFormat
+{
+public:
+
+	enum Stream : uint
+	{
+		Position, // three floats
+		Surface, // SurfaceVertex
+		Skin, // SkinVertex, only if a vertex has a weight
+		NumStreams
+	};
+
+	static constexpr uint positionBit = 1u << Position;
+	static constexpr uint surfaceBit = 1u << Surface;
+	static constexpr uint skinBit = 1u << Skin;
+
+	struct SurfaceVertex
+	{
+		// 10 bits each: the normal octahedral in x and y and the tangent's angle around it in z, A2B10G10R10
+		uint32_t normalTangent = 0u;
+		uint16_t texCoord[2] = {}; // half floats
+	};
+
+	struct SkinVertex
+	{
+		uchar boneIndices[4] = {};
+		uchar weights[4] = {}; // 255 is a weight of one
+	};
+
+	struct Stats
+	{
+		uint bytesPerVertex = 0u;
+		float maxNormalError = 0.0f; // radians
+		float maxTangentError = 0.0f; // radians
+		float maxTexCoordError = 0.0f;
+		float maxWeightError = 0.0f;
+	};
+
+	void compile(const Mesh& mesh);
+
+	uint getNumVertices() const { return numVertices; }
+	bool hasStream(Stream stream) const { return (streams & 1u << stream) != 0u; }
+	// All streams one after the other, getStreamOffset says where each one starts
+	const std::vector<uchar>& getData() const { return data; }
+	VkDeviceSize getStreamOffset(Stream stream) const { return streamOffsets[stream]; }
+	const Stats& getStats() const { return stats; }
+
+	static uint getStride(Stream stream);
+	// What a pipeline that reads the streams in the mask of stream bits declares
+	static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(uint streams);
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(uint streams);
+
+	// Decoded like the shaders do
+	static uint32_t encodeNormalTangent(const V3& normal, const V3& tangent);
+	static void decodeNormalTangent(uint32_t encoded, V3& normal, V3& tangent);
+	static uint16_t encodeHalf(float value);
+	static float decodeHalf(uint16_t half);
+
+private:
+
+	std::vector<uchar> data;
+	uint numVertices = 0u;
+	uint streams = 0u;
+	VkDeviceSize streamOffsets[NumStreams] = {};
+	Stats stats;
+};
@@ -17,6 +17,13 @@ void Model::unload()
 	vkDestroyBuffer(getDevice(), vertexBuffer, nullptr);
 	vkFreeMemory(getDevice(), vertexBufferMemory, nullptr);
 
+	if (bakedAnimation)
+	{
+		vkDestroyBuffer(getDevice(), bakedAnimationBuffer, nullptr);
+		vkFreeMemory(getDevice(), bakedAnimationBufferMemory, nullptr);
+		bakedAnimation = nullptr;
+	}
+
 	isInitialized = false;
 }
 
@@ -30,15 +37,46 @@ void Model::setMesh(Renderer* renderer_, Mesh* mesh_)
 	renderer = renderer_;
 	mesh = mesh_;
 
+	vertexFormat.compile(*mesh);
+	// skinned vertices leave the bounds and normal cones of their meshlets, those aren't culled by meshlet
+	if (vertexFormat.hasStream(VertexFormat::Skin))
+		meshlets.clear();
+	else
+		meshlets.build(*mesh);
+
 	createVertexBuffer();
 	createIndexBuffer();
 
 	isInitialized = true;
 }
 
+void Model::setBakedAnimation(const BakedAnimation* bakedAnimation_)
+{
+	assert(isInitialized && !bakedAnimation && bakedAnimation_->getNumVertices() == mesh->vertices.size());
+	bakedAnimation = bakedAnimation_;
+
+	VkDeviceSize bufferSize = bakedAnimation->getSize();
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	renderer->getImpl().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, bakedAnimation->getData().data(), (size_t)bufferSize);
+	vkUnmapMemory(getDevice(), stagingBufferMemory);
+
+	renderer->getImpl().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bakedAnimationBuffer, bakedAnimationBufferMemory);
+
+	renderer->getImpl().copyBuffer(stagingBuffer, bakedAnimationBuffer, bufferSize);
+
+	vkDestroyBuffer(getDevice(), stagingBuffer, nullptr);
+	vkFreeMemory(getDevice(), stagingBufferMemory, nullptr);
+}
+
 void Model::createVertexBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(mesh->vertices[0]) * mesh->vertices.size();
+	VkDeviceSize bufferSize = vertexFormat.getData().size();
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
@@ -46,7 +84,7 @@ void Model::createVertexBuffer()
 
 	void* data;
 	vkMapMemory(getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, mesh->vertices.data(), (size_t)bufferSize);
+	memcpy(data, vertexFormat.getData().data(), (size_t)bufferSize);
 	vkUnmapMemory(getDevice(), stagingBufferMemory);
 
 	renderer->getImpl().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
@@ -57,9 +95,31 @@ void Model::createVertexBuffer()
 	vkFreeMemory(getDevice(), stagingBufferMemory, nullptr);
 
 }
+void Model::bindVertexBuffers(VkCommandBuffer commandBuffer) const
+{
+	VkBuffer vertexBuffers[VertexFormat::NumStreams];
+	VkDeviceSize offsets[VertexFormat::NumStreams];
+	uint32_t numStreams = 0u;
+	for (uint stream = 0; stream < VertexFormat::NumStreams && vertexFormat.hasStream((VertexFormat::Stream)stream); ++stream)
+	{
+		vertexBuffers[stream] = vertexBuffer;
+		offsets[stream] = vertexFormat.getStreamOffset((VertexFormat::Stream)stream);
+		++numStreams;
+	}
+	vkCmdBindVertexBuffers(commandBuffer, 0, numStreams, vertexBuffers, offsets);
+}
+
 void Model::createIndexBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(mesh->indices[0]) * mesh->indices.size();
+	// every level of detail after the mesh's own triangles, all in one buffer
+	lodRanges.clear();
+	lodRanges.push_back({ 0u, (uint32_t)mesh->indices.size(), 0.0f });
+	for (const Mesh::Lod& lod : mesh->getLods())
+		lodRanges.push_back({ lodRanges.back().firstIndex + lodRanges.back().numIndices, (uint32_t)lod.indices.size(), lod.error });
+	meshletFirstIndex = lodRanges.back().firstIndex + lodRanges.back().numIndices;
+	size_t numIndices = meshletFirstIndex + meshlets.getNumIndices();
+
+	VkDeviceSize bufferSize = sizeof(mesh->indices[0]) * numIndices;
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
@@ -67,7 +127,10 @@ void Model::createIndexBuffer()
 
 	void* data;
 	vkMapMemory(getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, mesh->indices.data(), (size_t)bufferSize);
+	memcpy(data, mesh->indices.data(), mesh->indices.size() * sizeof(mesh->indices[0]));
+	for (uint lod = 1; lod < lodRanges.size(); ++lod)
+		memcpy((uint32_t*)data + lodRanges[lod].firstIndex, mesh->getLods()[lod - 1u].indices.data(), lodRanges[lod].numIndices * sizeof(uint32_t));
+	meshlets.writeIndices((uint32_t*)data + meshletFirstIndex);
 	vkUnmapMemory(getDevice(), stagingBufferMemory);
 
 	renderer->getImpl().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
@@ -2,77 +2,26 @@
 
 #include "common.h"
 #include "Animation/Mesh.h"
+#include "Animation/BakedAnimation.h"
+#include "Animation/Meshlets.h"
 
-#include <vulkan/vulkan.h>
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#include <glm/glm.hpp>
+#include "VertexFormat.h"
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
+#include <vulkan/vulkan.h>
 
 class Renderer;
 
-struct Vertex
+class Model
 {
-	glm::vec3 pos;
-	glm::vec3 color;
-	glm::vec2 texCoord;
-	glm::vec3 normal;	
-	glm::vec3 tangent = glm::vec3(0.0f);
-	
-	glm::uvec4 weightIndices = glm::uvec4(0u);
-	glm::vec4 weights = glm::vec4(0.0f);
-
-	static VkVertexInputBindingDescription getBindingDescription()
-	{
-		VkVertexInputBindingDescription bindingDescription{};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		return bindingDescription;
-	}
-
-	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(int numAttributes)
-	{
-		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
-
-		VkFormat formats[] = { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT,  VK_FORMAT_R32G32B32_SFLOAT,  VK_FORMAT_R32G32B32A32_UINT, VK_FORMAT_R32G32B32A32_SFLOAT };
-		uint32_t offsets[] = { offsetof(Vertex, pos), offsetof(Vertex, color), offsetof(Vertex, texCoord), offsetof(Vertex, normal), offsetof(Vertex, tangent),offsetof(Vertex, weightIndices), offsetof(Vertex, weights)};
-
-		for (int i = 0; i < numAttributes; ++i)
-		{
-			auto& descr = attributeDescriptions.emplace_back();
-			memset(&descr, 0, sizeof(VkVertexInputAttributeDescription));
-			descr.binding = 0;
-			descr.location = i;
-			descr.format = formats[i];
-			descr.offset = offsets[i];
-		}
-
-		return attributeDescriptions;
-	}
-
-	bool operator==(const Vertex& other) const
-	{
-		return pos == other.pos && color == other.color && texCoord == other.texCoord && normal == other.normal && tangent == other.tangent && weightIndices == other.weightIndices && weights == other.weights;
-	}
-};
+public:
 
-namespace std
-{
-	template<> struct hash<Vertex>
+	// Where a level of detail's triangles are in the index buffer, level 0 is the mesh itself
+	struct LodRange
 	{
-		size_t operator()(Vertex const& vertex) const
-		{
-			return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ ((hash<glm::vec2>()(vertex.texCoord) << 1) ^ (hash<glm::vec2>()(vertex.normal) >> 1));
-		}
+		uint32_t firstIndex = 0u;
+		uint32_t numIndices = 0u;
+		float error = 0.0f; // in model units, see Mesh::Lod
 	};
-}
-
-class Model
-{
-public:
 
 	Model() = default;
 	~Model();
@@ -80,9 +29,16 @@ public:
 	void unload();
 	
 	void setMesh(Renderer* renderer_, Mesh* mesh);
+	// Uploads a clip baked on this model's mesh, for visuals that play it with VisualComponent::playBakedAnimation
+	void setBakedAnimation(const BakedAnimation* bakedAnimation);
 
 	VkBuffer getVertexBuffer() const { return vertexBuffer; }
+	const VertexFormat& getVertexFormat() const { return vertexFormat; }
+	// Binds every stream of the vertex format at the binding of its number
+	void bindVertexBuffers(VkCommandBuffer commandBuffer) const;
 	VkBuffer getIndexBuffer() const { return indexBuffer; }
+	const BakedAnimation* getBakedAnimation() const { return bakedAnimation; }
+	VkBuffer getBakedAnimationBuffer() const { return bakedAnimationBuffer; }
 	uint32_t getNumIndices() const 
 	{
 		if (mesh)
@@ -91,6 +47,12 @@ public:
 		}
 		return 0; 
 	}
+	uint getNumLods() const { return (uint)lodRanges.size(); }
+	const LodRange& getLod(uint lod) const { return lodRanges[lod]; }
+	// Empty for skinned meshes, else level 0 is in the index buffer a second time in meshlet order, after the levels
+	// of detail. Level 0 itself keeps the mesh's vertex cache and overdraw order for draws that aren't culled.
+	const Meshlets& getMeshlets() const { return meshlets; }
+	uint32_t getMeshletFirstIndex() const { return meshletFirstIndex; }
 
 
 protected:
@@ -104,9 +66,17 @@ protected:
 
 	VkBuffer vertexBuffer;
 	VkDeviceMemory vertexBufferMemory;
+	VertexFormat vertexFormat;
 
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
+	std::vector<LodRange> lodRanges;
+	Meshlets meshlets;
+	uint32_t meshletFirstIndex = 0u;
+
+	const BakedAnimation* bakedAnimation = nullptr;
+	VkBuffer bakedAnimationBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory bakedAnimationBufferMemory = VK_NULL_HANDLE;
 
 	bool isInitialized = false;
 	Mesh* mesh = nullptr;
@@ -3,6 +3,11 @@
 #include "VisualComponent.h"
 #include "Animation/SkelAnimation.h"
 #include "Engine/Log.h"
+#include "Console/GlobalVar.h"
+
+GlobalVar<float> gMeshLodPixelError("meshLodPixelError", 1.0f);
+GlobalVar<int> gMeshletCulling("meshletCulling", 1);
+GlobalVar<int> gStatMeshletCulledTriangles("statMeshletCulledTriangles", 0);
 
 const std::string TEXTURE_PATH = "textures/deafult_texture.jpg";
 const std::string NORMAL_MAP_PATH = "textures/deafult_normal.png";
@@ -33,29 +38,31 @@ struct UBO
 	float padding2;
 };
 
-constexpr uint NUM_BONES = 64u;
-struct AnimUBO : UBO
+// Where a baked animation is for this visual: the two frames around its time, see BakedAnimation
+struct BakedFrames
 {
-	glm::vec4 initialPoseBonePositions[NUM_BONES];
-	glm::vec4 initialPoseBoneRotations[NUM_BONES];
-	glm::vec4 initialPoseBoneScales[NUM_BONES];
-	
-	glm::vec4 poseBonePositions[NUM_BONES];
-	glm::vec4 poseBoneRotations[NUM_BONES];
-	glm::vec4 poseBoneScales[NUM_BONES];
+	glm::vec4 boundsMin;
+	glm::vec4 boundsScale;
+	glm::uvec2 frameOffsets; // first vertex of each frame
+	float frameAlpha;
+	float padding;
 };
 
-struct AnimOffscreenUBO : OffscreenUBO
+struct BakedUBO : UBO
 {
-	glm::vec4 initialPoseBonePositions[NUM_BONES];
-	glm::vec4 initialPoseBoneRotations[NUM_BONES];
-	glm::vec4 initialPoseBoneScales[NUM_BONES];
+	BakedFrames baked;
+};
 
-	glm::vec4 poseBonePositions[NUM_BONES];
-	glm::vec4 poseBoneRotations[NUM_BONES];
-	glm::vec4 poseBoneScales[NUM_BONES];
+struct BakedOffscreenUBO : OffscreenUBO
+{
+	BakedFrames baked;
 };
 
+// The skinning palette of a visual, NUM_BONES 3x4 matrices. It's a dynamic uniform buffer of its own, written
+// once per frame and read by both the shadow and the main pass.
+constexpr uint NUM_BONES = 64u;
+constexpr size_t SKINNING_PALETTE_SIZE = NUM_BONES * Pose::paletteFloatsPerBone * sizeof(float);
+
 struct SceneDataForUniforms
 {
 	glm::mat4 model;
@@ -64,9 +71,7 @@ struct SceneDataForUniforms
 	glm::mat4 offscreenMVP;
 	glm::vec3 light;
 	const Material* material = nullptr;
-	
-	const SkelAnimation::Frame* frame = nullptr;
-	const SkelAnimation::Frame* initialFrame = nullptr;
+	BakedFrames baked{};
 };
 
 template<typename UBO_Type>
@@ -78,7 +83,8 @@ struct Pipeline : public Renderer::PipelineBase
 	}
 };
 
-template<typename UBO_Type = UBO>
+// Skinned pipelines read a skinning palette, baked ones a baked animation's vertices, both at binding 4
+template<typename UBO_Type = UBO, bool Skinned = false, bool Baked = false>
 struct MainPipeline : public Pipeline<UBO_Type>
 {
 	virtual void fillUBO(const void* sceneDataRaw, void* uboRaw)
@@ -104,6 +110,9 @@ struct MainPipeline : public Pipeline<UBO_Type>
 			ubo.modelLightReflection = 0;
 			ubo.textured = 1;
 		}
+
+		if constexpr (Baked)
+			ubo.baked = sceneData.baked;
 	}
 	
 	virtual void createDescriptorSetLayout() override
@@ -126,7 +135,19 @@ struct MainPipeline : public Pipeline<UBO_Type>
 		samplers[1].binding = 2;
 		samplers[2].binding = 3;
 
-		std::array<VkDescriptorSetLayoutBinding, 4> bindings = { uboLayoutBinding, samplers[0], samplers[1], samplers[2] };
+		VkDescriptorSetLayoutBinding paletteLayoutBinding = uboLayoutBinding;
+		paletteLayoutBinding.binding = 4;
+		paletteLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		paletteLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		VkDescriptorSetLayoutBinding bakedLayoutBinding = paletteLayoutBinding;
+		bakedLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding, samplers[0], samplers[1], samplers[2] };
+		if constexpr (Skinned)
+			bindings.push_back(paletteLayoutBinding);
+		if constexpr (Baked)
+			bindings.push_back(bakedLayoutBinding);
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -141,7 +162,7 @@ struct MainPipeline : public Pipeline<UBO_Type>
 
 	virtual void createDescriptorPool(int maxNumVisuals) override
 	{
-		std::array<VkDescriptorPoolSize, 4> poolSizes{};
+		std::array<VkDescriptorPoolSize, 5> poolSizes{};
 		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		poolSizes[0].descriptorCount = maxNumVisuals * Renderer::PipelineBase::getNumFramesInFlight();
 
@@ -154,9 +175,12 @@ struct MainPipeline : public Pipeline<UBO_Type>
 		poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		poolSizes[3].descriptorCount = maxNumVisuals * Renderer::PipelineBase::getNumFramesInFlight();
 
+		poolSizes[4].type = Baked ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[4].descriptorCount = maxNumVisuals * Renderer::PipelineBase::getNumFramesInFlight();
+
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = poolSizes.size();
+		poolInfo.poolSizeCount = Skinned || Baked ? 5 : 4;
 		poolInfo.pPoolSizes = poolSizes.data();
 		poolInfo.maxSets = maxNumVisuals * Renderer::PipelineBase::getNumFramesInFlight();
 
@@ -235,7 +259,12 @@ struct MainPipeline : public Pipeline<UBO_Type>
 			depthMapInfo.imageView = Renderer::PipelineBase::getImpl().shadowmapDepthImageView;
 			depthMapInfo.sampler = Renderer::PipelineBase::renderer->textureSampler;
 
-			std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+			VkDescriptorBufferInfo paletteInfo = Renderer::PipelineBase::getSkinningPaletteInfo(currentImage);
+			// only visuals playing a baked animation bind the baked sets, the others' binding stays empty
+			VkDescriptorBufferInfo bakedInfo = Renderer::PipelineBase::getBakedAnimationInfo(visualComponents[i]);
+			bool writesBakedAnimation = Baked && bakedInfo.buffer != VK_NULL_HANDLE;
+
+			std::vector<VkWriteDescriptorSet> descriptorWrites(Skinned || writesBakedAnimation ? 5 : 4);
 
 			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			descriptorWrites[0].dstSet = set[i];
@@ -269,166 +298,58 @@ struct MainPipeline : public Pipeline<UBO_Type>
 			descriptorWrites[3].descriptorCount = 1;
 			descriptorWrites[3].pImageInfo = &depthMapInfo;
 
+			if constexpr (Skinned)
+			{
+				descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[4].dstSet = set[i];
+				descriptorWrites[4].dstBinding = 4;
+				descriptorWrites[4].dstArrayElement = 0;
+				descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+				descriptorWrites[4].descriptorCount = 1;
+				descriptorWrites[4].pBufferInfo = &paletteInfo;
+			}
+			if (writesBakedAnimation)
+			{
+				descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[4].dstSet = set[i];
+				descriptorWrites[4].dstBinding = 4;
+				descriptorWrites[4].dstArrayElement = 0;
+				descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptorWrites[4].descriptorCount = 1;
+				descriptorWrites[4].pBufferInfo = &bakedInfo;
+			}
+
 			vkUpdateDescriptorSets(Renderer::PipelineBase::getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 		}
 	}
 };
 
-struct AnimPipeline : public MainPipeline<AnimUBO>
-{
-	virtual void fillUBO(const void* sceneDataRaw, void* uboRaw)
-	{
-		const SceneDataForUniforms& sceneData = *reinterpret_cast<const SceneDataForUniforms*>(sceneDataRaw);
-		AnimUBO& ubo = *reinterpret_cast<AnimUBO*>(uboRaw);
-		MainPipeline<AnimUBO>::fillUBO(&sceneData, &ubo);
-		FillPosePSR(ubo.initialPoseBonePositions, ubo.initialPoseBoneRotations, ubo.initialPoseBoneScales, sceneData.initialFrame);
-		FillPosePSR(ubo.poseBonePositions, ubo.poseBoneRotations, ubo.poseBoneScales, sceneData.frame);
-	}
-	
-	void FillPosePSR(glm::vec4* positions, glm::vec4* rotations, glm::vec4* scales, const SkelAnimation::Frame* frame)
-	{
-		if (!frame)
-			return;
-		
-		for (int i = 0; i < NUM_BONES; ++i)
-			rotations[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-		
-		int i = 0;
-		for (auto& bone : frame->bones)
-		{
-			positions[i] = glm::vec4(bone.position.x, bone.position.y, bone.position.z, 0.0f);
-			rotations[i] = glm::vec4(bone.rotation.x, bone.rotation.y, bone.rotation.z, bone.rotation.w);
-			scales[i] = glm::vec4(bone.size.x, bone.size.y, bone.size.z, 0.0f);
-			++i;
-			assert(i < NUM_BONES);
-		}	
-	}
-};
+using AnimPipeline = MainPipeline<UBO, true>;
+using BakedPipeline = MainPipeline<BakedUBO, false, true>;
 
-struct OffscreenPipeline : public Pipeline<OffscreenUBO>
+// Skinned pipelines read a skinning palette, baked ones a baked animation's vertices, both at binding 1
+template<bool Skinned = false, bool Baked = false>
+struct OffscreenPipeline : public Pipeline<std::conditional_t<Baked, BakedOffscreenUBO, OffscreenUBO>>
 {
-	virtual void fillUBO(const void* sceneDataRaw, void* uboRaw) override
-	{
-		const SceneDataForUniforms& sceneData = *reinterpret_cast<const SceneDataForUniforms*>(sceneDataRaw);
-		OffscreenUBO& ubo = *reinterpret_cast<OffscreenUBO*>(uboRaw);
-		ubo.MVP = sceneData.offscreenMVP;
-	}
-
-	virtual void createDescriptorSetLayout() override
-	{
-		VkDescriptorSetLayoutBinding uboLayoutBinding{};
-		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorCount = 1;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		uboLayoutBinding.pImmutableSamplers = nullptr;
-		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-		VkDescriptorSetLayoutCreateInfo layoutInfo{};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = 1;
-		layoutInfo.pBindings = &uboLayoutBinding;
+	using UBO_Type = std::conditional_t<Baked, BakedOffscreenUBO, OffscreenUBO>;
+	using Renderer::PipelineBase::getDevice;
+	using Renderer::PipelineBase::getNumFramesInFlight;
+	using Renderer::PipelineBase::getUBOSize;
+	using Renderer::PipelineBase::getSkinningPaletteInfo;
+	using Renderer::PipelineBase::getBakedAnimationInfo;
+	using Renderer::PipelineBase::descriptorSetLayout;
+	using Renderer::PipelineBase::descriptorPool;
+	using Renderer::PipelineBase::descriptorSets;
+	using Renderer::PipelineBase::uniformBuffers;
+	using Renderer::PipelineBase::numVisuals_DescriptorSets;
 
-		if (vkCreateDescriptorSetLayout(getDevice(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create descriptor set layout!");
-		}
-	}
-
-	virtual void createDescriptorPool(int maxNumVisuals) override
-	{
-		VkDescriptorPoolSize poolSize{};
-		poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSize.descriptorCount = maxNumVisuals * getNumFramesInFlight();
-
-		VkDescriptorPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = 1;
-		poolInfo.pPoolSizes = &poolSize;
-		poolInfo.maxSets = maxNumVisuals * getNumFramesInFlight();
-
-		if (vkCreateDescriptorPool(getDevice(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create descriptor pool!");
-		}
-	}
-
-	virtual void createDescriptorSets(int numVisuals, int currentImage, const std::vector<VisualComponent*>& visualComponents) override
-	{
-		if (numVisuals_DescriptorSets[currentImage] == numVisuals)
-			return;
-
-		auto& set = descriptorSets[currentImage];
-		if (!set.empty())
-			vkFreeDescriptorSets(getDevice(), descriptorPool, set.size(), set.data());
-
-		numVisuals_DescriptorSets[currentImage] = numVisuals;
-
-		uint32_t numDescriptorSets = numVisuals;
-
-		std::vector<VkDescriptorSetLayout> layouts(numDescriptorSets, descriptorSetLayout);
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(numDescriptorSets);
-		allocInfo.pSetLayouts = layouts.data();
-
-		set.resize(numDescriptorSets);
-		if (vkAllocateDescriptorSets(getDevice(), &allocInfo, set.data()) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate descriptor sets!");
-		}
-
-		for (size_t i = 0; i < numDescriptorSets; i++)
-		{
-			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = uniformBuffers[currentImage][i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = getUBOSize();
-
-			std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
-
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = set[i];
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-			vkUpdateDescriptorSets(getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-		}
-	}
-};
-
-struct AnimOffscreenPipeline : public Pipeline<AnimOffscreenUBO>
-{
 	virtual void fillUBO(const void* sceneDataRaw, void* uboRaw) override
 	{
 		const SceneDataForUniforms& sceneData = *reinterpret_cast<const SceneDataForUniforms*>(sceneDataRaw);
-		AnimOffscreenUBO& ubo = *reinterpret_cast<AnimOffscreenUBO*>(uboRaw);
+		UBO_Type& ubo = *reinterpret_cast<UBO_Type*>(uboRaw);
 		ubo.MVP = sceneData.offscreenMVP;
-
-		FillPosePSR(ubo.initialPoseBonePositions, ubo.initialPoseBoneRotations, ubo.initialPoseBoneScales, sceneData.initialFrame);
-		FillPosePSR(ubo.poseBonePositions, ubo.poseBoneRotations, ubo.poseBoneScales, sceneData.frame);
-	}
-
-	void FillPosePSR(glm::vec4* positions, glm::vec4* rotations, glm::vec4* scales, const SkelAnimation::Frame* frame)
-	{
-		if (!frame)
-			return;
-
-		for (int i = 0; i < NUM_BONES; ++i)
-			rotations[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-
-		int i = 0;
-		for (auto& bone : frame->bones)
-		{
-			positions[i] = glm::vec4(bone.position.x, bone.position.y, bone.position.z, 0.0f);
-			rotations[i] = glm::vec4(bone.rotation.x, bone.rotation.y, bone.rotation.z, bone.rotation.w);
-			scales[i] = glm::vec4(bone.size.x, bone.size.y, bone.size.z, 0.0f);
-			++i;
-			assert(i < NUM_BONES);
-		}
+		if constexpr (Baked)
+			ubo.baked = sceneData.baked;
 	}
 
 	virtual void createDescriptorSetLayout() override
@@ -440,10 +361,15 @@ struct AnimOffscreenPipeline : public Pipeline<AnimOffscreenUBO>
 		uboLayoutBinding.pImmutableSamplers = nullptr;
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
+		VkDescriptorSetLayoutBinding paletteLayoutBinding = uboLayoutBinding;
+		paletteLayoutBinding.binding = 1;
+		paletteLayoutBinding.descriptorType = Baked ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, paletteLayoutBinding };
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = 1;
-		layoutInfo.pBindings = &uboLayoutBinding;
+		layoutInfo.bindingCount = Skinned || Baked ? 2 : 1;
+		layoutInfo.pBindings = bindings.data();
 
 		if (vkCreateDescriptorSetLayout(getDevice(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
 		{
@@ -453,14 +379,17 @@ struct AnimOffscreenPipeline : public Pipeline<AnimOffscreenUBO>
 
 	virtual void createDescriptorPool(int maxNumVisuals) override
 	{
-		VkDescriptorPoolSize poolSize{};
-		poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSize.descriptorCount = maxNumVisuals * getNumFramesInFlight();
+		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		poolSizes[0].descriptorCount = maxNumVisuals * getNumFramesInFlight();
+
+		poolSizes[1].type = Baked ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[1].descriptorCount = maxNumVisuals * getNumFramesInFlight();
 
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = 1;
-		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.poolSizeCount = Skinned || Baked ? 2 : 1;
+		poolInfo.pPoolSizes = poolSizes.data();
 		poolInfo.maxSets = maxNumVisuals * getNumFramesInFlight();
 
 		if (vkCreateDescriptorPool(getDevice(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
@@ -502,7 +431,9 @@ struct AnimOffscreenPipeline : public Pipeline<AnimOffscreenUBO>
 			bufferInfo.offset = 0;
 			bufferInfo.range = getUBOSize();
 
-			std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+			VkDescriptorBufferInfo paletteInfo = Baked ? getBakedAnimationInfo(visualComponents[i]) : getSkinningPaletteInfo(currentImage);
+
+			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
 
 			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			descriptorWrites[0].dstSet = set[i];
@@ -512,12 +443,21 @@ struct AnimOffscreenPipeline : public Pipeline<AnimOffscreenUBO>
 			descriptorWrites[0].descriptorCount = 1;
 			descriptorWrites[0].pBufferInfo = &bufferInfo;
 
-			vkUpdateDescriptorSets(getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+			descriptorWrites[1] = descriptorWrites[0];
+			descriptorWrites[1].dstBinding = 1;
+			descriptorWrites[1].descriptorType = Baked ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptorWrites[1].pBufferInfo = &paletteInfo;
+
+			// only visuals playing a baked animation bind the baked sets, the others' binding stays empty
+			bool writesSecondBinding = Skinned || (Baked && paletteInfo.buffer != VK_NULL_HANDLE);
+			vkUpdateDescriptorSets(getDevice(), writesSecondBinding ? 2 : 1, descriptorWrites.data(), 0, nullptr);
 		}
 	}
-
 };
 
+using AnimOffscreenPipeline = OffscreenPipeline<true>;
+using BakedOffscreenPipeline = OffscreenPipeline<false, true>;
+
 
 void Renderer::init(GLFWwindow* window)
 {
@@ -526,15 +466,20 @@ void Renderer::init(GLFWwindow* window)
 	createTextureSampler();
 	texture.load(this, TEXTURE_PATH.c_str());
 	normalMap.load(this, NORMAL_MAP_PATH.c_str(), VK_FORMAT_R8G8B8A8_UNORM);
+	createSkinningPaletteBuffers();
 
 	pipeline = std::make_unique<MainPipeline<>>();
-	pipeline->init(this, "nmap", impl.renderPass, impl.msaaSamples, 5);
+	pipeline->init(this, "nmap", impl.renderPass, impl.msaaSamples, VertexFormat::positionBit | VertexFormat::surfaceBit);
 	animPipeline = std::make_unique<AnimPipeline>();
-	animPipeline->init(this, "anim", "nmap", impl.renderPass, impl.msaaSamples, 7);
-	offscreenPipeline = std::make_unique<OffscreenPipeline>();
-	offscreenPipeline->init(this, "offscreen", impl.shadowmapRenderPass, VK_SAMPLE_COUNT_1_BIT, 1);
+	animPipeline->init(this, "anim", "nmap", impl.renderPass, impl.msaaSamples, VertexFormat::positionBit | VertexFormat::surfaceBit | VertexFormat::skinBit);
+	offscreenPipeline = std::make_unique<OffscreenPipeline<>>();
+	offscreenPipeline->init(this, "offscreen", impl.shadowmapRenderPass, VK_SAMPLE_COUNT_1_BIT, VertexFormat::positionBit);
 	animOffscreenPipeline = std::make_unique<AnimOffscreenPipeline>();
-	animOffscreenPipeline->init(this, "animOffscreen", "offscreen", impl.shadowmapRenderPass, VK_SAMPLE_COUNT_1_BIT, 7);
+	animOffscreenPipeline->init(this, "animOffscreen", "offscreen", impl.shadowmapRenderPass, VK_SAMPLE_COUNT_1_BIT, VertexFormat::positionBit | VertexFormat::skinBit);
+	bakedPipeline = std::make_unique<BakedPipeline>();
+	bakedPipeline->init(this, "baked", "nmap", impl.renderPass, impl.msaaSamples, VertexFormat::surfaceBit);
+	bakedOffscreenPipeline = std::make_unique<BakedOffscreenPipeline>();
+	bakedOffscreenPipeline->init(this, "bakedOffscreen", "offscreen", impl.shadowmapRenderPass, VK_SAMPLE_COUNT_1_BIT, 0u);
 }
 
 void Renderer::deinit()
@@ -545,6 +490,14 @@ void Renderer::deinit()
 	animPipeline->deinit();
 	offscreenPipeline->deinit();
 	animOffscreenPipeline->deinit();
+	bakedPipeline->deinit();
+	bakedOffscreenPipeline->deinit();
+
+	for (size_t i = 0; i < impl.getNumFramesInFlight(); i++)
+	{
+		vkDestroyBuffer(getDevice(), skinningPaletteBuffers[i], nullptr);
+		vkFreeMemory(getDevice(), skinningPaletteBuffersMemory[i], nullptr);
+	}
 
 	texture.unload();
 	normalMap.unload();
@@ -584,6 +537,109 @@ void Renderer::createTextureSampler()
 	}
 }
 
+void Renderer::createSkinningPaletteBuffers()
+{
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(impl.physicalDevice, &properties);
+	VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+	skinningPaletteStride = (SKINNING_PALETTE_SIZE + alignment - 1) / alignment * alignment;
+
+	VkDeviceSize bufferSize = skinningPaletteStride * maxNumVisuals;
+	for (size_t i = 0; i < impl.getNumFramesInFlight(); i++)
+	{
+		impl.createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, skinningPaletteBuffers[i], skinningPaletteBuffersMemory[i]);
+		vkMapMemory(getDevice(), skinningPaletteBuffersMemory[i], 0, bufferSize, 0, &skinningPaletteBuffersMapped[i]);
+	}
+}
+
+void Renderer::updateSkinningPalettes(uint32_t currentImage, const std::vector<VisualComponent*>& visualComponents)
+{
+	// visuals whose pose came from AnimationSystem's pose cache point at the same palette, it's uploaded once
+	// and they all bind that slot
+	char* mapped = reinterpret_cast<char*>(skinningPaletteBuffersMapped[currentImage]);
+	std::unordered_map<const float*, uint32_t> uploaded;
+	skinningPaletteOffsets.assign(visualComponents.size(), 0u);
+	for (size_t i = 0; i < visualComponents.size(); i++)
+	{
+		std::span<const float> palette = visualComponents[i]->getSkinningPalette();
+		if (palette.empty())
+			continue;
+
+		auto [it, inserted] = uploaded.try_emplace(palette.data(), (uint32_t)(skinningPaletteStride * uploaded.size()));
+		if (inserted)
+		{
+			assert(palette.size_bytes() <= SKINNING_PALETTE_SIZE);
+			memcpy(mapped + it->second, palette.data(), palette.size_bytes());
+		}
+		skinningPaletteOffsets[i] = it->second;
+	}
+}
+
+void Renderer::selectMeshLods(const std::vector<VisualComponent*>& visualComponents)
+{
+	// the coarsest level of detail whose error, projected at the visual's distance, stays under meshLodPixelError
+	// pixels. The shadow pass draws the same one, zero or less always draws the full mesh
+	float maxPixelError = gMeshLodPixelError.get();
+	float pixelsPerUnit = impl.swapChainExtent.height * 0.5f / tanf(glm::radians(45.0f) * 0.5f);
+	V4 viewPosition{ cameraPos.x, cameraPos.y, cameraPos.z };
+	meshLods.resize(visualComponents.size());
+	for (size_t i = 0; i < visualComponents.size(); i++)
+	{
+		const Model& model = *visualComponents[i]->getModel();
+		meshLods[i] = model.getLod(0u);
+		if (maxPixelError <= 0.0f)
+			continue;
+
+		Mtx transform = visualComponents[i]->getTransform();
+		V4 scale = transform.getScale();
+		float maxScale = std::max({ scale.x, scale.y, scale.z });
+		float distance = (transform.getPosition() - viewPosition).xyz().length();
+		for (uint lod = 1; lod < model.getNumLods(); ++lod)
+		{
+			if (model.getLod(lod).error * maxScale * pixelsPerUnit > maxPixelError * distance)
+				break;
+			meshLods[i] = model.getLod(lod);
+		}
+	}
+}
+
+void Renderer::cullMeshlets(const std::vector<VisualComponent*>& visualComponents)
+{
+	// the meshlets of static visuals drawn at full detail against the camera's frustum and their normal cones, in
+	// the visual's own space. Shadows see the mesh from the light, the shadow pass draws the whole level of detail
+	glm::mat4 view = glm::lookAt(cameraPos, cameraLookAt, glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), getImpl().swapChainExtent.width / (float)getImpl().swapChainExtent.height, 0.1f, 20.0f);
+	bool isEnabled = gMeshletCulling.get() > 0;
+	Meshlets::CullStats stats;
+	mainPassRanges.clear();
+	mainPassRangeOffsets.assign(1, 0u);
+	for (size_t i = 0; i < visualComponents.size(); i++)
+	{
+		auto vis = visualComponents[i];
+		const Meshlets& meshlets = vis->getModel()->getMeshlets();
+		if (!isEnabled || meshLods[i].firstIndex != 0u || meshlets.isEmpty() || vis->isPlayingBakedAnimation() || !vis->getSkinningPalette().empty())
+			mainPassRanges.push_back({ meshLods[i].firstIndex, meshLods[i].numIndices });
+		else
+		{
+			auto worldTransform = vis->getTransform();
+			glm::mat4 model;
+			memcpy(&model, &worldTransform, sizeof(Mtx));
+			glm::mat4 clip = proj * view * model;
+
+			// rows of the clip matrix (Gribb and Hartmann), depth goes from 0 to 1
+			auto row = [&](int r) { return V4{ clip[0][r], clip[1][r], clip[2][r], clip[3][r] }; };
+			V4 frustumPlanes[] = { row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2) };
+			glm::vec4 localCameraPos = glm::inverse(model) * glm::vec4(cameraPos, 1.0f);
+			size_t firstRange = mainPassRanges.size();
+			meshlets.cull(V4{ localCameraPos.x, localCameraPos.y, localCameraPos.z, 1.0f }, frustumPlanes, mainPassRanges, stats);
+			for (size_t range = firstRange; range < mainPassRanges.size(); ++range)
+				mainPassRanges[range].firstIndex += vis->getModel()->getMeshletFirstIndex();
+		}
+		mainPassRangeOffsets.push_back((uint)mainPassRanges.size());
+	}
+	gStatMeshletCulledTriangles.set((int)stats.numCulledTriangles);
+}
+
 void Renderer::updateUniformBuffer(uint32_t currentImage, const std::vector<VisualComponent*>& visualComponents)
 {
 	static auto startTime = std::chrono::high_resolution_clock::now();
@@ -623,11 +679,24 @@ void Renderer::updateUniformBuffer(uint32_t currentImage, const std::vector<Visu
 		sceneDataForUniforms.light = light;
 		sceneDataForUniforms.offscreenMVP = offscreenMVP;
 		sceneDataForUniforms.material = visual->getMaterial();
-		sceneDataForUniforms.frame = visual->getAnimationFrame();
-		sceneDataForUniforms.initialFrame = visual->getInitialAnimationFrame();
+		if (visual->isPlayingBakedAnimation())
+		{
+			const BakedAnimation& baked = *visual->getModel()->getBakedAnimation();
+			uint frame0, frame1;
+			float alpha;
+			baked.getFrames(visual->getBakedAnimationTime(), frame0, frame1, alpha);
+			sceneDataForUniforms.baked.boundsMin = glm::vec4(baked.getBoundsMin().x, baked.getBoundsMin().y, baked.getBoundsMin().z, 0.0f);
+			sceneDataForUniforms.baked.boundsScale = glm::vec4(baked.getBoundsScale().x, baked.getBoundsScale().y, baked.getBoundsScale().z, 0.0f);
+			sceneDataForUniforms.baked.frameOffsets = glm::uvec2(frame0 * baked.getNumVertices(), frame1 * baked.getNumVertices());
+			sceneDataForUniforms.baked.frameAlpha = alpha;
+		}
 		sceneDatas.push_back(sceneDataForUniforms);
 	}
 
+	updateSkinningPalettes(currentImage, visualComponents);
+	selectMeshLods(visualComponents);
+	cullMeshlets(visualComponents);
+
 	pipeline->createUniformBuffers(visualComponents.size(), currentImage);
 	pipeline->createDescriptorSets(visualComponents.size(), currentImage, visualComponents);
 	pipeline->updateUniformBuffer(currentImage, sceneDatas.data(), visualComponents.size());
@@ -643,6 +712,14 @@ void Renderer::updateUniformBuffer(uint32_t currentImage, const std::vector<Visu
 	animOffscreenPipeline->createUniformBuffers(visualComponents.size(), currentImage);
 	animOffscreenPipeline->createDescriptorSets(visualComponents.size(), currentImage, visualComponents);
 	animOffscreenPipeline->updateUniformBuffer(currentImage, sceneDatas.data(), visualComponents.size());
+
+	bakedPipeline->createUniformBuffers(visualComponents.size(), currentImage);
+	bakedPipeline->createDescriptorSets(visualComponents.size(), currentImage, visualComponents);
+	bakedPipeline->updateUniformBuffer(currentImage, sceneDatas.data(), visualComponents.size());
+
+	bakedOffscreenPipeline->createUniformBuffers(visualComponents.size(), currentImage);
+	bakedOffscreenPipeline->createDescriptorSets(visualComponents.size(), currentImage, visualComponents);
+	bakedOffscreenPipeline->updateUniformBuffer(currentImage, sceneDatas.data(), visualComponents.size());
 }
 
 void Renderer::waitUntilDone()
@@ -708,7 +785,15 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t swapc
 		for (int i = 0; i < visualComponents.size(); ++i)
 		{
 			auto vis = visualComponents[i];
-			if (!vis->getInitialAnimationFrame())
+			if (vis->isPlayingBakedAnimation())
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bakedOffscreenPipeline->graphicsPipeline);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bakedOffscreenPipeline->pipelineLayout, 0, 1, &bakedOffscreenPipeline->descriptorSets[impl.currentFrame][i], 0, nullptr);
+				PushConstants constants;
+				constants.isPPLightingEnabled = isPPLightingEnabled;
+				vkCmdPushConstants(commandBuffer, bakedOffscreenPipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &constants);
+			}
+			else if (vis->getSkinningPalette().empty())
 			{
 				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline->graphicsPipeline);
 				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline->pipelineLayout, 0, 1, &offscreenPipeline->descriptorSets[impl.currentFrame][i], 0, nullptr);
@@ -719,19 +804,17 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t swapc
 			else
 			{
 				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, animOffscreenPipeline->graphicsPipeline);
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, animOffscreenPipeline->pipelineLayout, 0, 1, &animOffscreenPipeline->descriptorSets[impl.currentFrame][i], 0, nullptr);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, animOffscreenPipeline->pipelineLayout, 0, 1, &animOffscreenPipeline->descriptorSets[impl.currentFrame][i], 1, &skinningPaletteOffsets[i]);
 				PushConstants constants;
 				constants.isPPLightingEnabled = isPPLightingEnabled;
 				vkCmdPushConstants(commandBuffer, animOffscreenPipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &constants);
 			}
 
-			VkBuffer vertexBuffers[] = { vis->getModel()->getVertexBuffer() };
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+			vis->getModel()->bindVertexBuffers(commandBuffer);
 
 			vkCmdBindIndexBuffer(commandBuffer, vis->getModel()->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
 
-			vkCmdDrawIndexed(commandBuffer, vis->getModel()->getNumIndices(), 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, meshLods[i].numIndices, 1, meshLods[i].firstIndex, 0, 0);
 		}
 
 		vkCmdEndRenderPass(commandBuffer);
@@ -772,7 +855,15 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t swapc
 		for (int i = 0; i < visualComponents.size(); ++i)
 		{
 			auto vis = visualComponents[i];
-			if (!vis->getInitialAnimationFrame())
+			if (vis->isPlayingBakedAnimation())
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bakedPipeline->graphicsPipeline);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bakedPipeline->pipelineLayout, 0, 1, &bakedPipeline->descriptorSets[impl.currentFrame][i], 0, nullptr);
+				PushConstants constants;
+				constants.isPPLightingEnabled = isPPLightingEnabled;
+				vkCmdPushConstants(commandBuffer, bakedPipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &constants);
+			}
+			else if (vis->getSkinningPalette().empty())
 			{
 				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->graphicsPipeline);
 				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipelineLayout, 0, 1, &pipeline->descriptorSets[impl.currentFrame][i], 0, nullptr);
@@ -783,19 +874,18 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t swapc
 			else
 			{
 				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, animPipeline->graphicsPipeline);
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, animPipeline->pipelineLayout, 0, 1, &animPipeline->descriptorSets[impl.currentFrame][i], 0, nullptr);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, animPipeline->pipelineLayout, 0, 1, &animPipeline->descriptorSets[impl.currentFrame][i], 1, &skinningPaletteOffsets[i]);
 				PushConstants constants;
 				constants.isPPLightingEnabled = isPPLightingEnabled;
 				vkCmdPushConstants(commandBuffer, animPipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &constants);
 			}
 			
-			VkBuffer vertexBuffers[] = { vis->getModel()->getVertexBuffer()};
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+			vis->getModel()->bindVertexBuffers(commandBuffer);
 
 			vkCmdBindIndexBuffer(commandBuffer, vis->getModel()->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
 
-			vkCmdDrawIndexed(commandBuffer, vis->getModel()->getNumIndices(), 1, 0, 0, 0);
+			for (uint range = mainPassRangeOffsets[i]; range < mainPassRangeOffsets[i + 1]; ++range)
+				vkCmdDrawIndexed(commandBuffer, mainPassRanges[range].numIndices, 1, mainPassRanges[range].firstIndex, 0, 0);
 		}
 
 		vkCmdEndRenderPass(commandBuffer);
@@ -809,12 +899,12 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t swapc
 
 //==========================Pipeline=========================================//
 
-void Renderer::PipelineBase::init(Renderer* renderer_, std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes)
+void Renderer::PipelineBase::init(Renderer* renderer_, std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams)
 {
-	init(renderer_, shaderPath, shaderPath, renderPass, msaaSamples, numVertAttributes);
+	init(renderer_, shaderPath, shaderPath, renderPass, msaaSamples, vertexStreams);
 }
 
-void Renderer::PipelineBase::init(Renderer* renderer_, std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes)
+void Renderer::PipelineBase::init(Renderer* renderer_, std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams)
 {
 	renderer = renderer_;
 
@@ -837,8 +927,7 @@ void Renderer::PipelineBase::init(Renderer* renderer_, std::string_view vertShad
 	vkDestroyBuffer(getDevice(), sampleBuffer, nullptr);
 
 	createDescriptorSetLayout();
-	createGraphicsPipeline(vertShaderPath, fragShaderPath, renderPass, msaaSamples, numVertAttributes);
-	constexpr int maxNumVisuals = 100;
+	createGraphicsPipeline(vertShaderPath, fragShaderPath, renderPass, msaaSamples, vertexStreams);
 	allocateUniformBuffersMemory(maxNumVisuals);
 	createDescriptorPool(maxNumVisuals);
 }
@@ -860,12 +949,12 @@ void Renderer::PipelineBase::deinit()
 	vkDestroyPipelineLayout(getDevice(), pipelineLayout, nullptr);
 }
 
-void Renderer::PipelineBase::createGraphicsPipeline(std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes)
+void Renderer::PipelineBase::createGraphicsPipeline(std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams)
 {
-	createGraphicsPipeline(shaderPath, shaderPath, renderPass, msaaSamples, numVertAttributes);
+	createGraphicsPipeline(shaderPath, shaderPath, renderPass, msaaSamples, vertexStreams);
 }
 
-void Renderer::PipelineBase::createGraphicsPipeline(std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes)
+void Renderer::PipelineBase::createGraphicsPipeline(std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams)
 {
 	auto vertShaderCode = readFile(std::format("shaders/{}_v.spv", vertShaderPath));
 	auto fragShaderCode = readFile(std::format("shaders/{}_f.spv", fragShaderPath));
@@ -889,12 +978,12 @@ void Renderer::PipelineBase::createGraphicsPipeline(std::string_view vertShaderP
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions(numVertAttributes);
+	auto bindingDescriptions = VertexFormat::getBindingDescriptions(vertexStreams);
+	auto attributeDescriptions = VertexFormat::getAttributeDescriptions(vertexStreams);
 
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
@@ -1068,6 +1157,27 @@ void Renderer::PipelineBase::createUniformBuffers(int numVisuals, int frameIndex
 	}
 }
 
+VkDescriptorBufferInfo Renderer::PipelineBase::getSkinningPaletteInfo(int currentImage)
+{
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = renderer->skinningPaletteBuffers[currentImage];
+	bufferInfo.offset = 0;
+	bufferInfo.range = SKINNING_PALETTE_SIZE;
+	return bufferInfo;
+}
+
+VkDescriptorBufferInfo Renderer::PipelineBase::getBakedAnimationInfo(const VisualComponent* visual)
+{
+	VkDescriptorBufferInfo bufferInfo{};
+	if (visual->isPlayingBakedAnimation())
+	{
+		bufferInfo.buffer = visual->getModel()->getBakedAnimationBuffer();
+		bufferInfo.offset = 0;
+		bufferInfo.range = VK_WHOLE_SIZE;
+	}
+	return bufferInfo;
+}
+
 void Renderer::PipelineBase::updateUniformBuffer(uint32_t currentImage, const void* sceneDataForUniforms, int numVisuals)
 {
 	const SceneDataForUniforms* sceneData = reinterpret_cast<const SceneDataForUniforms*>(sceneDataForUniforms);
@@ -35,13 +35,13 @@ public:
 	{
 		virtual ~PipelineBase() = default;
 
-		void init(Renderer* renderer, std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes);
-		void init(Renderer* renderer, std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes);
+		void init(Renderer* renderer, std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams);
+		void init(Renderer* renderer, std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams);
 		void deinit();
 
 		virtual void createDescriptorSetLayout() = 0;
-		void createGraphicsPipeline(std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes);
-		void createGraphicsPipeline(std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, int numVertAttributes);
+		void createGraphicsPipeline(std::string_view vertShaderPath, std::string_view fragShaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams);
+		void createGraphicsPipeline(std::string_view shaderPath, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, uint vertexStreams);
 
 		void allocateUniformBuffersMemory(int maxNumVisuals);
 		void createUniformBuffers(int numVisuals, int currentImage);
@@ -51,6 +51,10 @@ public:
 		virtual size_t getUBOSize() const = 0;
 		void updateUniformBuffer(uint32_t currentImage, const void* sceneDataForUniforms, int numVisuals);
 		virtual void fillUBO(const void* sceneData, void* ubo) = 0;
+		// The frame's skinning palette buffer for the skinned pipelines' descriptor sets, the slot is a dynamic offset
+		VkDescriptorBufferInfo getSkinningPaletteInfo(int currentImage);
+		// The baked animation buffer of the visual's model for the baked pipelines, no buffer if it isn't playing one
+		VkDescriptorBufferInfo getBakedAnimationInfo(const VisualComponent* visual);
 
 		RendererImpl& getImpl() { return renderer->impl; }
 		VkDevice getDevice() { return renderer->impl.device; }
@@ -82,9 +86,15 @@ private:
 
 	friend class RendererImpl;
 
+	static constexpr int maxNumVisuals = 100;
+
 	void createTextureSampler();
+	void createSkinningPaletteBuffers();
 	
 	void updateUniformBuffer(uint32_t currentImage, const std::vector<VisualComponent*>& visualComponents);
+	void updateSkinningPalettes(uint32_t currentImage, const std::vector<VisualComponent*>& visualComponents);
+	void selectMeshLods(const std::vector<VisualComponent*>& visualComponents);
+	void cullMeshlets(const std::vector<VisualComponent*>& visualComponents);
 	
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t swapchainImageIndex, const std::vector<VisualComponent*>& visualComponents);
 	
@@ -94,6 +104,21 @@ private:
 	std::unique_ptr<PipelineBase> animPipeline;
 	std::unique_ptr<PipelineBase> offscreenPipeline;
 	std::unique_ptr<PipelineBase> animOffscreenPipeline;
+	std::unique_ptr<PipelineBase> bakedPipeline;
+	std::unique_ptr<PipelineBase> bakedOffscreenPipeline;
+
+	// One buffer per frame in flight with a palette slot per visual, shared by the skinned shadow and main pipelines
+	VkBuffer skinningPaletteBuffers[RendererImpl::getNumFramesInFlightStatic()];
+	VkDeviceMemory skinningPaletteBuffersMemory[RendererImpl::getNumFramesInFlightStatic()];
+	void* skinningPaletteBuffersMapped[RendererImpl::getNumFramesInFlightStatic()];
+	VkDeviceSize skinningPaletteStride = 0;
+	// Dynamic offset of every visual's palette slot for the frame being recorded
+	std::vector<uint32_t> skinningPaletteOffsets;
+	// The level of detail every visual draws in the frame being recorded
+	std::vector<Model::LodRange> meshLods;
+	// What the main pass draws of every visual, its level of detail or the meshlets of it that weren't culled
+	std::vector<Meshlets::IndexRange> mainPassRanges;
+	std::vector<uint> mainPassRangeOffsets;
 	
 	uint32_t mipLevels;
 	bool isPPLightingEnabled = true;